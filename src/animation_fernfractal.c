@@ -14,6 +14,7 @@
 #define ANIMATION_FERN_FRACTAL_NAME               "FernFractal"
 #define ANIMATION_FERN_FRACTAL_DEFAULT_FPS        (10)
 #define ANIMATION_FERN_FRACTAL_POINTS_PER_FRAME   (500)
+#define ANIMATION_FERN_FRACTAL_MESSAGE_SAMPLING   (50)     /* One message out of so many points */
 
 
 struct animation_fern_fractal_state_s
@@ -21,6 +22,7 @@ struct animation_fern_fractal_state_s
 	double xn;
 	double yn;
 	int points;
+	console_rate_t message_rate;
 };
 
 typedef struct animation_fern_fractal_state_s animation_fern_fractal_state_t;
@@ -58,6 +60,8 @@ static animation_t * animation_fern_fractal_create( animation_t * parent )
 	if(!state)
 		return NULL;
 
+	state->message_rate.every = ANIMATION_FERN_FRACTAL_MESSAGE_SAMPLING;
+
 	animation_set_default_fps( parent, ANIMATION_FERN_FRACTAL_DEFAULT_FPS );
 	animation_set_name( parent, ANIMATION_FERN_FRACTAL_NAME );
 	animation_set_state( parent, (void*) state );
@@ -176,7 +180,7 @@ static void animation_fern_fractal_next_frame( animation_t * this )
 		state->yn = yn;
 
 		/* Message */
-		console_add_line( con, "pts=%d / r=%d / xn=%0.3f / yn=%0.3f", state->points, r, xn, yn );
+		console_add_line_rated( con, &state->message_rate, "pts=%d / r=%d / xn=%0.3f / yn=%0.3f", state->points, r, xn, yn );
 
 		/* Fit Figure to the Frame Coordinates */
 		frame_get_dimensions( frm, &xmax, &ymax );
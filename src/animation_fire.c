@@ -82,7 +82,6 @@ static void animation_fire_initialize( animation_t * this )
 	animation_fire_state_t * state = animation_get_state(this);
 	palette_t * pal = animation_get_palette(this);
 	frame_t * frm = animation_get_frame(this);
-	int i = 0;
 
 	srand(time(NULL));
 
@@ -91,13 +90,10 @@ static void animation_fire_initialize( animation_t * this )
 	frame_set_border_mode( state->prevfrm, frame_border_toroidal );
 
 	/* Red Fire Palette */
-	for( i = 0; i < 64; i++ )
-	{
-		palette_set_color( pal, i, i * 4, 0,  0 );
-		palette_set_color( pal, i + 64, 255,  i * 4, 0 );
-		palette_set_color( pal, i + 128, 255,  255, i * 4 );
-		palette_set_color( pal, i + 192, 255, 255, 255 );
-	}
+	palette_set_gradient( pal, 0, 63, 0, 0, 0, 252, 0, 0 );
+	palette_set_gradient( pal, 64, 127, 255, 0, 0, 255, 252, 0 );
+	palette_set_gradient( pal, 128, 191, 255, 255, 0, 255, 255, 252 );
+	palette_set_gradient( pal, 192, 255, 255, 255, 255, 255, 255, 255 );
 }
 
 
@@ -0,0 +1,210 @@
+/*!
+	\file animation_plasma.c
+	\brief Plasma Animation Implementation
+	\author Tiago Ventura (tiago.ventura@gmail.com)
+*/
+
+#include <stdlib.h>
+#include <math.h>
+
+#include "frame.h"
+#include "palette.h"
+#include "palette_animator.h"
+#include "animation.h"
+#include "animation_plasma.h"
+
+
+#define ANIMATION_PLASMA_NAME               "Plasma"
+#define ANIMATION_PLASMA_DEFAULT_FPS        (30)
+#define ANIMATION_PLASMA_COLOR_COUNT        (256)
+#define ANIMATION_PLASMA_CYCLE_SPEED        (64.0)   /* Colors per second */
+#define ANIMATION_PLASMA_SCHEME_SECONDS     (8.0)    /* Time on each color scheme */
+#define ANIMATION_PLASMA_FADE_SECONDS       (2.0)
+#define ANIMATION_PLASMA_SCHEMES_COUNT      (3)
+
+
+struct animation_plasma_state_s
+{
+	palette_animator_t * animator;
+	palette_t * scheme[ ANIMATION_PLASMA_SCHEMES_COUNT ];
+	int current;
+	int logged;        /* scheme and fading state of the last console line, -1 for none */
+	double elapsed;
+};
+
+typedef struct animation_plasma_state_s animation_plasma_state_t;
+
+
+static animation_t * animation_plasma_create( animation_t * parent );
+static void animation_plasma_destroy( animation_t * this );
+static void animation_plasma_next_frame( animation_t * this );
+static void animation_plasma_initialize( animation_t * this );
+static void animation_plasma_finish( animation_t * this );
+
+
+animation_implementation_t * animation_plasma_get_implementation( void )
+{
+	static animation_implementation_t impl;
+
+	impl.create = animation_plasma_create;
+	impl.destroy = animation_plasma_destroy;
+	impl.initialize = animation_plasma_initialize;
+	impl.finish = animation_plasma_finish;
+	impl.first_frame = animation_plasma_next_frame;
+	impl.next_frame = animation_plasma_next_frame;
+	impl.previous_frame = animation_plasma_next_frame;
+
+	return &impl;
+}
+
+
+static animation_t * animation_plasma_create( animation_t * parent )
+{
+	animation_plasma_state_t * state = NULL;
+
+	state = calloc( 1, sizeof(animation_plasma_state_t) );
+
+	if(!state)
+		return NULL;
+
+	animation_set_default_fps( parent, ANIMATION_PLASMA_DEFAULT_FPS );
+	animation_set_name( parent, ANIMATION_PLASMA_NAME );
+	animation_set_state( parent, (void*) state );
+
+	return parent;
+}
+
+
+static void animation_plasma_destroy( animation_t * this )
+{
+	free( animation_get_state( this ) );
+}
+
+
+/* Color schemes are made of gradients that wrap around, so that cycling shows no seam */
+static void animation_plasma_make_schemes( animation_plasma_state_t * state )
+{
+	palette_t ** s = state->scheme;
+
+	/* Blue, cyan, white, purple */
+	palette_set_gradient( s[0], 0, 63, 0, 0, 64, 0, 160, 255 );
+	palette_set_gradient( s[0], 64, 127, 0, 160, 255, 255, 255, 255 );
+	palette_set_gradient( s[0], 128, 191, 255, 255, 255, 160, 0, 192 );
+	palette_set_gradient( s[0], 192, 255, 160, 0, 192, 0, 0, 64 );
+
+	/* Lava */
+	palette_set_gradient( s[1], 0, 63, 32, 0, 0, 255, 64, 0 );
+	palette_set_gradient( s[1], 64, 127, 255, 64, 0, 255, 255, 0 );
+	palette_set_gradient( s[1], 128, 191, 255, 255, 0, 128, 0, 0 );
+	palette_set_gradient( s[1], 192, 255, 128, 0, 0, 32, 0, 0 );
+
+	/* Green, yellow, teal */
+	palette_set_gradient( s[2], 0, 63, 0, 32, 0, 0, 255, 64 );
+	palette_set_gradient( s[2], 64, 127, 0, 255, 64, 255, 255, 0 );
+	palette_set_gradient( s[2], 128, 191, 255, 255, 0, 0, 128, 128 );
+	palette_set_gradient( s[2], 192, 255, 0, 128, 128, 0, 32, 0 );
+}
+
+
+static void animation_plasma_initialize( animation_t * this )
+{
+	animation_plasma_state_t * state = animation_get_state( this );
+	frame_t * frm = animation_get_frame( this );
+	palette_t * pal = animation_get_palette( this );
+	frame_point_t pt;
+	double value = 0.0;
+	int ncols = 0;
+	int nrows = 0;
+	int col = 0;
+	int row = 0;
+	int val = 0;
+	int i = 0;
+
+	state->animator = palette_animator_create();
+
+	for( i = 0; i < ANIMATION_PLASMA_SCHEMES_COUNT; i++ )
+		state->scheme[i] = palette_create();
+
+	animation_plasma_make_schemes( state );
+
+	state->current = 0;
+	state->logged = -1;
+	state->elapsed = 0.0;
+
+	palette_copy( pal, state->scheme[0] );
+
+	palette_animator_set_base( state->animator, state->scheme[0] );
+	palette_animator_add_cycle( state->animator, 0, ANIMATION_PLASMA_COLOR_COUNT, ANIMATION_PLASMA_CYCLE_SPEED );
+
+	/* The frame never changes again: all the motion comes from the palette */
+	frame_get_dimensions( frm, &ncols, &nrows );
+
+	for( row = 0; row < nrows; row++ )
+	{
+		for( col = 0; col < ncols; col++ )
+		{
+			value = sin( col / 16.0 ) +
+					sin( row / 8.0 ) +
+					sin( (col + row) / 16.0 ) +
+					sin( sqrt( (double) col * col + (double) row * row ) / 8.0 );
+
+			val = (int) ((value + 4.0) * (ANIMATION_PLASMA_COLOR_COUNT / 8.0)) & (ANIMATION_PLASMA_COLOR_COUNT - 1);
+
+			frame_make_point( &pt, 0, val, val, ' ' );
+			frame_set_point( frm, col, row, &pt );
+		}
+	}
+}
+
+
+static void animation_plasma_finish( animation_t * this )
+{
+	animation_plasma_state_t * state = animation_get_state( this );
+	int i = 0;
+
+	for( i = 0; i < ANIMATION_PLASMA_SCHEMES_COUNT; i++ )
+	{
+		if( state->scheme[i] )
+			palette_destroy( state->scheme[i] );
+
+		state->scheme[i] = NULL;
+	}
+
+	if( state->animator )
+		palette_animator_destroy( state->animator );
+
+	state->animator = NULL;
+}
+
+
+static void animation_plasma_next_frame( animation_t * this )
+{
+	animation_plasma_state_t * state = animation_get_state( this );
+	console_t * con = animation_get_console( this );
+	double dt = 1.0 / ANIMATION_PLASMA_DEFAULT_FPS;
+	int fading = 0;
+
+	state->elapsed += dt;
+
+	if( state->elapsed >= ANIMATION_PLASMA_SCHEME_SECONDS )
+	{
+		state->elapsed = 0.0;
+		state->current = (state->current + 1) % ANIMATION_PLASMA_SCHEMES_COUNT;
+
+		palette_animator_fade_to( state->animator, state->scheme[ state->current ], ANIMATION_PLASMA_FADE_SECONDS );
+	}
+
+	palette_animator_update( state->animator, animation_get_palette( this ), dt );
+
+	fading = palette_animator_is_fading( state->animator );
+
+	/* The line only changes with the scheme, do not format it on every step */
+	if( state->current * 2 + fading != state->logged )
+	{
+		state->logged = state->current * 2 + fading;
+
+		console_add_line( con, "scheme=%d / fading=%d", state->current, fading );
+	}
+}
+
+/* $Id$ */
@@ -0,0 +1,34 @@
+/*!
+	\file animation_plasma.h
+	\brief Plasma Animation Interface
+	\author Tiago Ventura (tiago.ventura@gmail.com)
+*/
+
+
+#ifndef __ANIMATION_PLASMA_H__
+#define __ANIMATION_PLASMA_H__
+
+
+#include "animation.h"
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/*!
+	\brief Concrete Animation: Plasma (palette cycling, the frame is drawn only once)
+	\return
+*/
+animation_implementation_t * animation_plasma_get_implementation( void );
+
+
+#ifdef __cplusplus
+}
+#endif
+
+
+#endif /* __ANIMATION_PLASMA_H__ */
+
+/* $Id$ */
@@ -5,23 +5,37 @@
 */
 
 #include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
 #include <math.h>
 #include <time.h>
+#include <unistd.h>
 
+#include "common.h"
 #include "frame.h"
 #include "animation.h"
 #include "animation_swarm.h"
-
-
-#define ANIMATION_SWARM_NAME          "Swarm"
-#define ANIMATION_SWARM_DEFAULT_FPS   (2)
-#define ANIMATION_SWARM_MIN_SPEED     (50)
-#define ANIMATION_SWARM_MAX_SPEED     (200)
-#define ANIMATION_SWARM_MAX_ACCEL     (25)
-#define ANIMATION_SWARM_MAX_TURN      (M_PI)
-#define ANIMATION_SWARM_OUTER_RANGE   (64)
-#define ANIMATION_SWARM_INNER_RANGE   (5)
-#define ANIMATION_SWARM_BEES_COUNT    (4000)
+#include "workers.h"
+
+
+#define ANIMATION_SWARM_NAME                "Swarm"
+#define ANIMATION_SWARM_DEFAULT_FPS         (20)
+#define ANIMATION_SWARM_MIN_SPEED           (50.0f)
+#define ANIMATION_SWARM_MAX_SPEED           (200.0f)
+#define ANIMATION_SWARM_MAX_ACCEL           (25.0f)
+#define ANIMATION_SWARM_MAX_TURN            ((float) M_PI)
+#define ANIMATION_SWARM_OUTER_RANGE         (64.0f)
+#define ANIMATION_SWARM_INNER_RANGE         (5.0f)
+#define ANIMATION_SWARM_SEPARATION_RANGE    (4.0f)
+#define ANIMATION_SWARM_SEPARATION_WEIGHT   (0.5f)
+#define ANIMATION_SWARM_MAX_NEIGHBOURS      (8)
+#define ANIMATION_SWARM_MAX_CANDIDATES      (32)
+#define ANIMATION_SWARM_BEES_COUNT          (100000)
+#define ANIMATION_SWARM_MAX_THREADS         (8)
+#define ANIMATION_SWARM_REFERENCE_ROWS      (480.0f)
+#define ANIMATION_SWARM_ATTACK_COLOR        (14)
+#define ANIMATION_SWARM_EVADE_COLOR         (12)
+#define ANIMATION_SWARM_TARGET_COLOR        (15)
 
 
 enum animation_swarm_bee_mode_e
@@ -33,35 +47,72 @@ enum animation_swarm_bee_mode_e
 typedef enum animation_swarm_bee_mode_e animation_swarm_bee_mode_t;
 
 
-struct animation_swarm_bee_s
+typedef struct animation_swarm_state_s animation_swarm_state_t;
+
+
+/*!
+	\brief Represents a slice of bees stepped by one task of the workers pool
+*/
+struct animation_swarm_worker_s
 {
-	int x;
-	int y;
-	double theta;
-	double speed;
-	animation_swarm_bee_mode_t mode;
+	animation_swarm_state_t * state;
+	int first;
+	int last;
+	uint32_t seed;
 };
 
-typedef struct animation_swarm_bee_s animation_swarm_bee_t;
+typedef struct animation_swarm_worker_s animation_swarm_worker_t;
 
 
-struct animation_swarm_s
+/*!
+	\brief Uniform grid used as spatial hash for neighbour queries
+*/
+struct animation_swarm_grid_s
 {
-	int xpos;
-	int ypos;
-	animation_swarm_bee_t bees[ ANIMATION_SWARM_BEES_COUNT ];
+	int ncols;
+	int nrows;
+	float cell_size;
+	int * cell_start;   /* ncols * nrows + 1 prefix sums */
+	int * cell_bees;    /* bees indexes sorted by cell */
+	int * bee_cell;     /* cell index of each bee */
+	float * cell_x;     /* positions sorted by cell, keeps queries cache friendly */
+	float * cell_y;
 };
 
-typedef struct animation_swarm_s animation_swarm_t;
+typedef struct animation_swarm_grid_s animation_swarm_grid_t;
 
 
+/*!
+	\brief Swarm state, bees are kept as structure of arrays
+*/
 struct animation_swarm_state_s
 {
-	animation_swarm_t swarm;
+	int count;
+	int nthreads;
+
+	float * x;
+	float * y;
+	float * next_x;
+	float * next_y;
+	float * vx;
+	float * vy;
+	float * sepx;
+	float * sepy;
+	uint8_t * mode;
+
+	animation_swarm_grid_t grid;
+	animation_swarm_worker_t * workers;
+	workers_t * pool;   /* persistent threads parked between steps, NULL steps on the caller */
+
+	float width;
+	float height;
+	float scale;
+	float dt;
+	float time;
+	float target_x;
+	float target_y;
 };
 
-typedef struct animation_swarm_state_s animation_swarm_state_t;
-
 
 static animation_t * animation_swarm_create( animation_t * parent );
 static void animation_swarm_destroy( animation_t * this );
@@ -89,12 +140,18 @@ animation_implementation_t * animation_swarm_get_implementation( void )
 static animation_t * animation_swarm_create( animation_t * parent )
 {
 	animation_swarm_state_t * state = NULL;
+	long ncpus = 0;
 
 	state = calloc( 1, sizeof(animation_swarm_state_t) );
 
 	if(!state)
 		return NULL;
 
+	ncpus = sysconf( _SC_NPROCESSORS_ONLN );
+
+	state->count = ANIMATION_SWARM_BEES_COUNT;
+	state->nthreads = (ncpus < 1) ? 1 : ( (ncpus > ANIMATION_SWARM_MAX_THREADS) ? ANIMATION_SWARM_MAX_THREADS : ncpus );
+
 	animation_set_default_fps( parent, ANIMATION_SWARM_DEFAULT_FPS );
 	animation_set_name( parent, ANIMATION_SWARM_NAME );
 	animation_set_state( parent, (void*) state );
@@ -109,11 +166,145 @@ static void animation_swarm_destroy( animation_t * this )
 }
 
 
+void animation_swarm_set_bees_count( animation_t * this, int count )
+{
+	animation_swarm_state_t * state = animation_get_state(this);
+
+	if( count > 0 )
+		state->count = count;
+}
+
+
+int animation_swarm_get_bees_count( animation_t * this )
+{
+	return ((animation_swarm_state_t*) animation_get_state(this))->count;
+}
+
+
+void animation_swarm_set_threads_count( animation_t * this, int count )
+{
+	animation_swarm_state_t * state = animation_get_state(this);
+
+	if( count < 1 )
+		count = 1;
+
+	if( count > ANIMATION_SWARM_MAX_THREADS )
+		count = ANIMATION_SWARM_MAX_THREADS;
+
+	state->nthreads = count;
+}
+
+
+int animation_swarm_get_threads_count( animation_t * this )
+{
+	return ((animation_swarm_state_t*) animation_get_state(this))->nthreads;
+}
+
+
+static inline uint32_t animation_swarm_random( uint32_t * seed )
+{
+	/* xorshift32, one independent generator per worker */
+	uint32_t s = *seed;
+
+	s ^= s << 13;
+	s ^= s >> 17;
+	s ^= s << 5;
+
+	*seed = s;
+
+	return s;
+}
+
+
+static inline float animation_swarm_random_value( uint32_t * seed, float val )
+{
+	return val * ( (animation_swarm_random( seed ) >> 8) * (1.0f / 16777216.0f) );
+}
+
+
+static inline float animation_swarm_clamp( float val, float min, float max )
+{
+	/* Plain compares are if-converted by the vectorizer, fminf/fmaxf are not */
+	val = (val < min) ? min : val;
+	return (val > max) ? max : val;
+}
+
+
+static void animation_swarm_free_buffers( animation_swarm_state_t * state )
+{
+	free( state->x );
+	free( state->y );
+	free( state->next_x );
+	free( state->next_y );
+	free( state->vx );
+	free( state->vy );
+	free( state->sepx );
+	free( state->sepy );
+	free( state->mode );
+	free( state->grid.cell_start );
+	free( state->grid.cell_bees );
+	free( state->grid.bee_cell );
+	free( state->grid.cell_x );
+	free( state->grid.cell_y );
+	free( state->workers );
+
+	if( state->pool )
+		workers_destroy( state->pool );
+
+	state->x = state->y = state->next_x = state->next_y = NULL;
+	state->vx = state->vy = state->sepx = state->sepy = NULL;
+	state->mode = NULL;
+	state->grid.cell_start = state->grid.cell_bees = state->grid.bee_cell = NULL;
+	state->grid.cell_x = state->grid.cell_y = NULL;
+	state->workers = NULL;
+	state->pool = NULL;
+}
+
+
+static int animation_swarm_alloc_buffers( animation_swarm_state_t * state )
+{
+	int n = state->count;
+	int ncells = state->grid.ncols * state->grid.nrows;
+
+	state->x = (float*) calloc( n, sizeof(float) );
+	state->y = (float*) calloc( n, sizeof(float) );
+	state->next_x = (float*) calloc( n, sizeof(float) );
+	state->next_y = (float*) calloc( n, sizeof(float) );
+	state->vx = (float*) calloc( n, sizeof(float) );
+	state->vy = (float*) calloc( n, sizeof(float) );
+	state->sepx = (float*) calloc( n, sizeof(float) );
+	state->sepy = (float*) calloc( n, sizeof(float) );
+	state->mode = (uint8_t*) calloc( n, sizeof(uint8_t) );
+	state->grid.cell_start = (int*) calloc( ncells + 1, sizeof(int) );
+	state->grid.cell_bees = (int*) calloc( n, sizeof(int) );
+	state->grid.bee_cell = (int*) calloc( n, sizeof(int) );
+	state->grid.cell_x = (float*) calloc( n, sizeof(float) );
+	state->grid.cell_y = (float*) calloc( n, sizeof(float) );
+	state->workers = (animation_swarm_worker_t*) calloc( state->nthreads, sizeof(animation_swarm_worker_t) );
+	state->pool = ( state->nthreads > 1 ) ? workers_create( state->nthreads ) : NULL;
+
+	if( !state->x || !state->y || !state->next_x || !state->next_y ||
+		!state->vx || !state->vy || !state->sepx || !state->sepy || !state->mode ||
+		!state->grid.cell_start || !state->grid.cell_bees || !state->grid.bee_cell ||
+		!state->grid.cell_x || !state->grid.cell_y ||
+		!state->workers )
+	{
+		animation_swarm_free_buffers( state );
+		return -1;
+	}
+
+	return 0;
+}
+
+
 static void animation_swarm_initialize( animation_t * this )
 {
 	int ncols = 0;
 	int nrows = 0;
 	int i = 0;
+	int slice = 0;
+	float theta = 0.0f;
+	float cell_size = 0.0f;
 	frame_t * frm = animation_get_frame(this);
 	animation_swarm_state_t * state = animation_get_state(this);
 
@@ -121,133 +312,346 @@ static void animation_swarm_initialize( animation_t * this )
 
 	frame_get_dimensions( frm, &ncols, &nrows );
 
-	state->swarm.xpos = ncols / 2;
-	state->swarm.ypos = nrows / 2;
+	/* Speeds and ranges are tuned for 640x480, scale them to the actual frame */
+	state->width = ncols;
+	state->height = nrows;
+	state->scale = nrows / ANIMATION_SWARM_REFERENCE_ROWS;
+	state->dt = 1.0f / ANIMATION_SWARM_DEFAULT_FPS;
+	state->time = 0.0f;
+	state->target_x = ncols / 2;
+	state->target_y = nrows / 2;
+
+	cell_size = ANIMATION_SWARM_SEPARATION_RANGE * state->scale;
+
+	if( cell_size < 1.0f )
+		cell_size = 1.0f;
+
+	state->grid.cell_size = cell_size;
+	state->grid.ncols = (int) ceilf( ncols / cell_size );
+	state->grid.nrows = (int) ceilf( nrows / cell_size );
+
+	if( animation_swarm_alloc_buffers( state ) )
+		return;
 
-	for( i = 0; i < ANIMATION_SWARM_BEES_COUNT; i++ )
+	for( i = 0; i < state->count; i++ )
 	{
-		state->swarm.bees[i].x = (rand() % ncols);
-		state->swarm.bees[i].y = (rand() % nrows);
-		state->swarm.bees[i].theta = ( (M_PI * 2) * ( (double) rand() / RAND_MAX ) );
-		state->swarm.bees[i].speed = ANIMATION_SWARM_MIN_SPEED;
-		state->swarm.bees[i].mode = mode_attack;
+		theta = (float) ( (M_PI * 2) * ( (double) rand() / RAND_MAX ) );
+
+		state->x[i] = (float) (rand() % ncols);
+		state->y[i] = (float) (rand() % nrows);
+		state->vx[i] = ANIMATION_SWARM_MIN_SPEED * state->scale * cosf( theta );
+		state->vy[i] = ANIMATION_SWARM_MIN_SPEED * state->scale * sinf( theta );
+		state->mode[i] = mode_attack;
+	}
+
+	slice = ( state->count + state->nthreads - 1 ) / state->nthreads;
+
+	for( i = 0; i < state->nthreads; i++ )
+	{
+		state->workers[i].state = state;
+		state->workers[i].first = i * slice;
+		state->workers[i].last = ( (i + 1) * slice > state->count ) ? state->count : (i + 1) * slice;
+		state->workers[i].seed = ( (uint32_t) rand() << 1 ) | 1;
 	}
 }
 
 
-static void animation_swarm_finish( animation_t * parent )
+static void animation_swarm_finish( animation_t * this )
 {
+	animation_swarm_free_buffers( animation_get_state(this) );
 }
 
 
-static void animation_swarm_next_frame( animation_t * this )
+static void animation_swarm_build_grid( animation_swarm_state_t * state )
 {
-	int col = 0;
-	int row = 0;
-	int ncols = 0;
-	int nrows = 0;
-	frame_t * frm = animation_get_frame( this );
-	console_t * con = animation_get_console( this );
+	animation_swarm_grid_t * grid = &state->grid;
+	int ncells = grid->ncols * grid->nrows;
+	float inv = 1.0f / grid->cell_size;
+	int i = 0;
+	int gx = 0;
+	int gy = 0;
+	int c = 0;
 
-	ncols = frame_get_cols_count( frm );
-	nrows = frame_get_rows_count( frm );
+	/* Counting sort of the bees by cell */
+	memset( grid->cell_start, 0, (ncells + 1) * sizeof(int) );
 
-	for( row = 0; row < nrows; row++ )
+	for( i = 0; i < state->count; i++ )
 	{
-		for( col = 0; col < ncols; col++ )
-		{
+		gx = (int) ( state->x[i] * inv );
+		gy = (int) ( state->y[i] * inv );
 
-		}
-	}
+		gx = (gx < 0) ? 0 : ( (gx >= grid->ncols) ? grid->ncols - 1 : gx );
+		gy = (gy < 0) ? 0 : ( (gy >= grid->nrows) ? grid->nrows - 1 : gy );
 
-	console_add_line( con, "swarm frame" );
-}
+		c = gy * grid->ncols + gx;
 
+		grid->bee_cell[i] = c;
+		grid->cell_start[ c + 1 ]++;
+	}
 
-static double random_value( double val )
-{
-	return val * ((double) rand() / RAND_MAX );
-}
+	for( c = 0; c < ncells; c++ )
+		grid->cell_start[ c + 1 ] += grid->cell_start[c];
 
+	/* cell_start[c] is used as insertion cursor and restored afterwards */
+	for( i = 0; i < state->count; i++ )
+	{
+		c = grid->cell_start[ grid->bee_cell[i] ]++;
 
-static double distance( int xa, int ya, int xb, int yb )
-{
-	int a = (xb - xa);
-	int b = (yb - ya);
+		grid->cell_bees[c] = i;
+		grid->cell_x[c] = state->x[i];
+		grid->cell_y[c] = state->y[i];
+	}
+
+	for( c = ncells; c > 0; c-- )
+		grid->cell_start[c] = grid->cell_start[ c - 1 ];
 
-	return ( sqrt( (a * a) + (b * b) ) );
+	grid->cell_start[0] = 0;
 }
 
 
-static void update( animation_t * this, double dt, int x, int y )
+static void animation_swarm_separation( animation_swarm_state_t * state, int i, float * sx, float * sy )
 {
-	double s = 0.0;
-	double phi = 0.0;
-	double accel = 0.0;
-	double turn = 0.0;
-	double k = 0.0;
+	const animation_swarm_grid_t * grid = &state->grid;
+	float range = grid->cell_size;
+	float range2 = range * range;
+	float xi = state->x[i];
+	float yi = state->y[i];
+	float dx = 0.0f;
+	float dy = 0.0f;
+	float d2 = 0.0f;
+	float ax = 0.0f;
+	float ay = 0.0f;
+	int cx = grid->bee_cell[i] % grid->ncols;
+	int cy = grid->bee_cell[i] / grid->ncols;
+	int gx = 0;
+	int gy = 0;
+	int k = 0;
+	int j = 0;
+	int c = 0;
+	int found = 0;
+	int examined = 0;
+
+	for( gy = cy - 1; (gy <= cy + 1) && (found < ANIMATION_SWARM_MAX_NEIGHBOURS) && (examined < ANIMATION_SWARM_MAX_CANDIDATES); gy++ )
+	{
+		if( (gy < 0) || (gy >= grid->nrows) )
+			continue;
 
-	animation_swarm_state_t * state = animation_get_state(this);
+		for( gx = cx - 1; (gx <= cx + 1) && (found < ANIMATION_SWARM_MAX_NEIGHBOURS) && (examined < ANIMATION_SWARM_MAX_CANDIDATES); gx++ )
+		{
+			if( (gx < 0) || (gx >= grid->ncols) )
+				continue;
 
-	s = distance( state->swarm.xpos, state->y, x, y );
+			c = gy * grid->ncols + gx;
 
-	switch( state->mode )
-	{
-		case mode_attack :
-		{
-			( (M_PI * 2) * ( (double) rand() / RAND_MAX ) )
+			for( k = grid->cell_start[c]; (k < grid->cell_start[ c + 1 ]) && (found < ANIMATION_SWARM_MAX_NEIGHBOURS) && (examined < ANIMATION_SWARM_MAX_CANDIDATES); k++ )
+			{
+				j = grid->cell_bees[k];
 
-			if( random_value(s) < random_value(ANIMATION_SWARM_INNER_RANGE) )
-				mode = mode_evade;
+				if( j == i )
+					continue;
 
-			break;
-		}
+				examined++;
 
-		case mode_evade :
-		{
-			if( random_value(s) > random_value(ANIMATION_SWARM_OUTER_RANGE) )
-				mode = mode_attack;
+				dx = xi - grid->cell_x[k];
+				dy = yi - grid->cell_y[k];
+				d2 = (dx * dx) + (dy * dy);
+
+				if( (d2 >= range2) || (d2 <= 0.0f) )
+					continue;
+
+				/* Linear falloff, strongest when touching */
+				ax += dx * ( (range2 - d2) / (range2 * range) );
+				ay += dy * ( (range2 - d2) / (range2 * range) );
 
-			break;
+				found++;
+			}
 		}
 	}
 
-	phi = atan2( y - this->y, x - this->x ) - theta;
+	*sx = ax;
+	*sy = ay;
+}
+
 
-	switch( mode )
+static void animation_swarm_decide( animation_swarm_worker_t * worker )
+{
+	animation_swarm_state_t * state = worker->state;
+	const float tx = state->target_x;
+	const float ty = state->target_y;
+	const float inner = ANIMATION_SWARM_INNER_RANGE * state->scale;
+	const float outer = ANIMATION_SWARM_OUTER_RANGE * state->scale;
+	float dx = 0.0f;
+	float dy = 0.0f;
+	float s = 0.0f;
+	int i = 0;
+
+	/* Scalar pass: random mode switching and neighbour queries */
+	for( i = worker->first; i < worker->last; i++ )
 	{
-		case mode_attack :
-		{
-			accel = cos(phi) * ANIMATION_SWARM_MAX_ACCEL;
-			turn = sin(phi) * ANIMATION_SWARM_MAX_TURN;
+		dx = tx - state->x[i];
+		dy = ty - state->y[i];
+		s = sqrtf( (dx * dx) + (dy * dy) );
 
-			break;
+		if( state->mode[i] == mode_attack )
+		{
+			if( animation_swarm_random_value( &worker->seed, s ) < animation_swarm_random_value( &worker->seed, inner ) )
+				state->mode[i] = mode_evade;
 		}
-
-		case mode_evade :
+		else
 		{
-			accel = sin(phi) * ANIMATION_SWARM_MAX_ACCEL;
-			turn = cos(phi) * ANIMATION_SWARM_MAX_TURN;
-
-			break;
+			if( animation_swarm_random_value( &worker->seed, s ) > animation_swarm_random_value( &worker->seed, outer ) )
+				state->mode[i] = mode_attack;
 		}
+
+		animation_swarm_separation( state, i, &state->sepx[i], &state->sepy[i] );
 	}
+}
+
 
-	if( accel > 0 )
+static void animation_swarm_steer( const animation_swarm_state_t * state, int first, int last,
+								   const float * restrict x, const float * restrict y,
+								   const float * restrict sepx, const float * restrict sepy,
+								   const uint8_t * restrict mode,
+								   float * restrict vx, float * restrict vy,
+								   float * restrict nx, float * restrict ny )
+{
+	const float tx = state->target_x;
+	const float ty = state->target_y;
+	const float dt = state->dt;
+	const float min_speed = ANIMATION_SWARM_MIN_SPEED * state->scale;
+	const float max_speed = ANIMATION_SWARM_MAX_SPEED * state->scale;
+	const float max_accel = ANIMATION_SWARM_MAX_ACCEL * state->scale;
+	const float xmax = state->width - 1.0f;
+	const float ymax = state->height - 1.0f;
+	int i = 0;
+
+	/* Vectorizable pass: heading and speed update without trigonometry */
+	for( i = first; i < last; i++ )
 	{
-		k = (ANIMATION_SWARM_MAX_SPEED - speed) / (ANIMATION_SWARM_MAX_SPEED - ANIMATION_SWARM_MIN_SPEED);
+		float dx = tx - x[i];
+		float dy = ty - y[i];
+		float dinv = 1.0f / sqrtf( (dx * dx) + (dy * dy) + 1e-6f );
+		float speed = sqrtf( (vx[i] * vx[i]) + (vy[i] * vy[i]) + 1e-6f );
+		float hx = vx[i] / speed;
+		float hy = vy[i] / speed;
+		float cphi = ( (hx * dx) + (hy * dy) ) * dinv;
+		float sphi = ( (hx * dy) - (hy * dx) ) * dinv;
+		float evade = (float) mode[i];
+		float accel = max_accel * ( cphi + evade * (sphi - cphi) );
+		float turn = ANIMATION_SWARM_MAX_TURN * ( sphi + evade * (cphi - sphi) ) * dt;
+		float k = 0.0f;
+		float up = 0.0f;
+		float ct = 0.0f;
+		float st = 0.0f;
+		float rx = 0.0f;
+		float ry = 0.0f;
+		float hinv = 0.0f;
+
+		/* Branchless select keeps the loop vectorizable */
+		up = (float) ( accel > 0.0f );
+		k = ( up * (max_speed - speed) + (1.0f - up) * (speed - min_speed) ) / (max_speed - min_speed);
+
+		speed += k * accel;
+		speed = animation_swarm_clamp( speed, min_speed, max_speed );
+
+		/* Rotate the heading by 'turn' radians (|turn| <= PI * dt) */
+		ct = 1.0f - (turn * turn) * 0.5f;
+		st = turn - (turn * turn * turn) * (1.0f / 6.0f);
+
+		rx = (hx * ct) - (hy * st) + (ANIMATION_SWARM_SEPARATION_WEIGHT * sepx[i]);
+		ry = (hx * st) + (hy * ct) + (ANIMATION_SWARM_SEPARATION_WEIGHT * sepy[i]);
+
+		hinv = 1.0f / sqrtf( (rx * rx) + (ry * ry) + 1e-6f );
+
+		vx[i] = rx * hinv * speed;
+		vy[i] = ry * hinv * speed;
+
+		nx[i] = animation_swarm_clamp( x[i] + vx[i] * dt, 0.0f, xmax );
+		ny[i] = animation_swarm_clamp( y[i] + vy[i] * dt, 0.0f, ymax );
 	}
-	else
+}
+
+
+static void animation_swarm_step_slice( animation_swarm_worker_t * worker )
+{
+	animation_swarm_state_t * state = worker->state;
+
+	animation_swarm_decide( worker );
+
+	animation_swarm_steer(	state, worker->first, worker->last,
+							state->x, state->y, state->sepx, state->sepy, state->mode,
+							state->vx, state->vy, state->next_x, state->next_y );
+}
+
+
+static void animation_swarm_step_task( void * arg, int task )
+{
+	animation_swarm_step_slice( &((animation_swarm_state_t*) arg)->workers[task] );
+}
+
+
+static void animation_swarm_step( animation_swarm_state_t * state )
+{
+	float * aux = NULL;
+
+	state->time += state->dt;
+	state->target_x = ( state->width / 2 ) + ( state->width / 3 ) * sinf( 0.7f * state->time );
+	state->target_y = ( state->height / 2 ) + ( state->height / 3 ) * sinf( 1.1f * state->time );
+
+	animation_swarm_build_grid( state );
+
+	/* Every slice keeps its own seed, so the step does not depend on which thread runs it */
+	workers_run( state->pool, animation_swarm_step_task, state, state->nthreads );
+
+	/* Positions are double buffered so that neighbour queries see a consistent step */
+	aux = state->x;
+	state->x = state->next_x;
+	state->next_x = aux;
+
+	aux = state->y;
+	state->y = state->next_y;
+	state->next_y = aux;
+}
+
+
+static void animation_swarm_next_frame( animation_t * this )
+{
+	int i = 0;
+	int evading = 0;
+	frame_point_t attack;
+	frame_point_t evade;
+	frame_point_t target;
+	frame_t * frm = animation_get_frame( this );
+	console_t * con = animation_get_console( this );
+	animation_swarm_state_t * state = animation_get_state(this);
+
+	if( !state->workers )
+		return;
+
+	animation_swarm_step( state );
+
+	frame_make_point( &attack, mode_attack, 0, ANIMATION_SWARM_ATTACK_COLOR, '.' );
+	frame_make_point( &evade, mode_evade, 0, ANIMATION_SWARM_EVADE_COLOR, '*' );
+	frame_make_point( &target, 0, 0, ANIMATION_SWARM_TARGET_COLOR, '@' );
+
+	frame_clear( frm );
+
+	for( i = 0; i < state->count; i++ )
 	{
-		k = (speed - ANIMATION_SWARM_MIN_SPEED) / (ANIMATION_SWARM_MAX_SPEED - ANIMATION_SWARM_MIN_SPEED);
+		if( state->mode[i] == mode_evade )
+		{
+			frame_set_point( frm, (int) state->x[i], (int) state->y[i], &evade );
+			evading++;
+		}
+		else
+		{
+			frame_set_point( frm, (int) state->x[i], (int) state->y[i], &attack );
+		}
 	}
 
-	speed += k * accel;
-
-	theta = fmod( (theta + turn * dt), (M_PI * 2) );
+	frame_set_point( frm, (int) state->target_x, (int) state->target_y, &target );
 
-	x += (int)(speed * dt * cos(theta));
-	y += (int)(speed * dt * sin(theta));
+	console_add_line( con, "bees=%d / attack=%d / evade=%d / threads=%d", state->count, state->count - evading, evading, state->nthreads );
 }
 
 /* $Id: animation_swarm.c 405 2016-05-13 11:03:53Z tiago.ventura $ */
@@ -1,6 +1,6 @@
 /*!
 	\file animation_swarm.h
-	\brief Matrix Digital Rain Effect Interface
+	\brief Swarm Animation Interface
 	\author Tiago Ventura (tiago.ventura@gmail.com)
 */
 
@@ -23,6 +23,39 @@ extern "C" {
 */
 animation_implementation_t * animation_swarm_get_implementation( void );
 
+
+/*!
+	\brief Set the number of bees (takes effect on the next initialization)
+	\param this Animation Object
+	\param count Bees count
+*/
+void animation_swarm_set_bees_count( animation_t * this, int count );
+
+
+/*!
+	\brief Get the number of bees
+	\param this Animation Object
+	\return Bees count
+*/
+int animation_swarm_get_bees_count( animation_t * this );
+
+
+/*!
+	\brief Set the number of threads used to step the swarm (1 disables threading)
+	\param this Animation Object
+	\param count Threads count
+*/
+void animation_swarm_set_threads_count( animation_t * this, int count );
+
+
+/*!
+	\brief Get the number of threads used to step the swarm
+	\param this Animation Object
+	\return Threads count
+*/
+int animation_swarm_get_threads_count( animation_t * this );
+
+
 #ifdef __cplusplus
 }
 #endif
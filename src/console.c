@@ -1,18 +1,87 @@
 /*!
 	\file console.c
 	\brief Console Object Implementation
+
+	The lines live in a ring of records, larger than the lines shown. An
+	append claims the next ticket with an atomic increment and fills the
+	record of its slot, with no lock, so any thread may add lines. Records
+	keep the format and the captured arguments: the text is only produced
+	when a line is actually read, at most once per line shown. Readers
+	(the players, under console_lock()) validate each record against its
+	sequence number, as a seqlock.
+
 	\author Tiago Ventura (tiago.ventura@gmail.com)
 */
 
 #include <stdlib.h>
+#include <stdint.h>
+#include <stddef.h>
 #include <string.h>
 #include <stdarg.h>
 #include <stdio.h>
+#include <time.h>
+#include <sched.h>
+#include <pthread.h>
 
 #include "console.h"
 
 
 #define CONSOLE_MAX_LINE_LEN  (100)
+#define CONSOLE_MAX_ARGS      (8)
+#define CONSOLE_MAX_SPEC_LEN  (32)
+#define CONSOLE_MIN_RING_LEN  (64)     /* Records in the ring, at least 4 per line shown */
+
+
+/*!
+	\brief Types of the captured arguments
+*/
+enum console_arg_type_e
+{
+	console_arg_invalid,
+	console_arg_percent,
+	console_arg_int,
+	console_arg_long,
+	console_arg_llong,
+	console_arg_size,
+	console_arg_intmax,
+	console_arg_ptrdiff,
+	console_arg_double,
+	console_arg_string,
+	console_arg_pointer
+};
+
+typedef enum console_arg_type_e console_arg_type_t;
+
+
+/*!
+	\brief Argument captured by an append
+*/
+union console_arg_u
+{
+	long long i;
+	intmax_t j;
+	double d;
+	const void * p;
+	size_t s;          /*!< Strings: offset of the copy in the record */
+};
+
+typedef union console_arg_u console_arg_t;
+
+
+/*!
+	\brief Line as appended: format and arguments, not formatted yet
+*/
+struct console_record_s
+{
+	uint64_t seq;                                  /*!< 2*ticket+1 while written, 2*ticket+2 when complete */
+	const char * fmt;                              /*!< NULL: the text is already in strings */
+	int nargs;
+	uint8_t type[ CONSOLE_MAX_ARGS ];
+	console_arg_t arg[ CONSOLE_MAX_ARGS ];
+	char strings[ CONSOLE_MAX_LINE_LEN ];          /*!< Copies of the string arguments */
+};
+
+typedef struct console_record_s console_record_t;
 
 
 /*!
@@ -24,7 +93,13 @@ struct console_s
 	int color;
 	int bgcolor;
 	int nlines;
+	console_record_t * ring;
+	uint64_t mask;
+	uint64_t head;             /*!< Last ticket claimed (tickets start at 1) */
+	uint64_t cleared;          /*!< Lines up to this ticket were cleared */
+	uint64_t * shown;          /*!< Ticket of the text of each line shown */
 	char ** text;
+	pthread_mutex_t mutex;
 };
 
 
@@ -37,6 +112,7 @@ console_t * console_get_instance( void )
 console_t * console_create( int nlines )
 {
 	static console_t * con = NULL;
+	size_t len = CONSOLE_MIN_RING_LEN;
 	int i = 0;
 
 	if(con)
@@ -50,9 +126,17 @@ console_t * console_create( int nlines )
 	if( !con )
 		return NULL;
 
+	pthread_mutex_init( &con->mutex, NULL );
+
+	/* Power of two: slots are tickets masked */
+	while( len < (size_t) nlines * 4 )
+		len <<= 1;
+
+	con->ring = (console_record_t*) calloc( len, sizeof(console_record_t) );
+	con->shown = (uint64_t*) calloc( nlines, sizeof(uint64_t) );
 	con->text = (char**) calloc( nlines, sizeof(char*) );
 
-	if( !con->text )
+	if( !con->ring || !con->shown || !con->text )
 	{
 		console_destroy( con );
 		return NULL;
@@ -69,6 +153,7 @@ console_t * console_create( int nlines )
 		}
 	}
 
+	con->mask = len - 1;
 	con->nlines = nlines;
 
 	return con;
@@ -88,50 +173,393 @@ void console_destroy( console_t * this )
 		free( this->text );
 	}
 
+	free( this->shown );
+	free( this->ring );
+
+	pthread_mutex_destroy( &this->mutex );
+
 	free( this );
 }
 
 
+/* Parses the conversion at fmt (just after the '%'), returns its length including the conversion character */
+static int console_parse_spec( const char * fmt, console_arg_type_t * type )
+{
+	const char * p = fmt;
+	int length = 0;     /* 'H' hh, 'h', 'l', 'L' ll, 'z', 'j', 't', 'D' long double */
+
+	*type = console_arg_invalid;
+
+	if( *p == '%' )
+	{
+		*type = console_arg_percent;
+		return 1;
+	}
+
+	while( *p && strchr( "-+ #0", *p ) )
+		p++;
+
+	/* Widths and precisions taken from the arguments are not supported */
+	while( (*p >= '0') && (*p <= '9') )
+		p++;
+
+	if( *p == '.' )
+		for( p++; (*p >= '0') && (*p <= '9'); p++ );
+
+	switch( *p )
+	{
+		case 'h': length = (p[1] == 'h') ? 'H' : 'h'; p += (length == 'H') ? 2 : 1; break;
+		case 'l': length = (p[1] == 'l') ? 'L' : 'l'; p += (length == 'L') ? 2 : 1; break;
+		case 'z': length = 'z'; p++; break;
+		case 'j': length = 'j'; p++; break;
+		case 't': length = 't'; p++; break;
+		case 'L': length = 'D'; p++; break;
+		default: break;
+	}
+
+	switch( *p )
+	{
+		case 'd': case 'i': case 'u': case 'o': case 'x': case 'X':
+			switch( length )
+			{
+				case 'l': *type = console_arg_long; break;
+				case 'L': *type = console_arg_llong; break;
+				case 'z': *type = console_arg_size; break;
+				case 'j': *type = console_arg_intmax; break;
+				case 't': *type = console_arg_ptrdiff; break;
+				case 'D': break;
+				default: *type = console_arg_int; break;
+			}
+			break;
+
+		case 'c':
+			if( !length )
+				*type = console_arg_int;
+			break;
+
+		case 'f': case 'F': case 'e': case 'E': case 'g': case 'G': case 'a': case 'A':
+			if( !length || (length == 'l') )
+				*type = console_arg_double;
+			break;
+
+		case 's':
+			if( !length )
+				*type = console_arg_string;
+			break;
+
+		case 'p':
+			if( !length )
+				*type = console_arg_pointer;
+			break;
+
+		default:
+			break;
+	}
+
+	if( !*p )
+		return p - fmt;
+
+	return p - fmt + 1;
+}
+
+
+/* Keeps the arguments of the format, 0 when they can not be captured and the line has to be formatted now */
+static int console_capture( console_record_t * rec, const char * fmt, va_list args )
+{
+	console_arg_type_t type = console_arg_invalid;
+	size_t used = 0;
+	size_t len = 0;
+	const char * str = NULL;
+	const char * p = fmt;
+
+	rec->nargs = 0;
+
+	while( (p = strchr( p, '%' )) )
+	{
+		p++;
+		p += console_parse_spec( p, &type );
+
+		if( type == console_arg_percent )
+			continue;
+
+		if( (type == console_arg_invalid) || (rec->nargs == CONSOLE_MAX_ARGS) )
+			return 0;
+
+		switch( type )
+		{
+			case console_arg_int: rec->arg[ rec->nargs ].i = va_arg( args, int ); break;
+			case console_arg_long: rec->arg[ rec->nargs ].i = va_arg( args, long ); break;
+			case console_arg_llong: rec->arg[ rec->nargs ].i = va_arg( args, long long ); break;
+			case console_arg_size: rec->arg[ rec->nargs ].s = va_arg( args, size_t ); break;
+			case console_arg_intmax: rec->arg[ rec->nargs ].j = va_arg( args, intmax_t ); break;
+			case console_arg_ptrdiff: rec->arg[ rec->nargs ].i = va_arg( args, ptrdiff_t ); break;
+			case console_arg_double: rec->arg[ rec->nargs ].d = va_arg( args, double ); break;
+			case console_arg_pointer: rec->arg[ rec->nargs ].p = va_arg( args, void * ); break;
+
+			case console_arg_string:
+			{
+				/* The string may be gone by the time the line is shown: copy it */
+				str = va_arg( args, const char * );
+
+				if( !str )
+					str = "(null)";
+
+				len = strnlen( str, sizeof(rec->strings) - 1 - used );
+				memcpy( rec->strings + used, str, len );
+				rec->strings[ used + len ] = '\0';
+
+				rec->arg[ rec->nargs ].s = used;
+				used += len + ((used + len + 1 < sizeof(rec->strings)) ? 1 : 0);
+				break;
+			}
+
+			default:
+				return 0;
+		}
+
+		rec->type[ rec->nargs++ ] = (uint8_t) type;
+	}
+
+	rec->fmt = fmt;
+
+	return 1;
+}
+
+
+/* Produces the text of a record, one snprintf() per conversion */
+static void console_format( const console_record_t * rec, char * text, size_t size )
+{
+	console_arg_type_t type = console_arg_invalid;
+	char spec[ CONSOLE_MAX_SPEC_LEN + 2 ];
+	const console_arg_t * arg = NULL;
+	const char * p = rec->fmt;
+	size_t len = 0;
+	int n = 0;
+	int a = 0;
+
+	if( !p )
+	{
+		strncpy( text, rec->strings, size - 1 );
+		text[ size - 1 ] = '\0';
+		return;
+	}
+
+	while( *p && (len < size - 1) )
+	{
+		if( *p != '%' )
+		{
+			text[ len++ ] = *p++;
+			continue;
+		}
+
+		n = console_parse_spec( p + 1, &type ) + 1;
+
+		if( type == console_arg_percent )
+		{
+			text[ len++ ] = '%';
+			p += n;
+			continue;
+		}
+
+		if( (n > CONSOLE_MAX_SPEC_LEN) || (a >= rec->nargs) )
+			break;
+
+		memcpy( spec, p, n );
+		spec[n] = '\0';
+		arg = &rec->arg[ a ];
+
+		switch( rec->type[ a++ ] )
+		{
+			case console_arg_int: n = snprintf( text + len, size - len, spec, (int) arg->i ); break;
+			case console_arg_long: n = snprintf( text + len, size - len, spec, (long) arg->i ); break;
+			case console_arg_llong: n = snprintf( text + len, size - len, spec, arg->i ); break;
+			case console_arg_size: n = snprintf( text + len, size - len, spec, arg->s ); break;
+			case console_arg_intmax: n = snprintf( text + len, size - len, spec, arg->j ); break;
+			case console_arg_ptrdiff: n = snprintf( text + len, size - len, spec, (ptrdiff_t) arg->i ); break;
+			case console_arg_double: n = snprintf( text + len, size - len, spec, arg->d ); break;
+			case console_arg_string: n = snprintf( text + len, size - len, spec, rec->strings + arg->s ); break;
+			case console_arg_pointer: n = snprintf( text + len, size - len, spec, arg->p ); break;
+			default: n = 0; break;
+		}
+
+		if( n < 0 )
+			break;
+
+		len = ((size_t) n < size - len) ? len + n : size - 1;
+		p += strlen( spec );
+	}
+
+	text[ len ] = '\0';
+}
+
+
+static void console_append( console_t * this, const char * fmt, va_list args )
+{
+	uint64_t ticket = __atomic_add_fetch( &this->head, 1, __ATOMIC_RELAXED );
+	console_record_t * rec = &this->ring[ ticket & this->mask ];
+	uint64_t writing = 2 * ticket + 1;
+	uint64_t seq = __atomic_load_n( &rec->seq, __ATOMIC_RELAXED );
+	va_list copy;
+
+	/* Claim the slot, unless a later append already did: then this line is out of the ring anyway */
+	for(;;)
+	{
+		if( seq >= writing )
+			return;
+
+		/* An append one lap behind is still writing it */
+		if( seq & 1 )
+		{
+			sched_yield();
+			seq = __atomic_load_n( &rec->seq, __ATOMIC_RELAXED );
+			continue;
+		}
+
+		if( __atomic_compare_exchange_n( &rec->seq, &seq, writing, 0, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED ) )
+			break;
+	}
+
+	va_copy( copy, args );
+
+	if( !console_capture( rec, fmt, copy ) )
+	{
+		rec->fmt = NULL;
+		vsnprintf( rec->strings, sizeof(rec->strings), fmt, args );
+	}
+
+	va_end( copy );
+
+	__atomic_store_n( &rec->seq, writing + 1, __ATOMIC_RELEASE );
+}
+
+
 const char * console_get_line( console_t * this, int idx )
 {
+	console_record_t rec;
+	console_record_t * slot = NULL;
+	uint64_t head = 0;
+	uint64_t ticket = 0;
+	uint64_t done = 0;
+
 	if( (idx < 0) || (idx >= this->nlines) )
 		return NULL;
 
+	head = __atomic_load_n( &this->head, __ATOMIC_ACQUIRE );
+
+	/* The last line is the latest one */
+	if( head < (uint64_t) (this->nlines - 1 - idx) + 1 )
+		ticket = 0;
+	else
+		ticket = head - (this->nlines - 1 - idx);
+
+	if( !ticket || (ticket <= this->cleared) )
+	{
+		this->text[ idx ][0] = '\0';
+		this->shown[ idx ] = ticket;
+		return this->text[ idx ];
+	}
+
+	if( this->shown[ idx ] == ticket )
+		return this->text[ idx ];
+
+	slot = &this->ring[ ticket & this->mask ];
+	done = 2 * ticket + 2;
+
+	/* Copy, then check that no append rewrote it meanwhile; if one is still writing, show the previous text */
+	if( __atomic_load_n( &slot->seq, __ATOMIC_ACQUIRE ) != done )
+		return this->text[ idx ];
+
+	memcpy( &rec, slot, sizeof(rec) );
+
+	__atomic_thread_fence( __ATOMIC_ACQUIRE );
+
+	if( __atomic_load_n( &slot->seq, __ATOMIC_RELAXED ) != done )
+		return this->text[ idx ];
+
+	console_format( &rec, this->text[ idx ], CONSOLE_MAX_LINE_LEN );
+	this->shown[ idx ] = ticket;
+
 	return this->text[ idx ];
 }
 
 
 void console_add_line( console_t * this, const char * fmt, ... )
 {
-	int i = 0;
 	va_list args;
-	char msg[ CONSOLE_MAX_LINE_LEN + 1 ] = {0};
-	char * paux = NULL;
 
 	if(!this)
 		return;
 
 	va_start( args, fmt );
-	vsnprintf( msg, CONSOLE_MAX_LINE_LEN, fmt, args );
+	console_append( this, fmt, args );
 	va_end(args);
+}
 
-	paux = this->text[0];
 
-	for( i = 0; i < this->nlines - 1; i++ )
-		this->text[i] = this->text[ i + 1 ];
+int console_rate_check( console_rate_t * rate )
+{
+	struct timespec now;
+	uint64_t ns = 0;
+	uint64_t next = 0;
+	unsigned int calls = 0;
+
+	if( !rate )
+		return 1;
+
+	calls = __atomic_fetch_add( &rate->calls, 1, __ATOMIC_RELAXED );
+
+	if( (rate->every > 1) && (calls % rate->every) )
+		return 0;
+
+	if( rate->interval <= 0.0 )
+		return 1;
 
-	this->text[ this->nlines - 1 ] = paux;
+	clock_gettime( CLOCK_MONOTONIC, &now );
+	ns = (uint64_t) now.tv_sec * 1000000000ULL + now.tv_nsec;
+	next = __atomic_load_n( &rate->next, __ATOMIC_RELAXED );
 
-	strncpy( paux, msg, CONSOLE_MAX_LINE_LEN );
+	/* One caller per interval wins the exchange */
+	if( ns < next )
+		return 0;
+
+	return __atomic_compare_exchange_n( &rate->next, &next, ns + (uint64_t) (rate->interval * 1e9), 0, __ATOMIC_RELAXED, __ATOMIC_RELAXED );
+}
+
+
+void console_add_line_rated( console_t * this, console_rate_t * rate, const char * fmt, ... )
+{
+	va_list args;
+
+	if( !this || !console_rate_check( rate ) )
+		return;
+
+	va_start( args, fmt );
+	console_append( this, fmt, args );
+	va_end(args);
 }
 
 
 void console_clear( console_t * this )
 {
-	int i = 0;
+	pthread_mutex_lock( &this->mutex );
+
+	this->cleared = __atomic_load_n( &this->head, __ATOMIC_ACQUIRE );
 
-	for( i = 0; i < this->nlines; i++ )
-		memset( this->text[i], 0, CONSOLE_MAX_LINE_LEN );
+	pthread_mutex_unlock( &this->mutex );
+}
+
+
+void console_lock( console_t * this )
+{
+	if( this )
+		pthread_mutex_lock( &this->mutex );
+}
+
+
+void console_unlock( console_t * this )
+{
+	if( this )
+		pthread_mutex_unlock( &this->mutex );
 }
 
 
@@ -7,16 +7,65 @@
 #ifndef __CONSOLE_H__
 #define __CONSOLE_H__
 
+#include <stdint.h>
+
 
 typedef struct console_s console_t;
 
 
+/*!
+	\brief Console Rate Limit Type Definition
+
+	Keeps a message that is added very often from flooding the console:
+	only one call out of `every` goes on, and no more than one each
+	`interval` seconds. Zero disables either check. Owned by the caller,
+	it may be shared by threads.
+*/
+typedef struct console_rate_s console_rate_t;
+
+struct console_rate_s
+{
+	unsigned int every;
+	double interval;
+	unsigned int calls;
+	uint64_t next;
+};
+
+#define CONSOLE_RATE_INITIALIZER( every, interval )   { (every), (interval), 0, 0 }
+
+
 console_t * console_get_instance( void );
 console_t * console_create( int nlines );
 void console_destroy( console_t * this );
 const char * console_get_line( console_t * this, int idx );
-void console_add_line( console_t * this, const char * fmt, ... );
+
+/*!
+	\brief Add a line to the console, from any thread and without locking
+	\param this Console Object
+	\param fmt printf() format, must outlive the line (a string literal): the line is formatted when shown
+
+	The arguments are kept as they are now, strings are copied.
+*/
+void console_add_line( console_t * this, const char * fmt, ... ) __attribute__ (( format( printf, 2, 3 ) ));
+
+/*!
+	\brief Add a line to the console unless its rate limit says otherwise
+	\param this Console Object
+	\param rate Rate Limit of the message
+	\param fmt printf() format, as in console_add_line()
+*/
+void console_add_line_rated( console_t * this, console_rate_t * rate, const char * fmt, ... ) __attribute__ (( format( printf, 3, 4 ) ));
+
+/*!
+	\brief Count a call against a rate limit
+	\param rate Rate Limit
+	\return 1 when the message should go out, 0 when it is dropped
+*/
+int console_rate_check( console_rate_t * rate );
+
 void console_clear( console_t * this );
+void console_lock( console_t * this );
+void console_unlock( console_t * this );
 const char * console_get_first_line( console_t * this );
 const char * console_get_next_line( console_t * this );
 int console_get_lines_count( console_t * this );
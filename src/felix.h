@@ -9,16 +9,22 @@
 #define __FELIX_H__
 
 #include "console.h"
+#include "workers.h"
 
 #include "filter.h"
 #include "filter_blur.h"
 #include "filter_noise.h"
+#include "filter_chain.h"
+#include "filter_convolve.h"
 
 #include "player.h"
 #include "player_graphmode_sdl.h"
+#include "player_graphmode_sdl2.h"
 #include "player_graphmode_allegro.h"
 #include "player_graphmode_modex_allegro.h"
 #include "player_textmode_allegro.h"
+#include "player_headless.h"
+#include "player_terminal.h"
 
 #include "animation.h"
 #include "animation_tvstatic.h"
@@ -30,6 +36,7 @@
 #include "animation_spirograph.h"
 #include "animation_lissajous.h"
 #include "animation_swarm.h"
+#include "animation_plasma.h"
 
 #endif /* __FELIX_H__ */
 
@@ -6,21 +6,54 @@
 
 
 #include <stdlib.h>
+#include <stdint.h>
 
+#include "pool.h"
 #include "frame.h"
+#include "workers.h"
 #include "filter.h"
 
 
+#define FILTER_TILE_SIZE    (128)
+
+
 /*!
 	\brief Represents a Filter Object
 */
 struct filter_s
 {
 	filter_implementation_t * impl;
+	filter_frame_fn frame_fn;
+	workers_t * workers;
+	palette_t * palette;
+	uint32_t seed;
+	unsigned int sequence;
 	void * data;
+	void * scratch[ WORKERS_MAX_THREADS ];        /*!< One block per worker thread */
+	size_t scratch_size[ WORKERS_MAX_THREADS ];
 };
 
 
+/*!
+	\brief A whole frame split in tiles, shared by the threads filtering it
+*/
+struct filter_tiles_s
+{
+	filter_t * filter;
+	frame_t * dst;
+	const frame_t * src;
+	uint32_t seed;
+	int ncols;
+	int nrows;
+	int tcols;
+};
+
+typedef struct filter_tiles_s filter_tiles_t;
+
+
+static void filter_point_adapter( filter_t * this, frame_t * dst, const frame_t * src, const frame_rect_t * rect, uint32_t seed );
+
+
 filter_t * filter_create( filter_implementation_t * impl )
 {
 	filter_t * flt = NULL;
@@ -34,6 +67,11 @@ filter_t * filter_create( filter_implementation_t * impl )
 		return NULL;
 
 	flt->impl = impl;
+	flt->frame_fn = (impl->filter_frame) ? impl->filter_frame : filter_point_adapter;
+	flt->workers = NULL;
+	flt->palette = NULL;
+	flt->seed = (uint32_t) rand();
+	flt->sequence = 0;
 	flt->data = NULL;
 
 	flt->impl->create( flt );
@@ -44,11 +82,43 @@ filter_t * filter_create( filter_implementation_t * impl )
 
 void filter_destroy( filter_t * this )
 {
+	int i = 0;
+
 	this->impl->destroy( this );
+
+	for( i = 0; i < WORKERS_MAX_THREADS; i++ )
+		pool_free( this->scratch[i] );
+
 	free( this );
 }
 
 
+int filter_get_halo( filter_t * this )
+{
+	if( !this->impl->get_halo )
+		return -1;
+
+	return this->impl->get_halo( this );
+}
+
+
+void * filter_get_scratch( filter_t * this, size_t size )
+{
+	int thread = workers_get_thread_index();
+
+	/* Only the calling thread uses its block: no lock, and after the first frames no allocation */
+	if( this->scratch_size[ thread ] < size )
+	{
+		pool_free( this->scratch[ thread ] );
+
+		this->scratch[ thread ] = pool_alloc( size );
+		this->scratch_size[ thread ] = (this->scratch[ thread ]) ? size : 0;
+	}
+
+	return this->scratch[ thread ];
+}
+
+
 void * filter_get_data( filter_t * this )
 {
 	return this->data;
@@ -61,44 +131,152 @@ void filter_set_data( filter_t * this, void * data )
 }
 
 
-void filter_get_filterd_point( filter_t * this, frame_point_t * pt, frame_t * frm, int col, int row )
+void filter_get_filterd_point( filter_t * this, frame_point_t * pt, const frame_t * frm, int col, int row )
 {
 	this->impl->get_filtered_point( this, pt, frm, col, row );
 }
 
 
-void filter_frame( filter_t * this, frame_t * frm )
+/*!
+	\brief Whole frame entry point for the filters that only know how to filter a point
+*/
+static void filter_point_adapter( filter_t * this, frame_t * dst, const frame_t * src, const frame_rect_t * rect, uint32_t seed )
 {
-	frame_t * frmaux = NULL;
 	frame_point_t pt;
+	frame_point_t * out = NULL;
 	int row = 0;
 	int col = 0;
-	int nrows = 0;
+
+	for( row = rect->row; row < rect->row + rect->nrows; row++ )
+	{
+		out = frame_get_row( dst, row );
+
+		for( col = rect->col; col < rect->col + rect->ncols; col++ )
+		{
+			this->impl->get_filtered_point( this, &pt, src, col, row );
+
+			out[col] = pt;
+		}
+	}
+}
+
+
+void filter_frame_rect( filter_t * this, frame_t * dst, const frame_t * src, const frame_rect_t * rect, uint32_t seed )
+{
+	frame_rect_t clip = *rect;
 	int ncols = 0;
+	int nrows = 0;
+
+	frame_get_dimensions( src, &ncols, &nrows );
 
+	if( clip.col < 0 )
+	{
+		clip.ncols += clip.col;
+		clip.col = 0;
+	}
+
+	if( clip.row < 0 )
+	{
+		clip.nrows += clip.row;
+		clip.row = 0;
+	}
+
+	if( clip.col + clip.ncols > ncols )
+		clip.ncols = ncols - clip.col;
 
-	frmaux = frame_duplicate( frm );
+	if( clip.row + clip.nrows > nrows )
+		clip.nrows = nrows - clip.row;
 
-	if(!frmaux)
+	if( (clip.ncols <= 0) || (clip.nrows <= 0) )
 		return;
 
-	frame_get_dimensions( frmaux, &ncols, &nrows );
+	this->frame_fn( this, dst, src, &clip, seed );
+}
+
+
+void filter_set_workers( filter_t * this, workers_t * workers )
+{
+	this->workers = workers;
+}
+
+
+workers_t * filter_get_workers( filter_t * this )
+{
+	return this->workers;
+}
+
+
+void filter_set_palette( filter_t * this, palette_t * pal )
+{
+	this->palette = pal;
+
+	if( this->impl->set_palette )
+		this->impl->set_palette( this, pal );
+}
+
+
+palette_t * filter_get_palette( filter_t * this )
+{
+	return this->palette;
+}
+
+
+uint32_t filter_mix_seed( uint32_t seed, uint32_t value )
+{
+	/* murmur3 finalizer */
+	seed ^= value + 0x9e3779b9u + (seed << 6) + (seed >> 2);
+	seed ^= seed >> 16;
+	seed *= 0x85ebca6bu;
+	seed ^= seed >> 13;
+	seed *= 0xc2b2ae35u;
+	seed ^= seed >> 16;
+
+	return seed;
+}
+
+
+static void filter_tile( void * arg, int task )
+{
+	filter_tiles_t * tiles = (filter_tiles_t*) arg;
+	frame_rect_t rect;
+
+	rect.col = (task % tiles->tcols) * FILTER_TILE_SIZE;
+	rect.row = (task / tiles->tcols) * FILTER_TILE_SIZE;
+	rect.ncols = FILTER_TILE_SIZE;
+	rect.nrows = FILTER_TILE_SIZE;
+
+	filter_frame_rect( tiles->filter, tiles->dst, tiles->src, &rect, filter_mix_seed( tiles->seed, task ) );
+}
+
+
+void filter_frame( filter_t * this, frame_t * dst, const frame_t * src )
+{
+	filter_tiles_t tiles;
+	frame_rect_t rect;
+
+	tiles.filter = this;
+	tiles.dst = dst;
+	tiles.src = src;
+	tiles.seed = filter_mix_seed( this->seed, this->sequence++ );
+
+	frame_get_dimensions( src, &tiles.ncols, &tiles.nrows );
 
-	for( col = 0; col < ncols; col++ )
+	/* Only the filters that know what they read can be split, always in the same tiles whatever the threads count */
+	if( filter_get_halo( this ) < 0 )
 	{
-		for( row = 0; row < nrows; row++ )
-		{
-			this->impl->get_filtered_point( this, &pt, frm, col, row );
+		rect.col = 0;
+		rect.row = 0;
+		rect.ncols = tiles.ncols;
+		rect.nrows = tiles.nrows;
 
-			frame_set_point( frmaux, col, row, &pt );
-		}
-	}
+		this->frame_fn( this, dst, src, &rect, tiles.seed );
 
-	frame_copy( frm, frmaux );
+		return;
+	}
 
-	frame_destroy( frmaux );
+	tiles.tcols = (tiles.ncols + FILTER_TILE_SIZE - 1) / FILTER_TILE_SIZE;
 
-	return;
+	workers_run( this->workers, filter_tile, &tiles, tiles.tcols * ((tiles.nrows + FILTER_TILE_SIZE - 1) / FILTER_TILE_SIZE) );
 }
 
 /* $Id: filter.c 304 2015-08-08 00:57:58Z tiago.ventura $ */
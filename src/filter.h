@@ -7,7 +7,12 @@
 #ifndef __FILTER_H__
 #define __FILTER_H__
 
+#include <stddef.h>
+#include <stdint.h>
+
 #include "frame.h"
+#include "palette.h"
+#include "workers.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -17,6 +22,17 @@ typedef struct filter_implementation_s filter_implementation_t;
 
 typedef struct filter_s filter_t;
 
+/*!
+	\brief Filters the points of a rectangle of the source frame into the same rectangle of the destination frame
+
+	The rectangle is always inside the frames, the points around it can be
+	read from the source. Calls for disjoint rectangles of the same frames
+	may run concurrently when the filter knows its halo. Filters drawing
+	random numbers take them from the seed only, so that the same rectangle
+	and seed always give the same points.
+*/
+typedef void (*filter_frame_fn) ( filter_t * this, frame_t * dst, const frame_t * src, const frame_rect_t * rect, uint32_t seed );
+
 /*!
 	\brief Represents an Implementation of a Filter Object
 */
@@ -24,7 +40,10 @@ struct filter_implementation_s
 {
 	filter_t * (*create) (filter_t *);
 	void (*destroy) (filter_t *);
-	void (*get_filtered_point) ( filter_t*, frame_point_t*, frame_t*, int, int );
+	void (*get_filtered_point) ( filter_t*, frame_point_t*, const frame_t*, int, int );
+	filter_frame_fn filter_frame;   /*!< Optional: NULL filters point by point through get_filtered_point */
+	int (*get_halo) ( filter_t* );  /*!< Optional: how far around a point the filter reads, NULL if unbounded */
+	void (*set_palette) ( filter_t*, palette_t* );  /*!< Optional: told the palette of the frames, e.g. to pass it on */
 };
 
 
@@ -32,7 +51,69 @@ filter_t * filter_create( filter_implementation_t * impl );
 
 void filter_destroy( filter_t * this );
 
-void filter_frame( filter_t * this, frame_t * frm );
+/*!
+	\brief Filter a whole frame
+
+	Filters that know their halo are run in tiles, on the workers when the
+	filter has them. Each tile gets its own seed, so the output does not
+	depend on the number of threads.
+
+	\param this Filter Object
+	\param dst Filtered frame, same dimensions as the source and never the source itself
+	\param src Source frame
+*/
+void filter_frame( filter_t * this, frame_t * dst, const frame_t * src );
+
+/*!
+	\brief Filter a rectangle of a frame, the rest of the destination is left untouched
+	\param this Filter Object
+	\param dst Filtered frame, same dimensions as the source and never the source itself
+	\param src Source frame
+	\param rect Rectangle, clipped to the frame
+	\param seed Random seed for the filters that need one
+*/
+void filter_frame_rect( filter_t * this, frame_t * dst, const frame_t * src, const frame_rect_t * rect, uint32_t seed );
+
+/*!
+	\brief How far around a point the filter reads its source (0 for point-wise filters)
+	\param this Filter Object
+	\return Distance in points, -1 if unknown (the filter may read anywhere)
+*/
+int filter_get_halo( filter_t * this );
+
+/*!
+	\brief Set the threads filter_frame() runs the tiles on
+	\param this Filter Object
+	\param workers Workers Object, shared and not owned by the filter, NULL for the calling thread only
+*/
+void filter_set_workers( filter_t * this, workers_t * workers );
+
+workers_t * filter_get_workers( filter_t * this );
+
+/*!
+	\brief Set the palette the colors of the next frames index into
+	\param this Filter Object
+	\param pal Palette Object, not owned by the filter, NULL if the colors are plain values
+*/
+void filter_set_palette( filter_t * this, palette_t * pal );
+
+palette_t * filter_get_palette( filter_t * this );
+
+/*!
+	\brief Derive a seed from another one, e.g. one per tile or per stage
+	\param seed Seed
+	\param value Value to mix in
+	\return Derived seed
+*/
+uint32_t filter_mix_seed( uint32_t seed, uint32_t value );
+
+/*!
+	\brief Scratch memory of the calling worker thread, kept by the filter and reused by the next calls
+	\param this Filter Object
+	\param size Bytes needed, the block only grows
+	\return Scratch memory, NULL on failure
+*/
+void * filter_get_scratch( filter_t * this, size_t size );
 
 void * filter_get_data( filter_t * this );
 
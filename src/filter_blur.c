@@ -6,15 +6,33 @@
 
 
 #include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
 
 #include "frame.h"
+#include "palette.h"
 #include "filter.h"
 #include "filter_blur.h"
 
 
+#define FILTER_BLUR_DEFAULT_RADIUS    (1)
+#define FILTER_BLUR_MAX_RADIUS        (64)
+
+
+struct filter_blur_params_s
+{
+	int radius;
+	int palette_domain;
+};
+
+typedef struct filter_blur_params_s filter_blur_params_t;
+
+
 static filter_t * filter_blur_create( filter_t * parent );
 static void filter_blur_destroy( filter_t * this );
-static void filter_blur_get_filtered_point( filter_t * this, frame_point_t * pt, frame_t * frm, int col, int row );
+static void filter_blur_get_filtered_point( filter_t * this, frame_point_t * pt, const frame_t * frm, int col, int row );
+static void filter_blur_filter_frame( filter_t * this, frame_t * dst, const frame_t * src, const frame_rect_t * rect, uint32_t seed );
+static int filter_blur_get_halo( filter_t * this );
 
 
 filter_implementation_t * filter_blur_get_implementation( void )
@@ -24,46 +42,304 @@ filter_implementation_t * filter_blur_get_implementation( void )
 	impl.create = filter_blur_create;
 	impl.destroy = filter_blur_destroy;
 	impl.get_filtered_point = filter_blur_get_filtered_point;
+	impl.filter_frame = filter_blur_filter_frame;
+	impl.get_halo = filter_blur_get_halo;
 
 	return &impl;
 }
 
 
-
 static filter_t * filter_blur_create( filter_t * parent )
 {
+	filter_blur_params_t * params = NULL;
+
+	params = (filter_blur_params_t *) calloc( 1, sizeof(filter_blur_params_t) );
+
+	if(!params)
+		return NULL;
+
+	params->radius = FILTER_BLUR_DEFAULT_RADIUS;
+
+	filter_set_data( parent, params );
+
 	return parent;
 }
 
 
 static void filter_blur_destroy( filter_t * this )
 {
+	free( filter_get_data( this ) );
 }
 
 
-static void filter_blur_get_filtered_point( filter_t * this, frame_point_t * pt, frame_t * frm, int col, int row )
+void filter_blur_set_radius( filter_t * this, int radius )
 {
+	if( radius < 1 )
+		radius = 1;
+
+	if( radius > FILTER_BLUR_MAX_RADIUS )
+		radius = FILTER_BLUR_MAX_RADIUS;
+
+	((filter_blur_params_t*)(filter_get_data(this)))->radius = radius;
+}
+
+
+int filter_blur_get_radius( filter_t * this )
+{
+	return ((filter_blur_params_t*)(filter_get_data(this)))->radius;
+}
+
+
+void filter_blur_set_palette_domain( filter_t * this, int enabled )
+{
+	((filter_blur_params_t*)(filter_get_data(this)))->palette_domain = enabled;
+}
+
+
+int filter_blur_get_palette_domain( filter_t * this )
+{
+	return ((filter_blur_params_t*)(filter_get_data(this)))->palette_domain;
+}
+
+
+static int filter_blur_get_halo( filter_t * this )
+{
+	return filter_blur_get_radius( this );
+}
+
+
+/*!
+	\brief Reference implementation, one point at a time (frame_get_point() handles the border)
+*/
+static void filter_blur_get_filtered_point( filter_t * this, frame_point_t * pt, const frame_t * frm, int col, int row )
+{
+	int r = filter_blur_get_radius( this );
 	int sum = 0;
+	int i = 0;
+	int j = 0;
 	frame_point_t point;
 
-	frame_get_point( frm, col + 1, row + 1, &point );
-	sum += point.color;
+	for( j = -r; j <= r; j++ )
+	{
+		for( i = -r; i <= r; i++ )
+		{
+			frame_get_point( frm, col + i, row + j, &point );
+			sum += (uint8_t) point.color;
+		}
+	}
+
+	frame_get_point( frm, col, row, pt );
+
+	pt->color = sum / ((2 * r + 1) * (2 * r + 1));
+}
+
+
+/*!
+	\brief Horizontal pass over one padded row: sliding window sum of 2 * radius + 1 colors, O(1) per point
+*/
+static void filter_blur_horizontal( const uint8_t * restrict src, uint16_t * restrict dst, int ncols, int radius )
+{
+	unsigned int sum = 0;
+	int col = 0;
+
+	for( col = 0; col < 2 * radius; col++ )
+		sum += src[col];
+
+	for( col = 0; col < ncols; col++ )
+	{
+		sum += src[ col + 2 * radius ];
+		dst[col] = (uint16_t) sum;
+		sum -= src[col];
+	}
+}
+
+
+/*!
+	\brief Vertical pass: slide the column sums one row down (vectorized across the columns)
+*/
+static void filter_blur_slide( uint32_t * restrict vsum, const uint16_t * restrict enter, const uint16_t * restrict leave, int ncols )
+{
+	int col = 0;
+
+	for( col = 0; col < ncols; col++ )
+		vsum[col] = vsum[col] + enter[col] - leave[col];
+}
+
+
+/*!
+	\brief Box mean of a row, the bias turns the float product into an exact integer division
+*/
+static void filter_blur_divide( uint8_t * restrict dst, const uint32_t * restrict vsum, int ncols, float inv )
+{
+	int col = 0;
+
+	for( col = 0; col < ncols; col++ )
+		dst[col] = (uint8_t) (int) ( ((float) vsum[col] + 0.5f) * inv );
+}
+
+
+/*!
+	\brief Horizontal pass over one padded row, through a color lookup table
+*/
+static void filter_blur_horizontal_lut( const uint8_t * restrict src, uint16_t * restrict dst, int ncols, int radius, const uint8_t * restrict lut )
+{
+	unsigned int sum = 0;
+	int col = 0;
+
+	for( col = 0; col < 2 * radius; col++ )
+		sum += lut[ src[col] ];
+
+	for( col = 0; col < ncols; col++ )
+	{
+		sum += lut[ src[ col + 2 * radius ] ];
+		dst[col] = (uint16_t) sum;
+		sum -= lut[ src[col] ];
+	}
+}
+
+
+/*!
+	\brief Separable box blur of a rectangle
+
+	The colors of the rectangle and of a radius wide halo around it are
+	gathered into an 8-bit plane, the border mode of the source frame
+	giving the colors of the halo outside of it. They are summed along
+	the rows with a sliding window, then down the columns with running
+	sums. Each worker thread has its own scratch block in the filter, so
+	calls on disjoint rectangles can run concurrently and allocate
+	nothing once it fits.
+
+	In the palette domain the red, green and blue components of the colors
+	are blurred instead of the indexes. A mean equal to the color of the
+	center point keeps its index, a mean equal to another color of the
+	palette gets that one, and every other mean goes back to an index
+	through the inverse color map of the palette.
+*/
+static void filter_blur_filter_frame( filter_t * this, frame_t * dst, const frame_t * src, const frame_rect_t * rect, uint32_t seed )
+{
+	int radius = filter_blur_get_radius( this );
+	int width = rect->ncols;
+	int height = rect->nrows;
+	int pwidth = width + 2 * radius;
+	int pheight = height + 2 * radius;
+	palette_tables_t * tables = NULL;
+	uint8_t center = 0;
+	uint8_t lut[3][256];
+	uint8_t * scratch = NULL;
+	uint8_t * plane = NULL;
+	uint16_t * hsum[3] = { NULL, NULL, NULL };
+	uint16_t * zero = NULL;
+	uint32_t * vsum[3] = { NULL, NULL, NULL };
+	uint8_t * mean[3] = { NULL, NULL, NULL };
+	frame_point_t * out = NULL;
+	float inv = 0.0f;
+	int nchannels = 1;
+	int row = 0;
+	int col = 0;
+	int c = 0;
+
+	if( filter_blur_get_palette_domain( this ) && filter_get_palette( this ) )
+		tables = palette_acquire_tables( filter_get_palette( this ) );
+
+	if( tables )
+	{
+		nchannels = 3;
+
+		for( col = 0; col < 256; col++ )
+			palette_tables_get_color( tables, col, &lut[0][col], &lut[1][col], &lut[2][col] );
+	}
+
+	/* vsum, hsum and zero first, they need the alignment */
+	scratch = (uint8_t*) filter_get_scratch( this, nchannels * (size_t) width * sizeof(uint32_t) +
+									 nchannels * (size_t) width * pheight * sizeof(uint16_t) +
+									 (size_t) width * sizeof(uint16_t) +
+									 (size_t) pwidth * pheight +
+									 nchannels * (size_t) width );
+
+	if( !scratch )
+	{
+		if( tables )
+			palette_release_tables( tables );
+
+		return;
+	}
+
+	for( c = 0; c < nchannels; c++ )
+		vsum[c] = (uint32_t*) scratch + (size_t) c * width;
+
+	for( c = 0; c < nchannels; c++ )
+		hsum[c] = (uint16_t*) ((uint32_t*) scratch + (size_t) nchannels * width) + (size_t) c * width * pheight;
+
+	zero = (uint16_t*) ((uint32_t*) scratch + (size_t) nchannels * width) + (size_t) nchannels * width * pheight;
+	plane = (uint8_t*) (zero + width);
+
+	for( c = 0; c < nchannels; c++ )
+		mean[c] = plane + (size_t) pwidth * pheight + (size_t) c * width;
+
+	memset( zero, 0, width * sizeof(uint16_t) );
+
+	/* Padded source window, row-major */
+	for( row = 0; row < pheight; row++ )
+	{
+		frame_gather_colors( src, rect->col - radius, rect->row - radius + row, pwidth, plane + (size_t) row * pwidth );
+
+		if( tables )
+		{
+			for( c = 0; c < nchannels; c++ )
+				filter_blur_horizontal_lut( plane + (size_t) row * pwidth, hsum[c] + (size_t) row * width, width, radius, lut[c] );
+		}
+		else
+		{
+			filter_blur_horizontal( plane + (size_t) row * pwidth, hsum[0] + (size_t) row * width, width, radius );
+		}
+	}
+
+	inv = 1.0f / (float) ((2 * radius + 1) * (2 * radius + 1));
+
+	/* Column sums of the window above the first row */
+	for( c = 0; c < nchannels; c++ )
+	{
+		memset( vsum[c], 0, width * sizeof(uint32_t) );
+
+		for( row = 0; row < 2 * radius; row++ )
+			filter_blur_slide( vsum[c], hsum[c] + (size_t) row * width, zero, width );
+	}
+
+	for( row = 0; row < height; row++ )
+	{
+		/* Padded rows [row, row + 2 * radius] */
+		for( c = 0; c < nchannels; c++ )
+		{
+			filter_blur_slide( vsum[c], hsum[c] + (size_t) (row + 2 * radius) * width, (row) ? hsum[c] + (size_t) (row - 1) * width : zero, width );
+			filter_blur_divide( mean[c], vsum[c], width, inv );
+		}
+
+		/* Everything but the color comes from the source point */
+		out = frame_get_row( dst, rect->row + row ) + rect->col;
 
-	frame_get_point( frm, col + 1, row -1, &point );
-	sum += point.color;
+		memcpy( out, frame_get_row( src, rect->row + row ) + rect->col, width * sizeof(frame_point_t) );
 
-	frame_get_point( frm, col - 1, row + 1, &point );
-	sum += point.color;
+		if( tables )
+		{
+			for( col = 0; col < width; col++ )
+			{
+				center = (uint8_t) out[col].color;
 
-	frame_get_point( frm, col - 1, row - 1, &point );
-	sum += point.color;
+				if( (mean[0][col] == lut[0][ center ]) && (mean[1][col] == lut[1][ center ]) && (mean[2][col] == lut[2][ center ]) )
+					continue;
 
-	frame_get_point( frm, col, row, &point );
-	sum += point.color;
+				out[col].color = palette_tables_get_nearest_color( tables, mean[0][col], mean[1][col], mean[2][col] );
+			}
+		}
+		else
+		{
+			for( col = 0; col < width; col++ )
+				out[col].color = mean[0][col];
+		}
+	}
 
-	pt->bgcolor = point.bgcolor;
-	pt->chr = point.chr;
-	pt->color = ( sum / 5 );
+	if( tables )
+		palette_release_tables( tables );
 }
 
 /* $Id: filter_blur.c 293 2015-07-28 05:24:22Z tiago.ventura $ */
@@ -22,6 +22,43 @@ extern "C" {
 filter_implementation_t * filter_blur_get_implementation( void );
 
 
+/*!
+	\brief Set the blur radius: every point becomes the mean of the (2 * radius + 1)^2 box around it
+	\param this Filter Object
+	\param radius Radius in points (1 to 64)
+*/
+void filter_blur_set_radius( filter_t * this, int radius );
+
+
+/*!
+	\brief Get the blur radius
+	\param this Filter Object
+	\return Radius in points
+*/
+int filter_blur_get_radius( filter_t * this );
+
+
+/*!
+	\brief Blur the colors the indexes stand for instead of the indexes themselves
+
+	Needs the palette of the frames (filter_set_palette()), without one the
+	indexes are blurred. Right for any palette, while blurring the indexes
+	only makes sense for palettes that are a single ramp.
+
+	\param this Filter Object
+	\param enabled 1 to blur in the palette domain, 0 to blur the indexes
+*/
+void filter_blur_set_palette_domain( filter_t * this, int enabled );
+
+
+/*!
+	\brief Get whether the blur works in the palette domain
+	\param this Filter Object
+	\return 1 in the palette domain, 0 on the indexes
+*/
+int filter_blur_get_palette_domain( filter_t * this );
+
+
 #ifdef __cplusplus
 }
 #endif
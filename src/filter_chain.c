@@ -0,0 +1,545 @@
+/*!
+	\file filter_chain.c
+	\brief Filter Chain Object Implementation (Concrete)
+	\author Tiago Ventura (tiago.ventura@gmail.com)
+*/
+
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "frame.h"
+#include "workers.h"
+#include "filter.h"
+#include "filter_chain.h"
+
+
+#define FILTER_CHAIN_MAX_FILTERS    (16)
+#define FILTER_CHAIN_TILE_SIZE      (64)
+
+
+struct filter_chain_state_s
+{
+	int count;
+	filter_t * filter[ FILTER_CHAIN_MAX_FILTERS ];
+	frame_t * buffer[2];    /*!< Whole frames between unfused stages, used in turns */
+	frame_t * local[ WORKERS_MAX_THREADS ][2];   /*!< Tiles of the fused stages, per worker thread */
+};
+
+typedef struct filter_chain_state_s filter_chain_state_t;
+
+
+static filter_t * filter_chain_create( filter_t * parent );
+static void filter_chain_destroy( filter_t * this );
+static void filter_chain_get_filtered_point( filter_t * this, frame_point_t * pt, const frame_t * frm, int col, int row );
+static void filter_chain_filter_frame( filter_t * this, frame_t * dst, const frame_t * src, const frame_rect_t * rect, uint32_t seed );
+static int filter_chain_get_halo( filter_t * this );
+static void filter_chain_set_palette( filter_t * this, palette_t * pal );
+
+
+filter_implementation_t * filter_chain_get_implementation( void )
+{
+	static filter_implementation_t impl;
+
+	impl.create = filter_chain_create;
+	impl.destroy = filter_chain_destroy;
+	impl.get_filtered_point = filter_chain_get_filtered_point;
+	impl.filter_frame = filter_chain_filter_frame;
+	impl.get_halo = filter_chain_get_halo;
+	impl.set_palette = filter_chain_set_palette;
+
+	return &impl;
+}
+
+
+static filter_t * filter_chain_create( filter_t * parent )
+{
+	filter_chain_state_t * state = NULL;
+
+	state = (filter_chain_state_t*) calloc( 1, sizeof(filter_chain_state_t) );
+
+	if(!state)
+		return NULL;
+
+	filter_set_data( parent, state );
+
+	return parent;
+}
+
+
+static void filter_chain_destroy( filter_t * this )
+{
+	filter_chain_state_t * state = filter_get_data( this );
+	int i = 0;
+
+	for( i = 0; i < state->count; i++ )
+		filter_destroy( state->filter[i] );
+
+	for( i = 0; i < 2; i++ )
+		if( state->buffer[i] )
+			frame_destroy( state->buffer[i] );
+
+	for( i = 0; i < WORKERS_MAX_THREADS; i++ )
+	{
+		if( state->local[i][0] )
+			frame_destroy( state->local[i][0] );
+
+		if( state->local[i][1] )
+			frame_destroy( state->local[i][1] );
+	}
+
+	free( state );
+}
+
+
+int filter_chain_append( filter_t * this, filter_t * flt )
+{
+	filter_chain_state_t * state = filter_get_data( this );
+
+	if( state->count >= FILTER_CHAIN_MAX_FILTERS )
+		return -1;
+
+	state->filter[ state->count++ ] = flt;
+
+	filter_set_palette( flt, filter_get_palette( this ) );
+
+	return 0;
+}
+
+
+int filter_chain_get_count( filter_t * this )
+{
+	return ((filter_chain_state_t*) filter_get_data( this ))->count;
+}
+
+
+static int filter_chain_get_halo( filter_t * this )
+{
+	filter_chain_state_t * state = filter_get_data( this );
+	int halo = 0;
+	int i = 0;
+
+	for( i = 0; i < state->count; i++ )
+	{
+		if( filter_get_halo( state->filter[i] ) < 0 )
+			return -1;
+
+		halo += filter_get_halo( state->filter[i] );
+	}
+
+	return halo;
+}
+
+
+static void filter_chain_set_palette( filter_t * this, palette_t * pal )
+{
+	filter_chain_state_t * state = filter_get_data( this );
+	int i = 0;
+
+	for( i = 0; i < state->count; i++ )
+		filter_set_palette( state->filter[i], pal );
+}
+
+
+/*!
+	\brief Point-wise access is not a chain operation, the point goes through untouched
+*/
+static void filter_chain_get_filtered_point( filter_t * this, frame_point_t * pt, const frame_t * frm, int col, int row )
+{
+	frame_get_point( frm, col, row, pt );
+}
+
+
+static void filter_chain_intersect( frame_rect_t * rect, int col, int row, int ncols, int nrows )
+{
+	int right = rect->col + rect->ncols;
+	int bottom = rect->row + rect->nrows;
+
+	if( rect->col < col )
+		rect->col = col;
+
+	if( rect->row < row )
+		rect->row = row;
+
+	if( right > col + ncols )
+		right = col + ncols;
+
+	if( bottom > row + nrows )
+		bottom = row + nrows;
+
+	rect->ncols = right - rect->col;
+	rect->nrows = bottom - rect->row;
+}
+
+
+/*!
+	\brief Copy a rectangle of points between two frames, at different positions
+*/
+static void filter_chain_copy_rect( frame_t * dst, int dcol, int drow, const frame_t * src, const frame_rect_t * rect )
+{
+	int row = 0;
+
+	if( (rect->ncols <= 0) || (rect->nrows <= 0) )
+		return;
+
+	for( row = 0; row < rect->nrows; row++ )
+		memcpy( frame_get_row( dst, drow + row ) + dcol, frame_get_row( src, rect->row + row ) + rect->col, rect->ncols * sizeof(frame_point_t) );
+}
+
+
+/*!
+	\brief Copy a rectangle of points that may reach outside of the source frame, read through its border mode
+*/
+static void filter_chain_copy_border_rect( frame_t * dst, const frame_t * src, const frame_rect_t * rect )
+{
+	const frame_point_t * in = NULL;
+	frame_point_t * out = NULL;
+	int row = 0;
+	int col = 0;
+	int sr = 0;
+	int sc = 0;
+
+	for( row = 0; row < rect->nrows; row++ )
+	{
+		out = frame_get_row( dst, row );
+		sr = frame_get_border_row( src, rect->row + row );
+
+		if( sr < 0 )
+		{
+			memset( out, 0, rect->ncols * sizeof(frame_point_t) );
+			continue;
+		}
+
+		in = frame_get_row( src, sr );
+
+		for( col = 0; col < rect->ncols; col++ )
+		{
+			sc = frame_get_border_col( src, rect->col + col );
+
+			if( sc < 0 )
+				memset( &out[col], 0, sizeof(frame_point_t) );
+			else
+				out[col] = in[sc];
+		}
+	}
+}
+
+
+/*!
+	\brief Fill the points of area outside of inside as a zero padded or extended border of inside would read
+*/
+static void filter_chain_pad( frame_t * frm, const frame_rect_t * inside, const frame_rect_t * area, frame_border_mode_t mode )
+{
+	frame_point_t * out = NULL;
+	int right = inside->col + inside->ncols;
+	int bottom = inside->row + inside->nrows;
+	int row = 0;
+	int col = 0;
+
+	/* Sides of the rows of inside first, the rows above and below are copies of its first and last rows */
+	for( row = inside->row; row < bottom; row++ )
+	{
+		out = frame_get_row( frm, row );
+
+		for( col = area->col; col < inside->col; col++ )
+		{
+			if( mode == frame_border_extended )
+				out[col] = out[ inside->col ];
+			else
+				memset( &out[col], 0, sizeof(frame_point_t) );
+		}
+
+		for( col = right; col < area->col + area->ncols; col++ )
+		{
+			if( mode == frame_border_extended )
+				out[col] = out[ right - 1 ];
+			else
+				memset( &out[col], 0, sizeof(frame_point_t) );
+		}
+	}
+
+	for( row = area->row; row < area->row + area->nrows; row++ )
+	{
+		if( (row >= inside->row) && (row < bottom) )
+			continue;
+
+		out = frame_get_row( frm, row ) + area->col;
+
+		if( mode == frame_border_extended )
+			memcpy( out, frame_get_row( frm, (row < inside->row) ? inside->row : bottom - 1 ) + area->col, area->ncols * sizeof(frame_point_t) );
+		else
+			memset( out, 0, area->ncols * sizeof(frame_point_t) );
+	}
+}
+
+
+/*!
+	\brief Run the filters [first, last] fused, tile by tile
+
+	Each tile is copied with the halo of the whole group into a small local
+	frame. Every filter then shrinks the valid area by its own halo, going
+	back and forth between two local frames, until only the tile is left.
+	The halo is read through the border mode of the source frame. On a
+	toroidal frame the filters run over the whole halo, which wraps around
+	like the source does. Otherwise they stop at the edges of the source
+	frame, and the local points past them are filled as the border of
+	a whole frame would read. The local frames are the calling thread's,
+	reserved for the largest group of the chain.
+*/
+static void filter_chain_run_fused( filter_chain_state_t * state, int first, int last, frame_t * dst, const frame_t * src, const frame_rect_t * rect, uint32_t seed )
+{
+	frame_t ** local = state->local[ workers_get_thread_index() ];
+	frame_border_mode_t mode = frame_get_border_mode( src );
+	frame_t * in = NULL;
+	frame_t * out = NULL;
+	frame_t * swap = NULL;
+	frame_rect_t area = *rect;
+	frame_rect_t tile;
+	frame_rect_t need;
+	frame_rect_t r;
+	uint32_t tseed = 0;
+	int halo = 0;
+	int remaining = 0;
+	int border = 0;
+	int ncols = 0;
+	int nrows = 0;
+	int ox = 0;
+	int oy = 0;
+	int i = 0;
+
+	frame_get_dimensions( src, &ncols, &nrows );
+
+	filter_chain_intersect( &area, 0, 0, ncols, nrows );
+
+	if( (area.ncols <= 0) || (area.nrows <= 0) )
+		return;
+
+	for( i = first; i <= last; i++ )
+		halo += filter_get_halo( state->filter[i] );
+
+	if( !local[0] || !local[1] || (frame_get_cols_count( local[0] ) < FILTER_CHAIN_TILE_SIZE + 2 * halo) )
+		return;
+
+	for( tile.row = area.row; tile.row < area.row + area.nrows; tile.row += FILTER_CHAIN_TILE_SIZE )
+	{
+		for( tile.col = area.col; tile.col < area.col + area.ncols; tile.col += FILTER_CHAIN_TILE_SIZE )
+		{
+			tile.ncols = FILTER_CHAIN_TILE_SIZE;
+			tile.nrows = FILTER_CHAIN_TILE_SIZE;
+
+			tseed = filter_mix_seed( seed, (tile.row << 16) ^ tile.col );
+
+			filter_chain_intersect( &tile, area.col, area.row, area.ncols, area.nrows );
+
+			/* Position of the local frames in the source frame */
+			ox = tile.col - halo;
+			oy = tile.row - halo;
+
+			border = (ox < 0) || (oy < 0) || (ox + tile.ncols + 2 * halo > ncols) || (oy + tile.nrows + 2 * halo > nrows);
+
+			in = local[0];
+			out = local[1];
+
+			r.col = ox;
+			r.row = oy;
+			r.ncols = tile.ncols + 2 * halo;
+			r.nrows = tile.nrows + 2 * halo;
+
+			if( border )
+				filter_chain_copy_border_rect( in, src, &r );
+			else
+				filter_chain_copy_rect( in, 0, 0, src, &r );
+
+			remaining = halo;
+
+			for( i = first; i <= last; i++ )
+			{
+				remaining -= filter_get_halo( state->filter[i] );
+
+				/* Area the next filters still need, in local coordinates */
+				need.col = halo - remaining;
+				need.row = halo - remaining;
+				need.ncols = tile.ncols + 2 * remaining;
+				need.nrows = tile.nrows + 2 * remaining;
+
+				r = need;
+
+				/* Past the edges of a frame that does not wrap, the border gives the points and not the filter */
+				if( border && (mode != frame_border_toroidal) )
+					filter_chain_intersect( &r, -ox, -oy, ncols, nrows );
+
+				filter_frame_rect( state->filter[i], out, in, &r, filter_mix_seed( tseed, i ) );
+
+				if( border && (mode != frame_border_toroidal) && (i < last) )
+					filter_chain_pad( out, &r, &need, mode );
+
+				swap = in;
+				in = out;
+				out = swap;
+			}
+
+			r.col = halo;
+			r.row = halo;
+			r.ncols = tile.ncols;
+			r.nrows = tile.nrows;
+
+			filter_chain_copy_rect( dst, tile.col, tile.row, in, &r );
+		}
+	}
+}
+
+
+/*!
+	\brief Last filter of the group that starts at first: runs of filters with a known halo fuse
+*/
+static int filter_chain_get_group_end( filter_chain_state_t * state, int first )
+{
+	int last = first;
+
+	if( filter_get_halo( state->filter[first] ) < 0 )
+		return first;
+
+	while( (last + 1 < state->count) && (filter_get_halo( state->filter[ last + 1 ] ) >= 0) )
+		last++;
+
+	return last;
+}
+
+
+/*!
+	\brief Make sure the frames the chain works in exist and fit
+
+	The local tiles of the calling thread fit the fused group with the
+	largest halo; the whole frames between groups exist only when the
+	chain has more than one group. Both are kept from frame to frame.
+
+	\return 0 on success, -1 on failure
+*/
+static int filter_chain_reserve( filter_chain_state_t * state, int ncols, int nrows )
+{
+	frame_t ** local = state->local[ workers_get_thread_index() ];
+	int size = 0;
+	int halo = 0;
+	int first = 0;
+	int last = 0;
+	int i = 0;
+
+	for( first = 0; first < state->count; first = last + 1 )
+	{
+		last = filter_chain_get_group_end( state, first );
+
+		if( last == first )
+			continue;
+
+		for( i = first, halo = 0; i <= last; i++ )
+			halo += filter_get_halo( state->filter[i] );
+
+		if( FILTER_CHAIN_TILE_SIZE + 2 * halo > size )
+			size = FILTER_CHAIN_TILE_SIZE + 2 * halo;
+	}
+
+	for( i = 0; (i < 2) && size; i++ )
+	{
+		if( local[i] && (frame_get_cols_count( local[i] ) < size) )
+		{
+			frame_destroy( local[i] );
+			local[i] = NULL;
+		}
+
+		if( !local[i] )
+			local[i] = frame_create( size, size );
+
+		if( !local[i] )
+			return -1;
+	}
+
+	if( filter_chain_get_group_end( state, 0 ) == state->count - 1 )
+		return 0;
+
+	for( i = 0; i < 2; i++ )
+	{
+		if( state->buffer[i] && ( (frame_get_cols_count( state->buffer[i] ) != ncols) || (frame_get_rows_count( state->buffer[i] ) != nrows) ) )
+		{
+			frame_destroy( state->buffer[i] );
+			state->buffer[i] = NULL;
+		}
+
+		if( !state->buffer[i] )
+			state->buffer[i] = frame_create( ncols, nrows );
+
+		if( !state->buffer[i] )
+			return -1;
+	}
+
+	return 0;
+}
+
+
+static void filter_chain_filter_frame( filter_t * this, frame_t * dst, const frame_t * src, const frame_rect_t * rect, uint32_t seed )
+{
+	filter_chain_state_t * state = filter_get_data( this );
+	const frame_t * in = src;
+	frame_t * out = NULL;
+	frame_rect_t r;
+	int halo = 0;
+	int first = 0;
+	int last = 0;
+	int ncols = 0;
+	int nrows = 0;
+	int turn = 0;
+	int i = 0;
+
+	if( !state->count )
+	{
+		filter_chain_copy_rect( dst, rect->col, rect->row, src, rect );
+		return;
+	}
+
+	frame_get_dimensions( src, &ncols, &nrows );
+
+	if( filter_chain_reserve( state, ncols, nrows ) )
+		return;
+
+	for( first = 0; first < state->count; first = last + 1 )
+	{
+		last = filter_chain_get_group_end( state, first );
+
+		out = (last == state->count - 1) ? dst : state->buffer[ turn ];
+
+		/* The next group reads around the edges of this one's output as it would around the source */
+		if( out != dst )
+			frame_set_border_mode( out, frame_get_border_mode( src ) );
+
+		/* The following groups read around the rectangle, whole frame if they may read anywhere */
+		halo = 0;
+
+		for( i = last + 1; (i < state->count) && (halo >= 0); i++ )
+			halo = (filter_get_halo( state->filter[i] ) < 0) ? -1 : halo + filter_get_halo( state->filter[i] );
+
+		if( halo < 0 )
+		{
+			r.col = 0;
+			r.row = 0;
+			r.ncols = ncols;
+			r.nrows = nrows;
+		}
+		else
+		{
+			r.col = rect->col - halo;
+			r.row = rect->row - halo;
+			r.ncols = rect->ncols + 2 * halo;
+			r.nrows = rect->nrows + 2 * halo;
+		}
+
+		if( (last > first) && (filter_get_halo( state->filter[first] ) >= 0) )
+			filter_chain_run_fused( state, first, last, out, in, &r, filter_mix_seed( seed, first ) );
+		else
+			filter_frame_rect( state->filter[first], out, in, &r, filter_mix_seed( seed, first ) );
+
+		in = out;
+		turn = !turn;
+	}
+}
+
+/* $Id$ */
@@ -0,0 +1,57 @@
+/*!
+	\file filter_chain.h
+	\brief Filter Chain Interface
+	\author Tiago Ventura (tiago.ventura@gmail.com)
+*/
+
+
+#ifndef __FILTER_CHAIN_H__
+#define __FILTER_CHAIN_H__
+
+
+#include "filter.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/*!
+	\brief Concrete Filter: an ordered list of filters applied one after the other
+
+	Consecutive filters that know their halo are fused: the chain walks the
+	frame in tiles and runs all of them on a tile (plus the halo it needs)
+	before moving to the next one, so the intermediate results stay in the
+	cache. A filter with an unknown halo is run on its own over the whole
+	frame, between two frames allocated once and used in turns.
+
+	\return
+*/
+filter_implementation_t * filter_chain_get_implementation( void );
+
+
+/*!
+	\brief Append a filter to the end of the chain, the chain takes its ownership
+	\param this Filter Chain Object
+	\param flt Filter Object
+	\return 0 on success, -1 if the chain is full
+*/
+int filter_chain_append( filter_t * this, filter_t * flt );
+
+
+/*!
+	\brief Get the number of filters in the chain
+	\param this Filter Chain Object
+	\return Filters count
+*/
+int filter_chain_get_count( filter_t * this );
+
+
+#ifdef __cplusplus
+}
+#endif
+
+
+#endif /* __FILTER_CHAIN_H__ */
+
+/* $Id$ */
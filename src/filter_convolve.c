@@ -0,0 +1,344 @@
+/*!
+	\file filter_convolve.c
+	\brief Convolution Filter Object Implementation (Concrete)
+	\author Tiago Ventura (tiago.ventura@gmail.com)
+*/
+
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+
+#include "frame.h"
+#include "filter.h"
+#include "filter_convolve.h"
+
+
+#define FILTER_CONVOLVE_MAX_SIZE         (15)
+#define FILTER_CONVOLVE_MAX_GAIN         (64)
+#define FILTER_CONVOLVE_FIXED_SHIFT      (16)
+#define FILTER_CONVOLVE_FIXED_ONE        (1 << FILTER_CONVOLVE_FIXED_SHIFT)
+#define FILTER_CONVOLVE_DEFAULT_KERNEL   (filter_convolve_gaussian3)
+
+
+struct filter_convolve_params_s
+{
+	int size;
+	int32_t bias;                                                         /*!< Bias plus rounding, 16.16 fixed point */
+	int32_t weight[ FILTER_CONVOLVE_MAX_SIZE * FILTER_CONVOLVE_MAX_SIZE ];  /*!< Weights over the divisor, 16.16 fixed point */
+};
+
+typedef struct filter_convolve_params_s filter_convolve_params_t;
+
+
+static filter_t * filter_convolve_create( filter_t * parent );
+static void filter_convolve_destroy( filter_t * this );
+static void filter_convolve_get_filtered_point( filter_t * this, frame_point_t * pt, const frame_t * frm, int col, int row );
+static void filter_convolve_filter_frame( filter_t * this, frame_t * dst, const frame_t * src, const frame_rect_t * rect, uint32_t seed );
+static int filter_convolve_get_halo( filter_t * this );
+
+
+filter_implementation_t * filter_convolve_get_implementation( void )
+{
+	static filter_implementation_t impl;
+
+	impl.create = filter_convolve_create;
+	impl.destroy = filter_convolve_destroy;
+	impl.get_filtered_point = filter_convolve_get_filtered_point;
+	impl.filter_frame = filter_convolve_filter_frame;
+	impl.get_halo = filter_convolve_get_halo;
+
+	return &impl;
+}
+
+
+static filter_t * filter_convolve_create( filter_t * parent )
+{
+	filter_convolve_params_t * params = NULL;
+
+	params = (filter_convolve_params_t *) calloc( 1, sizeof(filter_convolve_params_t) );
+
+	if(!params)
+		return NULL;
+
+	filter_set_data( parent, params );
+
+	filter_convolve_set_predefined_kernel( parent, FILTER_CONVOLVE_DEFAULT_KERNEL );
+
+	return parent;
+}
+
+
+static void filter_convolve_destroy( filter_t * this )
+{
+	free( filter_get_data( this ) );
+}
+
+
+int filter_convolve_set_kernel( filter_t * this, int size, const int * weights, int divisor, int bias )
+{
+	filter_convolve_params_t * params = filter_get_data( this );
+	long gain = 0;
+	int i = 0;
+
+	if( (size < 1) || (size > FILTER_CONVOLVE_MAX_SIZE) || !(size & 1) || !divisor || (bias < -255) || (bias > 255) )
+		return -1;
+
+	for( i = 0; i < size * size; i++ )
+		gain += labs( weights[i] );
+
+	/* Keeps the 32-bit sums of 8-bit colors from overflowing */
+	if( gain > (long) FILTER_CONVOLVE_MAX_GAIN * labs( divisor ) )
+		return -1;
+
+	params->size = size;
+	params->bias = bias * FILTER_CONVOLVE_FIXED_ONE + FILTER_CONVOLVE_FIXED_ONE / 2;
+
+	for( i = 0; i < size * size; i++ )
+		params->weight[i] = (int32_t) lround( (double) weights[i] * FILTER_CONVOLVE_FIXED_ONE / divisor );
+
+	return 0;
+}
+
+
+void filter_convolve_set_predefined_kernel( filter_t * this, filter_convolve_kernel_t kernel )
+{
+	static const int box3[9] = {	1, 1, 1,
+									1, 1, 1,
+									1, 1, 1 };
+
+	static const int box5[25] = {	1, 1, 1, 1, 1,
+									1, 1, 1, 1, 1,
+									1, 1, 1, 1, 1,
+									1, 1, 1, 1, 1,
+									1, 1, 1, 1, 1 };
+
+	static const int gaussian3[9] = {	1, 2, 1,
+										2, 4, 2,
+										1, 2, 1 };
+
+	static const int gaussian5[25] = {	1,  4,  6,  4, 1,
+										4, 16, 24, 16, 4,
+										6, 24, 36, 24, 6,
+										4, 16, 24, 16, 4,
+										1,  4,  6,  4, 1 };
+
+	static const int sharpen[9] = {	 0, -1,  0,
+									-1,  5, -1,
+									 0, -1,  0 };
+
+	static const int edge[9] = {	-1, -1, -1,
+									-1,  8, -1,
+									-1, -1, -1 };
+
+	static const int emboss[9] = {	-2, -1, 0,
+									-1,  1, 1,
+									 0,  1, 2 };
+
+	switch( kernel )
+	{
+		case filter_convolve_box3: filter_convolve_set_kernel( this, 3, box3, 9, 0 ); break;
+		case filter_convolve_box5: filter_convolve_set_kernel( this, 5, box5, 25, 0 ); break;
+		case filter_convolve_gaussian3: filter_convolve_set_kernel( this, 3, gaussian3, 16, 0 ); break;
+		case filter_convolve_gaussian5: filter_convolve_set_kernel( this, 5, gaussian5, 256, 0 ); break;
+		case filter_convolve_sharpen: filter_convolve_set_kernel( this, 3, sharpen, 1, 0 ); break;
+		case filter_convolve_edge: filter_convolve_set_kernel( this, 3, edge, 1, 0 ); break;
+		case filter_convolve_emboss: filter_convolve_set_kernel( this, 3, emboss, 1, 0 ); break;
+	}
+}
+
+
+int filter_convolve_get_size( filter_t * this )
+{
+	return ((filter_convolve_params_t*)(filter_get_data(this)))->size;
+}
+
+
+static int filter_convolve_get_halo( filter_t * this )
+{
+	return filter_convolve_get_size( this ) / 2;
+}
+
+
+static inline uint8_t filter_convolve_clamp( int32_t sum )
+{
+	sum >>= FILTER_CONVOLVE_FIXED_SHIFT;
+
+	return (uint8_t) ( (sum < 0) ? 0 : ( (sum > 255) ? 255 : sum ) );
+}
+
+
+/*!
+	\brief Reference implementation, one point at a time
+*/
+static void filter_convolve_get_filtered_point( filter_t * this, frame_point_t * pt, const frame_t * frm, int col, int row )
+{
+	filter_convolve_params_t * params = filter_get_data( this );
+	int h = params->size / 2;
+	int32_t sum = params->bias;
+	int i = 0;
+	int j = 0;
+	frame_point_t point;
+
+	for( j = 0; j < params->size; j++ )
+	{
+		for( i = 0; i < params->size; i++ )
+		{
+			frame_get_point( frm, col + i - h, row + j - h, &point );
+			sum += params->weight[ j * params->size + i ] * (uint8_t) point.color;
+		}
+	}
+
+	frame_get_point( frm, col, row, pt );
+
+	pt->color = filter_convolve_clamp( sum );
+}
+
+
+/*!
+	\brief 3x3 kernel over one row, every tap unrolled (vectorized across the columns)
+*/
+static void filter_convolve_row_3x3( uint8_t * restrict dst, const uint8_t * restrict p0, const uint8_t * restrict p1, const uint8_t * restrict p2, const int32_t * restrict w, int32_t bias, int ncols )
+{
+	const int32_t w0 = w[0], w1 = w[1], w2 = w[2];
+	const int32_t w3 = w[3], w4 = w[4], w5 = w[5];
+	const int32_t w6 = w[6], w7 = w[7], w8 = w[8];
+	int col = 0;
+
+	for( col = 0; col < ncols; col++ )
+	{
+		dst[col] = filter_convolve_clamp( bias +
+						w0 * p0[col] + w1 * p0[col + 1] + w2 * p0[col + 2] +
+						w3 * p1[col] + w4 * p1[col + 1] + w5 * p1[col + 2] +
+						w6 * p2[col] + w7 * p2[col + 1] + w8 * p2[col + 2] );
+	}
+}
+
+
+static inline int32_t filter_convolve_taps_5( const uint8_t * restrict p, const int32_t * restrict w, int col )
+{
+	return w[0] * p[col] + w[1] * p[col + 1] + w[2] * p[col + 2] + w[3] * p[col + 3] + w[4] * p[col + 4];
+}
+
+
+/*!
+	\brief 5x5 kernel over one row, every tap unrolled (vectorized across the columns)
+*/
+static void filter_convolve_row_5x5( uint8_t * restrict dst, const uint8_t * restrict p, int pwidth, const int32_t * restrict w, int32_t bias, int ncols )
+{
+	const uint8_t * restrict p0 = p;
+	const uint8_t * restrict p1 = p0 + pwidth;
+	const uint8_t * restrict p2 = p1 + pwidth;
+	const uint8_t * restrict p3 = p2 + pwidth;
+	const uint8_t * restrict p4 = p3 + pwidth;
+	int col = 0;
+
+	for( col = 0; col < ncols; col++ )
+	{
+		dst[col] = filter_convolve_clamp( bias +
+						filter_convolve_taps_5( p0, w, col ) +
+						filter_convolve_taps_5( p1, w + 5, col ) +
+						filter_convolve_taps_5( p2, w + 10, col ) +
+						filter_convolve_taps_5( p3, w + 15, col ) +
+						filter_convolve_taps_5( p4, w + 20, col ) );
+	}
+}
+
+
+/*!
+	\brief Any kernel over one row, one tap at a time into the sums
+*/
+static void filter_convolve_row_generic( uint8_t * restrict dst, int32_t * restrict sum, const uint8_t * restrict p, int pwidth, const int32_t * restrict w, int size, int32_t bias, int ncols )
+{
+	const uint8_t * restrict tap = NULL;
+	int32_t weight = 0;
+	int col = 0;
+	int i = 0;
+	int j = 0;
+
+	for( col = 0; col < ncols; col++ )
+		sum[col] = bias;
+
+	for( j = 0; j < size; j++ )
+	{
+		for( i = 0; i < size; i++ )
+		{
+			weight = w[ j * size + i ];
+			tap = p + (size_t) j * pwidth + i;
+
+			for( col = 0; col < ncols; col++ )
+				sum[col] += weight * tap[col];
+		}
+	}
+
+	for( col = 0; col < ncols; col++ )
+		dst[col] = filter_convolve_clamp( sum[col] );
+}
+
+
+/*!
+	\brief Convolution of a rectangle
+
+	The colors of the rectangle and of its halo are gathered into an 8-bit
+	plane, the border mode of the source frame giving the colors of the halo
+	outside of it. Then every row of the rectangle is convolved from the
+	plane, by the 3x3 or 5x5 specialized code when the kernel has one of
+	these sizes.
+*/
+static void filter_convolve_filter_frame( filter_t * this, frame_t * dst, const frame_t * src, const frame_rect_t * rect, uint32_t seed )
+{
+	filter_convolve_params_t * params = filter_get_data( this );
+	int size = params->size;
+	int h = size / 2;
+	int width = rect->ncols;
+	int pwidth = width + 2 * h;
+	int pheight = rect->nrows + 2 * h;
+	uint8_t * scratch = NULL;
+	int32_t * sum = NULL;
+	uint8_t * plane = NULL;
+	uint8_t * p = NULL;
+	uint8_t * result = NULL;
+	frame_point_t * out = NULL;
+	int row = 0;
+	int col = 0;
+
+	/* sum first, it needs the alignment */
+	scratch = (uint8_t*) filter_get_scratch( this, (size_t) width * sizeof(int32_t) + (size_t) pwidth * pheight + (size_t) width );
+
+	if( !scratch )
+		return;
+
+	sum = (int32_t*) scratch;
+	plane = (uint8_t*) (sum + width);
+	result = plane + (size_t) pwidth * pheight;
+
+	/* Padded source window, row-major */
+	for( row = 0; row < pheight; row++ )
+	{
+		frame_gather_colors( src, rect->col - h, rect->row - h + row, pwidth, plane + (size_t) row * pwidth );
+	}
+
+	for( row = 0; row < rect->nrows; row++ )
+	{
+		p = plane + (size_t) row * pwidth;
+
+		if( size == 3 )
+			filter_convolve_row_3x3( result, p, p + pwidth, p + 2 * pwidth, params->weight, params->bias, width );
+		else if( size == 5 )
+			filter_convolve_row_5x5( result, p, pwidth, params->weight, params->bias, width );
+		else
+			filter_convolve_row_generic( result, sum, p, pwidth, params->weight, size, params->bias, width );
+
+		/* Everything but the color comes from the source point */
+		out = frame_get_row( dst, rect->row + row ) + rect->col;
+
+		memcpy( out, frame_get_row( src, rect->row + row ) + rect->col, width * sizeof(frame_point_t) );
+
+		for( col = 0; col < width; col++ )
+			out[col].color = result[col];
+	}
+
+}
+
+/* $Id$ */
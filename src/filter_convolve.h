@@ -0,0 +1,86 @@
+/*!
+	\file filter_convolve.h
+	\brief Convolution Filter Interface
+	\author Tiago Ventura (tiago.ventura@gmail.com)
+*/
+
+
+#ifndef __FILTER_CONVOLVE_H__
+#define __FILTER_CONVOLVE_H__
+
+
+#include "filter.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/*!
+	\brief Convolution Kernels Type Definition
+*/
+typedef enum filter_convolve_kernel_e filter_convolve_kernel_t;
+
+
+/*!
+	\brief Enumerate the predefined convolution kernels
+*/
+enum filter_convolve_kernel_e
+{
+	filter_convolve_box3,       /*!< 3x3 Mean */
+	filter_convolve_box5,       /*!< 5x5 Mean */
+	filter_convolve_gaussian3,  /*!< 3x3 Binomial Gaussian Approximation */
+	filter_convolve_gaussian5,  /*!< 5x5 Binomial Gaussian Approximation */
+	filter_convolve_sharpen,    /*!< 3x3 Sharpen */
+	filter_convolve_edge,       /*!< 3x3 Laplacian Edge Detection */
+	filter_convolve_emboss      /*!< 3x3 Emboss */
+};
+
+
+/*!
+	\brief Concrete Filter: convolution of the colors with a square kernel (3x3 gaussian by default)
+	\return
+*/
+filter_implementation_t * filter_convolve_get_implementation( void );
+
+
+/*!
+	\brief Set an arbitrary kernel, every color becomes (sum of weight * color) / divisor + bias, clamped to 0..255
+
+	The weights are turned into 16.16 fixed point, so the convolution of a
+	frame never touches floating point.
+
+	\param this Filter Object
+	\param size Kernel side, odd, from 1 to 15
+	\param weights size * size weights, row-major
+	\param divisor Divisor (not 0), the sum of the weights divided by it must not exceed 64 in absolute value
+	\param bias Value added to every result, from -255 to 255
+	\return 0 on success, -1 if the kernel was rejected (the previous one is kept)
+*/
+int filter_convolve_set_kernel( filter_t * this, int size, const int * weights, int divisor, int bias );
+
+
+/*!
+	\brief Set one of the predefined kernels
+	\param this Filter Object
+	\param kernel Kernel
+*/
+void filter_convolve_set_predefined_kernel( filter_t * this, filter_convolve_kernel_t kernel );
+
+
+/*!
+	\brief Get the kernel side
+	\param this Filter Object
+	\return Kernel side in points
+*/
+int filter_convolve_get_size( filter_t * this );
+
+
+#ifdef __cplusplus
+}
+#endif
+
+
+#endif /* __FILTER_CONVOLVE_H__ */
+
+/* $Id$ */
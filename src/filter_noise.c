@@ -6,6 +6,7 @@
 
 
 #include <stdlib.h>
+#include <stdint.h>
 
 #include "frame.h"
 #include "filter.h"
@@ -13,11 +14,17 @@
 
 
 #define FILTER_NOISE_DEFAULT_DISPERSION_VALUE    (3)
+#define FILTER_NOISE_MAX_DISPERSION              (64)
+#define FILTER_NOISE_TEXTURE_SHIFT               (8)
+#define FILTER_NOISE_TEXTURE_SIZE                (1 << FILTER_NOISE_TEXTURE_SHIFT)
+#define FILTER_NOISE_TEXTURE_MASK                (FILTER_NOISE_TEXTURE_SIZE - 1)
 
 
 struct filter_noise_params_s
 {
 	int dispersion;
+	uint8_t roff[ FILTER_NOISE_TEXTURE_SIZE * FILTER_NOISE_TEXTURE_SIZE ];  /*!< Row displacements, from 0 to dispersion */
+	uint8_t coff[ FILTER_NOISE_TEXTURE_SIZE * FILTER_NOISE_TEXTURE_SIZE ];  /*!< Column displacements, from 0 to dispersion */
 };
 
 typedef struct filter_noise_params_s filter_noise_params_t;
@@ -25,7 +32,9 @@ typedef struct filter_noise_params_s filter_noise_params_t;
 
 static filter_t * filter_noise_create( filter_t * parent );
 static void filter_noise_destroy( filter_t * this );
-static void filter_noise_get_filtered_point( filter_t * this, frame_point_t * pt, frame_t * frm, int col, int row );
+static void filter_noise_get_filtered_point( filter_t * this, frame_point_t * pt, const frame_t * frm, int col, int row );
+static void filter_noise_filter_frame( filter_t * this, frame_t * dst, const frame_t * src, const frame_rect_t * rect, uint32_t seed );
+static int filter_noise_get_halo( filter_t * this );
 
 
 filter_implementation_t * filter_noise_get_implementation( void )
@@ -35,6 +44,8 @@ filter_implementation_t * filter_noise_get_implementation( void )
 	impl.create = filter_noise_create;
 	impl.destroy = filter_noise_destroy;
 	impl.get_filtered_point = filter_noise_get_filtered_point;
+	impl.filter_frame = filter_noise_filter_frame;
+	impl.get_halo = filter_noise_get_halo;
 
 	return &impl;
 }
@@ -49,10 +60,10 @@ static filter_t * filter_noise_create( filter_t * parent )
 	if(!params)
 		return NULL;
 
-	params->dispersion = FILTER_NOISE_DEFAULT_DISPERSION_VALUE;
-
 	filter_set_data( parent, params );
 
+	filter_noise_set_dispersion( parent, FILTER_NOISE_DEFAULT_DISPERSION_VALUE );
+
 	return parent;
 }
 
@@ -63,9 +74,34 @@ static void filter_noise_destroy( filter_t * this )
 }
 
 
+/*!
+	\brief Fill the displacement texture, the frames are displaced by a random window of it
+*/
+static void filter_noise_fill_texture( filter_noise_params_t * params )
+{
+	int i = 0;
+
+	for( i = 0; i < FILTER_NOISE_TEXTURE_SIZE * FILTER_NOISE_TEXTURE_SIZE; i++ )
+	{
+		params->roff[i] = rand() % (params->dispersion + 1);
+		params->coff[i] = rand() % (params->dispersion + 1);
+	}
+}
+
+
 void filter_noise_set_dispersion( filter_t * this, int dispersion )
 {
-	((filter_noise_params_t*)(filter_get_data(this)))->dispersion = dispersion;
+	filter_noise_params_t * params = filter_get_data( this );
+
+	if( dispersion < 0 )
+		dispersion = 0;
+
+	if( dispersion > FILTER_NOISE_MAX_DISPERSION )
+		dispersion = FILTER_NOISE_MAX_DISPERSION;
+
+	params->dispersion = dispersion;
+
+	filter_noise_fill_texture( params );
 }
 
 
@@ -75,7 +111,16 @@ int filter_noise_get_dispersion( filter_t * this )
 }
 
 
-static void filter_noise_get_filtered_point( filter_t * this, frame_point_t * pt, frame_t * frm, int col, int row )
+static int filter_noise_get_halo( filter_t * this )
+{
+	int d = filter_noise_get_dispersion( this );
+
+	/* Offsets go from -d/2 to d - d/2 */
+	return d - (d / 2);
+}
+
+
+static void filter_noise_get_filtered_point( filter_t * this, frame_point_t * pt, const frame_t * frm, int col, int row )
 {
 	int coff = 0;
 	int roff = 0;
@@ -88,4 +133,90 @@ static void filter_noise_get_filtered_point( filter_t * this, frame_point_t * pt
 	frame_get_point( frm, col + coff, row + roff, pt );
 }
 
+/*!
+	\brief Displace the rectangle with a window of the texture taken at the position given by the seed
+
+	Every row of the rectangle reads from the d + 1 source rows around it. The
+	columns that can not reach outside of the frame, and the rows that can not
+	either, go through the loop without bounds checks. The points that land
+	outside of the frame are read through its border mode, as frame_get_point()
+	does.
+*/
+static void filter_noise_filter_frame( filter_t * this, frame_t * dst, const frame_t * src, const frame_rect_t * rect, uint32_t seed )
+{
+	filter_noise_params_t * params = filter_get_data( this );
+	const frame_point_t * rows[ FILTER_NOISE_MAX_DISPERSION + 1 ];
+	const uint8_t * roff = NULL;
+	const uint8_t * coff = NULL;
+	frame_point_t * out = NULL;
+	frame_point_t zero = { 0, 0, 0, 0 };
+	int d = params->dispersion;
+	int lo = d / 2;
+	int hi = d - lo;
+	int ox = seed & FILTER_NOISE_TEXTURE_MASK;
+	int oy = (seed >> FILTER_NOISE_TEXTURE_SHIFT) & FILTER_NOISE_TEXTURE_MASK;
+	int first = 0;
+	int last = 0;
+	int ncols = 0;
+	int nrows = 0;
+	int row = 0;
+	int col = 0;
+	int sc = 0;
+	int sr = 0;
+	int k = 0;
+	int t = 0;
+
+	frame_get_dimensions( src, &ncols, &nrows );
+
+	/* Columns whose displacement always lands inside of the frame */
+	first = (rect->col > lo) ? rect->col : lo;
+	last = (rect->col + rect->ncols < ncols - hi) ? rect->col + rect->ncols : ncols - hi;
+
+	for( row = rect->row; row < rect->row + rect->nrows; row++ )
+	{
+		out = frame_get_row( dst, row );
+
+		roff = params->roff + (((row + oy) & FILTER_NOISE_TEXTURE_MASK) << FILTER_NOISE_TEXTURE_SHIFT);
+		coff = params->coff + (((row + oy) & FILTER_NOISE_TEXTURE_MASK) << FILTER_NOISE_TEXTURE_SHIFT);
+
+		for( k = 0; k <= d; k++ )
+		{
+			sr = frame_get_border_row( src, row + k - lo );
+			rows[k] = (sr >= 0) ? frame_get_row( src, sr ) : NULL;
+		}
+
+		if( (first <= last) && (row - lo >= 0) && (row + hi < nrows) )
+		{
+			for( col = rect->col; col < first; col++ )
+			{
+				t = (col + ox) & FILTER_NOISE_TEXTURE_MASK;
+				sc = frame_get_border_col( src, col + coff[t] - lo );
+				out[col] = (sc >= 0) ? rows[ roff[t] ][ sc ] : zero;
+			}
+
+			for( col = first; col < last; col++ )
+			{
+				t = (col + ox) & FILTER_NOISE_TEXTURE_MASK;
+				out[col] = rows[ roff[t] ][ col + coff[t] - lo ];
+			}
+
+			for( col = last; col < rect->col + rect->ncols; col++ )
+			{
+				t = (col + ox) & FILTER_NOISE_TEXTURE_MASK;
+				sc = frame_get_border_col( src, col + coff[t] - lo );
+				out[col] = (sc >= 0) ? rows[ roff[t] ][ sc ] : zero;
+			}
+		}
+		else
+		{
+			for( col = rect->col; col < rect->col + rect->ncols; col++ )
+			{
+				t = (col + ox) & FILTER_NOISE_TEXTURE_MASK;
+				sc = frame_get_border_col( src, col + coff[t] - lo );
+				out[col] = ( rows[ roff[t] ] && (sc >= 0) ) ? rows[ roff[t] ][ sc ] : zero;
+			}
+		}
+	}
+}
+
 /* $Id: filter_noise.c 293 2015-07-28 05:24:22Z tiago.ventura $ */
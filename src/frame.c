@@ -8,6 +8,7 @@
 #include <string.h>
 
 #include "common.h"
+#include "pool.h"
 #include "frame.h"
 
 
@@ -20,16 +21,27 @@ struct frame_s
 	int nrows;
 	frame_border_mode_t border;
 	frame_point_t ** buf;
+	frame_point_t * data;
 };
 
 
+static unsigned int frame_allocations = 0;
+
+
+unsigned int frame_get_allocations_count( void )
+{
+	return __atomic_load_n( &frame_allocations, __ATOMIC_RELAXED );
+}
+
+
 frame_t * frame_create( int ncols, int nrows )
 {
 	frame_t * frm = NULL;
 	int i = 0;
 
+	__atomic_add_fetch( &frame_allocations, 1, __ATOMIC_RELAXED );
 
-	frm = (frame_t*) calloc( 1, sizeof(frame_t) );
+	frm = (frame_t*) pool_calloc( 1, sizeof(frame_t) );
 
 	if( !frm )
 		return NULL;
@@ -38,24 +50,18 @@ frame_t * frame_create( int ncols, int nrows )
 	frm->nrows = nrows;
 	frm->border = frame_border_zero_padded;
 
-	frm->buf = (frame_point_t**) calloc( nrows, sizeof(frame_point_t*) );
+	/* All the points in one block, rows are pointers into it */
+	frm->buf = (frame_point_t**) pool_calloc( nrows, sizeof(frame_point_t*) );
+	frm->data = (frame_point_t*) pool_calloc( (size_t) ncols * nrows, sizeof(frame_point_t) );
 
-	if( !frm->buf )
+	if( !frm->buf || !frm->data )
 	{
 		frame_destroy( frm );
 		return NULL;
 	}
 
 	for( i = 0; i < nrows; i++ )
-	{
-		frm->buf[i] = (frame_point_t*) calloc( ncols, sizeof(frame_point_t) );
-
-		if( !frm->buf[i] )
-		{
-			frame_destroy( frm );
-			return NULL;
-		}
-	}
+		frm->buf[i] = frm->data + ((size_t) i * ncols);
 
 	return frm;
 }
@@ -63,31 +69,19 @@ frame_t * frame_create( int ncols, int nrows )
 
 void frame_destroy( frame_t * frm )
 {
-	int i = 0;
-
-	if( frm->buf )
-	{
-		for( i = 0; i < frm->nrows; i++ )
-			if( frm->buf[i] )
-				free( frm->buf[i] );
-
-		free( frm->buf );
-	}
-
-	free( frm );
+	pool_free( frm->data );
+	pool_free( frm->buf );
+	pool_free( frm );
 }
 
 
-void frame_copy( frame_t * dst, frame_t * src )
+void frame_copy( frame_t * dst, const frame_t * src )
 {
-	int i = 0;
-
-	for( i = 0; i < src->nrows; i++ )
-		memcpy( dst->buf[i], src->buf[i], src->ncols * sizeof(frame_point_t) );
+	memcpy( dst->data, src->data, (size_t) src->ncols * src->nrows * sizeof(frame_point_t) );
 }
 
 
-frame_t * frame_duplicate( frame_t * frm )
+frame_t * frame_duplicate( const frame_t * frm )
 {
 	frame_t * new = NULL;
 
@@ -104,10 +98,7 @@ frame_t * frame_duplicate( frame_t * frm )
 
 void frame_clear( frame_t * this )
 {
-	int i = 0;
-
-	for( i = 0; i < this->nrows; i++ )
-		memset( this->buf[i], 0, this->ncols * sizeof(frame_point_t) );
+	memset( this->data, 0, (size_t) this->ncols * this->nrows * sizeof(frame_point_t) );
 }
 
 
@@ -128,25 +119,25 @@ void frame_set_border_mode( frame_t * this, frame_border_mode_t mode )
 }
 
 
-frame_border_mode_t frame_get_border_mode( frame_t * this )
+frame_border_mode_t frame_get_border_mode( const frame_t * this )
 {
 	return this->border;
 }
 
 
-int frame_get_cols_count( frame_t * this )
+int frame_get_cols_count( const frame_t * this )
 {
 	return this->ncols;
 }
 
 
-int frame_get_rows_count( frame_t * this )
+int frame_get_rows_count( const frame_t * this )
 {
 	return this->nrows;
 }
 
 
-void frame_get_dimensions( frame_t * this, int * ncols, int * nrows )
+void frame_get_dimensions( const frame_t * this, int * ncols, int * nrows )
 {
 	*ncols = this->ncols;
 	*nrows = this->nrows;
@@ -181,54 +172,164 @@ void frame_set_point( frame_t * this, int col, int row, frame_point_t * pt )
 }
 
 
-void frame_get_point( frame_t * this, int col, int row, frame_point_t * pt )
+/*!
+	\brief Map an index along a dimension of count points according to the border mode, -1 for zero
+*/
+static inline int frame_get_border_index( frame_border_mode_t border, int index, int count )
 {
-	if( this->border == frame_border_zero_padded )
-	{
-		if( (row < 0) || (col < 0) || (col >= this->ncols) || (row >= this->nrows) )
-		{
-			memset( pt, 0, sizeof(frame_point_t) );
-			return;
-		}
+	if( (index >= 0) && (index < count) )
+		return index;
 
-		memcpy( pt, &(this->buf[row][col]), sizeof(frame_point_t) );
+	if( border == frame_border_toroidal )
+		return ((index % count) + count) % count;
 
-	}
-	else if( this->border == frame_border_extended )
+	if( border == frame_border_extended )
+		return (index < 0) ? 0 : count - 1;
+
+	return -1;
+}
+
+
+int frame_get_border_col( const frame_t * this, int col )
+{
+	return frame_get_border_index( this->border, col, this->ncols );
+}
+
+
+int frame_get_border_row( const frame_t * this, int row )
+{
+	return frame_get_border_index( this->border, row, this->nrows );
+}
+
+
+void frame_get_point( const frame_t * this, int col, int row, frame_point_t * pt )
+{
+	col = frame_get_border_index( this->border, col, this->ncols );
+	row = frame_get_border_index( this->border, row, this->nrows );
+
+	if( (col < 0) || (row < 0) )
 	{
-		if( row < 0 )
-			row = 0;
+		memset( pt, 0, sizeof(frame_point_t) );
+		return;
+	}
 
-		if( row >= this->nrows )
-			row = this->nrows - 1;
+	memcpy( pt, &(this->buf[row][col]), sizeof(frame_point_t) );
+}
 
-		if( col < 0 )
-			col = 0;
 
-		if( col >= this->ncols )
-			col = this->ncols - 1;
+frame_point_t * frame_get_row( const frame_t * this, int row )
+{
+	return this->buf[row];
+}
+
+
+static void frame_pack_clip( const frame_t * this, const frame_rect_t * rect, frame_rect_t * area )
+{
+	int col2 = this->ncols;
+	int row2 = this->nrows;
+
+	area->col = 0;
+	area->row = 0;
+
+	if( rect )
+	{
+		area->col = (rect->col > 0) ? rect->col : 0;
+		area->row = (rect->row > 0) ? rect->row : 0;
 
-		memcpy( pt, &(this->buf[row][col]), sizeof(frame_point_t) );
+		if( rect->col + rect->ncols < col2 )
+			col2 = rect->col + rect->ncols;
+
+		if( rect->row + rect->nrows < row2 )
+			row2 = rect->row + rect->nrows;
 	}
-	else if( this->border == frame_border_toroidal )
+
+	area->ncols = (col2 > area->col) ? col2 - area->col : 0;
+	area->nrows = (row2 > area->row) ? row2 - area->row : 0;
+}
+
+
+static void frame_pack_colors_row( const frame_point_t * restrict src, uint8_t * restrict dst, int n )
+{
+	int col = 0;
+
+	for( col = 0; col < n; col++ )
+		dst[col] = (uint8_t) src[col].color;
+}
+
+
+void frame_pack_colors( const frame_t * this, const frame_rect_t * rect, uint8_t * dst, int pitch )
+{
+	frame_rect_t area;
+	int row = 0;
+
+	frame_pack_clip( this, rect, &area );
+
+	for( row = 0; row < area.nrows; row++, dst += pitch )
+		frame_pack_colors_row( this->buf[ area.row + row ] + area.col, dst, area.ncols );
+}
+
+
+void frame_gather_colors( const frame_t * this, int col, int row, int count, uint8_t * dst )
+{
+	const frame_point_t * src = NULL;
+	int first = (col < 0) ? -col : 0;
+	int last = (col + count > this->ncols) ? this->ncols - col : count;
+	int i = 0;
+	int c = 0;
+
+	row = frame_get_border_index( this->border, row, this->nrows );
+
+	if( row < 0 )
 	{
-		if( row < 0 )
-			row = this->nrows + (row % this->nrows);
+		memset( dst, 0, count );
+		return;
+	}
 
-		if( row >= this->nrows )
-			row = row % this->nrows;
+	src = this->buf[row];
 
-		if( col < 0 )
-			col = this->ncols + (col % this->ncols);
+	/* Points inside of the frame in one run, the border mode only for the ones around */
+	if( first < last )
+		frame_pack_colors_row( src + col + first, dst + first, last - first );
+	else
+		first = last = count;
 
-		if( col >= this->ncols )
-			col = col % this->ncols;
+	for( i = 0; i < first; i++ )
+	{
+		c = frame_get_border_index( this->border, col + i, this->ncols );
+		dst[i] = (c < 0) ? 0 : (uint8_t) src[c].color;
+	}
 
-		memcpy( pt, &(this->buf[row][col]), sizeof(frame_point_t) );
+	for( i = last; i < count; i++ )
+	{
+		c = frame_get_border_index( this->border, col + i, this->ncols );
+		dst[i] = (c < 0) ? 0 : (uint8_t) src[c].color;
 	}
 }
 
 
+static void frame_pack_pixels_row( const frame_point_t * restrict src, uint32_t * restrict dst, int n, const uint32_t * restrict lut )
+{
+	int col = 0;
+
+	for( col = 0; col < n; col++ )
+		dst[col] = lut[ (uint8_t) src[col].color ];
+}
+
+
+void frame_pack_pixels( const frame_t * this, const frame_rect_t * rect, uint32_t * dst, int pitch, const uint32_t * lut )
+{
+	frame_rect_t area;
+	int row = 0;
+
+	frame_pack_clip( this, rect, &area );
+
+	/* The loads of the lookup table hit L1 and the loop is bound by the 16 byte points it reads,
+	   so gathers (AVX2) or pshufb do not make it any faster than this */
+	for( row = 0; row < area.nrows; row++ )
+		frame_pack_pixels_row( this->buf[ area.row + row ] + area.col, (uint32_t*) ((uint8_t*) dst + (size_t) row * pitch), area.ncols, lut );
+}
+
+
 void frame_draw_line( frame_t * this, int col1, int row1, int col2, int row2, frame_point_t * pt )
 {
 	int i = 0;
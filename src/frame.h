@@ -7,6 +7,7 @@
 #ifndef __FRAME_H__
 #define __FRAME_H__
 
+#include <stdint.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -29,6 +30,23 @@ struct frame_point_s
 typedef struct frame_point_s frame_point_t;
 
 
+/*!
+	\brief Represents a rectangular area of a frame
+*/
+struct frame_rect_s
+{
+	int col;
+	int row;
+	int ncols;
+	int nrows;
+};
+
+/*!
+	\brief Define a Frame Rectangle type
+*/
+typedef struct frame_rect_s frame_rect_t;
+
+
 /*!
 	\brief Define a Frame Object type (opaque)
 */
@@ -57,6 +75,12 @@ enum frame_border_mode_e
 */
 frame_t * frame_create( int ncols, int nrows );
 
+/*!
+	\brief Number of frames created since the program started (allocation counting hook)
+	\return Frames count
+*/
+unsigned int frame_get_allocations_count( void );
+
 /*!
 	\brief Frame Object Destructor
 	\param this Frame Object to be destroyed
@@ -68,14 +92,14 @@ void frame_destroy( frame_t * this );
 	\param dst Destination Frame Object
 	\param src Source Frame Object
 */
-void frame_copy( frame_t * dst, frame_t * src );
+void frame_copy( frame_t * dst, const frame_t * src );
 
 /*!
 	\brief Duplicate a Frame Object
 	\param this Frame Object to Duplicate
 	\return Duplicated Frame Object
 */
-frame_t * frame_duplicate( frame_t * this );
+frame_t * frame_duplicate( const frame_t * this );
 
 /*!
 	\brief Clear a Frame Object
@@ -101,21 +125,21 @@ void frame_set_border_mode( frame_t * this, frame_border_mode_t mode );
 	\param this Frame Object
 	\return Current frame array mode
 */
-frame_border_mode_t frame_get_border_mode( frame_t * this );
+frame_border_mode_t frame_get_border_mode( const frame_t * this );
 
 /*!
 	\brief Get frame columns count
 	\param this Frame Object
 	\return  columns count
 */
-int frame_get_cols_count( frame_t * this );
+int frame_get_cols_count( const frame_t * this );
 
 /*!
 	\brief Get frame rows count
 	\param this Frame Object
 	\return rows count
 */
-int frame_get_rows_count( frame_t * this );
+int frame_get_rows_count( const frame_t * this );
 
 /*!
 	\brief Get frame dimensions
@@ -123,7 +147,7 @@ int frame_get_rows_count( frame_t * this );
 	\param ncols
 	\param nrows
 */
-void frame_get_dimensions( frame_t * this, int * ncols, int * nrows );
+void frame_get_dimensions( const frame_t * this, int * ncols, int * nrows );
 
 /*!
 	\brief Set point
@@ -140,7 +164,23 @@ void frame_set_point( frame_t * this, int col, int row, frame_point_t * pt );
 	\param col
 	\param row
 */
-void frame_get_point( frame_t * this, int col, int row, frame_point_t * pt );
+void frame_get_point( const frame_t * this, int col, int row, frame_point_t * pt );
+
+/*!
+	\brief Map a column index, inside of the frame or not, to the column its points are read from (as frame_get_point() does)
+	\param this Frame Object
+	\param col Column index
+	\return Column index inside of the frame, -1 when the points read zero (zero padded border)
+*/
+int frame_get_border_col( const frame_t * this, int col );
+
+/*!
+	\brief Map a row index, inside of the frame or not, to the row its points are read from (as frame_get_point() does)
+	\param this Frame Object
+	\param row Row index
+	\return Row index inside of the frame, -1 when the points read zero (zero padded border)
+*/
+int frame_get_border_row( const frame_t * this, int row );
 
 /*!
 	\brief Draw a Circle
@@ -185,6 +225,43 @@ void frame_draw_rect( frame_t * this, int left, int top, int right, int bottom,
 */
 void frame_draw_ellipse( frame_t * this, int col, int row, int xr, int yr, frame_point_t * pt );
 
+/*!
+	\brief Direct access to the points of a row (the points of a frame are contiguous, row after row)
+	\param this Frame Object
+	\param row Row index (must be valid, no border handling)
+	\return First point of the row
+*/
+frame_point_t * frame_get_row( const frame_t * this, int row );
+
+/*!
+	\brief Pack the color of every point into an 8-bit indexed buffer
+	\param this Frame Object
+	\param rect Area of the frame to pack, clipped to the frame (NULL for the whole frame)
+	\param dst Destination buffer, receives the first point of the area (at least nrows * pitch bytes)
+	\param pitch Distance in bytes between two rows of the destination buffer
+*/
+void frame_pack_colors( const frame_t * this, const frame_rect_t * rect, uint8_t * dst, int pitch );
+
+/*!
+	\brief Pack the colors of a row segment that may reach outside of the frame, the border mode gives the colors there
+	\param this Frame Object
+	\param col First column of the segment
+	\param row Row of the segment
+	\param count Points in the segment
+	\param dst Destination buffer (at least count bytes)
+*/
+void frame_gather_colors( const frame_t * this, int col, int row, int count, uint8_t * dst );
+
+/*!
+	\brief Translate the colors of the points into 32-bit pixels
+	\param this Frame Object
+	\param rect Area of the frame to pack, clipped to the frame (NULL for the whole frame)
+	\param dst Destination buffer, receives the first point of the area
+	\param pitch Distance in bytes between two rows of dst
+	\param lut Pixel of each color (see palette_expand())
+*/
+void frame_pack_pixels( const frame_t * this, const frame_rect_t * rect, uint32_t * dst, int pitch, const uint32_t * lut );
+
 /*!
 	\brief Make Point
 	\returns
@@ -0,0 +1,159 @@
+/*!
+	\file histogram.c
+	\brief Lock-free Latency Histogram Object Implementation
+	\author Tiago Ventura (tiago.ventura@gmail.com)
+*/
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "histogram.h"
+
+
+#define HISTOGRAM_SUB_BUCKET_BITS    (5)
+#define HISTOGRAM_SUB_BUCKET_COUNT   (1 << HISTOGRAM_SUB_BUCKET_BITS)
+#define HISTOGRAM_BUCKET_COUNT       ((64 - HISTOGRAM_SUB_BUCKET_BITS + 1) * HISTOGRAM_SUB_BUCKET_COUNT)
+
+
+/*!
+	\brief Represents a Histogram Object
+*/
+struct histogram_s
+{
+	uint64_t count;
+	uint64_t sum;
+	uint64_t max;
+	uint64_t bucket[ HISTOGRAM_BUCKET_COUNT ];
+};
+
+
+histogram_t * histogram_create( void )
+{
+	return (histogram_t*) calloc( 1, sizeof(histogram_t) );
+}
+
+
+void histogram_destroy( histogram_t * this )
+{
+	free( this );
+}
+
+
+void histogram_reset( histogram_t * this )
+{
+	memset( this, 0, sizeof(histogram_t) );
+}
+
+
+static inline int histogram_get_bucket_index( uint64_t value )
+{
+	int shift = 0;
+
+	if( value < 2 * HISTOGRAM_SUB_BUCKET_COUNT )
+		return (int) value;
+
+	/* Keep the HISTOGRAM_SUB_BUCKET_BITS + 1 most significant bits */
+	shift = (63 - __builtin_clzll( value )) - HISTOGRAM_SUB_BUCKET_BITS;
+
+	return ( (shift + 1) * HISTOGRAM_SUB_BUCKET_COUNT ) + (int) ( (value >> shift) - HISTOGRAM_SUB_BUCKET_COUNT );
+}
+
+
+static inline uint64_t histogram_get_bucket_value( int idx )
+{
+	int shift = 0;
+	uint64_t top = 0;
+
+	if( idx < 2 * HISTOGRAM_SUB_BUCKET_COUNT )
+		return (uint64_t) idx;
+
+	shift = (idx / HISTOGRAM_SUB_BUCKET_COUNT) - 1;
+	top = (idx % HISTOGRAM_SUB_BUCKET_COUNT) + HISTOGRAM_SUB_BUCKET_COUNT;
+
+	/* Highest value that falls into the bucket */
+	return ( (top + 1) << shift ) - 1;
+}
+
+
+void histogram_record( histogram_t * this, uint64_t value )
+{
+	uint64_t max = __atomic_load_n( &this->max, __ATOMIC_RELAXED );
+
+	__atomic_fetch_add( &this->bucket[ histogram_get_bucket_index( value ) ], 1, __ATOMIC_RELAXED );
+	__atomic_fetch_add( &this->sum, value, __ATOMIC_RELAXED );
+	__atomic_fetch_add( &this->count, 1, __ATOMIC_RELAXED );
+
+	while( value > max )
+	{
+		if( __atomic_compare_exchange_n( &this->max, &max, value, 0, __ATOMIC_RELAXED, __ATOMIC_RELAXED ) )
+			break;
+	}
+}
+
+
+uint64_t histogram_get_count( histogram_t * this )
+{
+	return __atomic_load_n( &this->count, __ATOMIC_RELAXED );
+}
+
+
+uint64_t histogram_get_sum( histogram_t * this )
+{
+	return __atomic_load_n( &this->sum, __ATOMIC_RELAXED );
+}
+
+
+uint64_t histogram_get_max( histogram_t * this )
+{
+	return __atomic_load_n( &this->max, __ATOMIC_RELAXED );
+}
+
+
+double histogram_get_mean( histogram_t * this )
+{
+	uint64_t count = histogram_get_count( this );
+
+	if( !count )
+		return 0.0;
+
+	return histogram_get_sum( this ) / (double) count;
+}
+
+
+uint64_t histogram_get_percentile( histogram_t * this, double percentile )
+{
+	uint64_t total = 0;
+	uint64_t target = 0;
+	uint64_t seen = 0;
+	uint64_t value = 0;
+	int i = 0;
+
+	for( i = 0; i < HISTOGRAM_BUCKET_COUNT; i++ )
+		total += __atomic_load_n( &this->bucket[i], __ATOMIC_RELAXED );
+
+	if( !total )
+		return 0;
+
+	target = (uint64_t) ( (percentile / 100.0) * total + 0.5 );
+
+	if( target < 1 )
+		target = 1;
+
+	if( target > total )
+		target = total;
+
+	for( i = 0; i < HISTOGRAM_BUCKET_COUNT; i++ )
+	{
+		seen += __atomic_load_n( &this->bucket[i], __ATOMIC_RELAXED );
+
+		if( seen >= target )
+			break;
+	}
+
+	value = histogram_get_bucket_value( i );
+
+	/* The bucket upper bound can't be larger than what has actually been seen */
+	return ( value > histogram_get_max( this ) ) ? histogram_get_max( this ) : value;
+}
+
+/* $Id$ */
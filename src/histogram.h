@@ -0,0 +1,103 @@
+/*!
+	\file histogram.h
+	\brief Lock-free Latency Histogram Object Interface
+	\author Tiago Ventura (tiago.ventura@gmail.com)
+*/
+
+#ifndef __HISTOGRAM_H__
+#define __HISTOGRAM_H__
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/*!
+	\brief Histogram Object Type Definition (opaque)
+
+	Values are counted in log-linear buckets (HDR style): exact below 64
+	and with a relative error under 3.2% above. Recording is lock-free and
+	may happen concurrently with any query.
+*/
+typedef struct histogram_s histogram_t;
+
+
+/*!
+	\brief Histogram Object Constructor
+	\return Histogram Object
+*/
+histogram_t * histogram_create( void );
+
+
+/*!
+	\brief Histogram Object Destructor
+	\param this Histogram Object
+*/
+void histogram_destroy( histogram_t * this );
+
+
+/*!
+	\brief Discard all the recorded values
+	\param this Histogram Object
+*/
+void histogram_reset( histogram_t * this );
+
+
+/*!
+	\brief Record a value
+	\param this Histogram Object
+	\param value
+*/
+void histogram_record( histogram_t * this, uint64_t value );
+
+
+/*!
+	\brief Get the number of recorded values
+	\param this Histogram Object
+	\return
+*/
+uint64_t histogram_get_count( histogram_t * this );
+
+
+/*!
+	\brief Get the sum of the recorded values
+	\param this Histogram Object
+	\return
+*/
+uint64_t histogram_get_sum( histogram_t * this );
+
+
+/*!
+	\brief Get the highest recorded value
+	\param this Histogram Object
+	\return
+*/
+uint64_t histogram_get_max( histogram_t * this );
+
+
+/*!
+	\brief Get the mean of the recorded values
+	\param this Histogram Object
+	\return
+*/
+double histogram_get_mean( histogram_t * this );
+
+
+/*!
+	\brief Get the value below which a percentage of the recorded values fall
+	\param this Histogram Object
+	\param percentile Percentile (e.g. 99.9)
+	\return Highest value equivalent to the percentile bucket
+*/
+uint64_t histogram_get_percentile( histogram_t * this, double percentile );
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __HISTOGRAM_H__ */
+
+/* $Id$ */
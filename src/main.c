@@ -23,13 +23,61 @@
 #include "felix.h"
 
 
+#define MAIN_FILTERS_MAX    (16)
+
+
+/*!
+	\brief Filter names accepted by -f
+*/
+struct main_filter_s
+{
+	const char * name;
+	filter_implementation_t * (*get_implementation)( void );
+	int kernel;          /*!< Convolution kernel, -1 for the other filters */
+	int palette_domain;  /*!< Blur the colors instead of the indexes */
+	void (*set_parameter)( filter_t * f, int value );  /*!< Setter of the value given after a colon, NULL if none */
+};
+
+typedef struct main_filter_s main_filter_t;
+
+
 /* ************************************************************************** */
 /* *                              GLOBALS                                   * */
 /* ************************************************************************** */
 
-filter_implementation_t * g_filter_impl = NULL;
+const main_filter_t g_filters[] = {
+	{ "blur",      filter_blur_get_implementation,     -1, 0, filter_blur_set_radius },
+	{ "rgbblur",   filter_blur_get_implementation,     -1, 1, filter_blur_set_radius },
+	{ "noise",     filter_noise_get_implementation,    -1, 0, filter_noise_set_dispersion },
+	{ "box",       filter_convolve_get_implementation, filter_convolve_box3, 0, NULL },
+	{ "box5",      filter_convolve_get_implementation, filter_convolve_box5, 0, NULL },
+	{ "gaussian",  filter_convolve_get_implementation, filter_convolve_gaussian3, 0, NULL },
+	{ "gaussian5", filter_convolve_get_implementation, filter_convolve_gaussian5, 0, NULL },
+	{ "sharpen",   filter_convolve_get_implementation, filter_convolve_sharpen, 0, NULL },
+	{ "edge",      filter_convolve_get_implementation, filter_convolve_edge, 0, NULL },
+	{ "emboss",    filter_convolve_get_implementation, filter_convolve_emboss, 0, NULL },
+	{ NULL, NULL, -1, 0, NULL }
+};
+
+const main_filter_t * g_filter[ MAIN_FILTERS_MAX ];
+int g_filter_value[ MAIN_FILTERS_MAX ];   /* value given after the name, -1 for the default */
+int g_filters_count = 0;
 player_implementation_t * g_player_impl = NULL;
 animation_implementation_t * g_animation_impl = NULL;
+int g_screen_ncols = 0;
+int g_screen_nrows = 0;
+int g_frames_limit = 0;
+int g_unthrottled = 0;
+int g_pipelined = 0;
+int g_threads = 0;
+int g_color_depth = 0;
+int g_scale = 1;
+int g_vsync = 0;
+player_terminal_mode_t g_terminal_mode = player_terminal_mode_text;
+double g_fps = 0.0;
+double g_simulation_rate = 0.0;
+player_catchup_t g_catchup_policy = player_catchup_drop;
+const char * g_stats_file = NULL;
 
 
 /* ************************************************************************** */
@@ -58,6 +106,16 @@ static void main_signal_handler( int sig )
 			break;
 		}
 
+		case SIGUSR1  :
+		{
+			p = player_get_instance();
+
+			if( p )
+				player_request_stats_dump( p );
+
+			break;
+		}
+
 		case SIGABRT  :
 		case SIGINT   :
 		case SIGQUIT  :
@@ -83,9 +141,24 @@ static int show_syntax( char ** argv )
 {
 	printf( "usage:\n" );
 	printf( "	%s\n", argv[0] );
-	printf("		-a	life, tvstatic, fire, fern, spirograph, lissajous, starfield, matrix, swarm\n");
-	printf("		-p	sdl, allegro, modex, text\n");
-	printf("		-f	blur, noise\n");
+	printf("		-a	life, tvstatic, fire, fern, spirograph, lissajous, starfield, matrix, swarm, plasma\n");
+	printf("		-p	sdl, allegro, modex, text, headless, terminal, halfblock, braille\n");
+	printf("		-f	blur, rgbblur, noise, box, box5, gaussian, gaussian5, sharpen, edge, emboss (comma separated list, e.g. blur,noise,blur)\n");
+	printf("			blur and rgbblur take a radius, noise a dispersion, after a colon (e.g. blur:4,noise:8)\n");
+	printf("		-r	screen resolution (e.g. 640x480)\n");
+	printf("		-n	number of frames to play\n");
+	printf("		-u	unthrottled (do not synchronize the frame rate)\n");
+	printf("		-d	display rate in frames per second (defaults to the animation rate)\n");
+	printf("		-t	simulation rate in animation steps per second (e.g. 10000)\n");
+	printf("		-k	late frames catch-up policy: drop, skip, stretch\n");
+	printf("		-m	multithreaded pipeline (animation, filter and presentation threads)\n");
+	printf("		-j	number of threads filtering each frame (defaults to one per processor)\n");
+	printf("		-b	bits per pixel: 8 (indexed, default) or 32 (true color, sdl and headless)\n");
+#ifdef FELIX_SDL2
+	printf("		-x	integer scale factor of the window (sdl)\n");
+	printf("		-v	wait for the vertical retrace (sdl)\n");
+#endif
+	printf("		-s	export frame statistics to a file (.csv or .json)\n");
 	printf("\n");
 
 	return 0;
@@ -108,10 +181,11 @@ static int main_initialize( int argc, char * argv[] )
 	signal( SIGINT, main_signal_handler );
 	signal( SIGQUIT, main_signal_handler );
 	signal( SIGTERM, main_signal_handler );
+	signal( SIGUSR1, main_signal_handler );
 
 	opterr = 0;
 
-	while( ( parm = getopt ( argc, argv, "p:a:f:ch" ) ) != -1 )
+	while( ( parm = getopt ( argc, argv, "p:a:f:r:n:s:k:d:t:j:b:x:vumch" ) ) != -1 )
 	{
 		switch( parm )
 		{
@@ -123,7 +197,11 @@ static int main_initialize( int argc, char * argv[] )
 				}
 				else if( !strcmp("sdl",optarg) )
 				{
+#ifdef FELIX_SDL2
+					g_player_impl = player_graphmode_sdl2_get_implementation();
+#else
 					g_player_impl = player_graphmode_sdl_get_implementation();
+#endif
 				}
 				else if( !strcmp("text",optarg) )
 				{
@@ -133,6 +211,25 @@ static int main_initialize( int argc, char * argv[] )
 				{
 					//g_player_impl = player_graphmode_modex_allegro_get_implementation();
 				}
+				else if( !strcmp("headless",optarg) )
+				{
+					g_player_impl = player_headless_get_implementation();
+				}
+				else if( !strcmp("terminal",optarg) )
+				{
+					g_player_impl = player_terminal_get_implementation();
+					g_terminal_mode = player_terminal_mode_text;
+				}
+				else if( !strcmp("halfblock",optarg) )
+				{
+					g_player_impl = player_terminal_get_implementation();
+					g_terminal_mode = player_terminal_mode_halfblock;
+				}
+				else if( !strcmp("braille",optarg) )
+				{
+					g_player_impl = player_terminal_get_implementation();
+					g_terminal_mode = player_terminal_mode_braille;
+				}
 				else
 				{
 					syntax_error = 1;
@@ -177,7 +274,11 @@ static int main_initialize( int argc, char * argv[] )
 				}
 				else if( !strcmp("swarm",optarg) )
 				{
-					//g_animation_impl = animation_swarm_get_implementation();
+					g_animation_impl = animation_swarm_get_implementation();
+				}
+				else if( !strcmp("plasma",optarg) )
+				{
+					g_animation_impl = animation_plasma_get_implementation();
 				}
 				else
 				{
@@ -187,15 +288,100 @@ static int main_initialize( int argc, char * argv[] )
 				break;
 			}
 
-			case 'f': /* Filter */
+			case 'f': /* Filters */
 			{
-				if( !strcmp("blur",optarg) )
+				char * name = NULL;
+				char * value = NULL;
+				int i = 0;
+
+				g_filters_count = 0;
+
+				for( name = strtok( optarg, "," ); name; name = strtok( NULL, "," ) )
 				{
-					g_filter_impl = filter_blur_get_implementation();
+					value = strchr( name, ':' );
+
+					if( value )
+						*value++ = '\0';
+
+					for( i = 0; g_filters[i].name && strcmp( g_filters[i].name, name ); i++ );
+
+					if( (g_filters_count >= MAIN_FILTERS_MAX) || !g_filters[i].name )
+					{
+						syntax_error = 1;
+					}
+					else if( value && ( !g_filters[i].set_parameter || (sscanf( value, "%d", &g_filter_value[ g_filters_count ] ) != 1) || (g_filter_value[ g_filters_count ] < 0) ) )
+					{
+						syntax_error = 1;
+					}
+					else
+					{
+						if( !value )
+							g_filter_value[ g_filters_count ] = -1;
+
+						g_filter[ g_filters_count++ ] = &g_filters[i];
+					}
 				}
-				else if( !strcmp("noise",optarg) )
+
+				break;
+			}
+
+			case 'r': /* Screen Resolution */
+			{
+				if( (sscanf( optarg, "%dx%d", &g_screen_ncols, &g_screen_nrows ) != 2) || (g_screen_ncols <= 0) || (g_screen_nrows <= 0) )
+					syntax_error = 1;
+
+				break;
+			}
+
+			case 'n': /* Frames Limit */
+			{
+				g_frames_limit = atoi( optarg );
+
+				if( g_frames_limit <= 0 )
+					syntax_error = 1;
+
+				break;
+			}
+
+			case 's': /* Statistics File */
+			{
+				g_stats_file = optarg;
+				break;
+			}
+
+			case 'd': /* Display Rate */
+			{
+				g_fps = atof( optarg );
+
+				if( g_fps <= 0.0 )
+					syntax_error = 1;
+
+				break;
+			}
+
+			case 't': /* Simulation Rate */
+			{
+				g_simulation_rate = atof( optarg );
+
+				if( g_simulation_rate <= 0.0 )
+					syntax_error = 1;
+
+				break;
+			}
+
+			case 'k': /* Catch-Up Policy */
+			{
+				if( !strcmp("drop",optarg) )
+				{
+					g_catchup_policy = player_catchup_drop;
+				}
+				else if( !strcmp("skip",optarg) )
+				{
+					g_catchup_policy = player_catchup_skip;
+				}
+				else if( !strcmp("stretch",optarg) )
 				{
-					g_filter_impl = filter_noise_get_implementation();
+					g_catchup_policy = player_catchup_stretch;
 				}
 				else
 				{
@@ -205,6 +391,54 @@ static int main_initialize( int argc, char * argv[] )
 				break;
 			}
 
+			case 'u': /* Unthrottled */
+			{
+				g_unthrottled = 1;
+				break;
+			}
+
+			case 'm': /* Pipelined */
+			{
+				g_pipelined = 1;
+				break;
+			}
+
+			case 'j': /* Filter Threads */
+			{
+				g_threads = atoi(optarg);
+
+				if( g_threads < 1 )
+					syntax_error = 1;
+
+				break;
+			}
+
+			case 'b': /* Color Depth */
+			{
+				g_color_depth = atoi(optarg);
+
+				if( (g_color_depth != 8) && (g_color_depth != 32) )
+					syntax_error = 1;
+
+				break;
+			}
+
+			case 'x': /* Window Scale */
+			{
+				g_scale = atoi(optarg);
+
+				if( g_scale < 1 )
+					syntax_error = 1;
+
+				break;
+			}
+
+			case 'v': /* Vertical Sync */
+			{
+				g_vsync = 1;
+				break;
+			}
+
 			case 'c': /* Console */
 			{
 				console_create( 10 );
@@ -236,6 +470,52 @@ static int main_initialize( int argc, char * argv[] )
 }
 
 
+static filter_t * main_create_named_filter( const main_filter_t * desc, int value )
+{
+	filter_t * f = filter_create( desc->get_implementation() );
+
+	if( f && desc->set_parameter && (value >= 0) )
+		desc->set_parameter( f, value );
+
+	if( f && (desc->kernel >= 0) )
+		filter_convolve_set_predefined_kernel( f, (filter_convolve_kernel_t) desc->kernel );
+
+	if( f && desc->palette_domain )
+		filter_blur_set_palette_domain( f, 1 );
+
+	return f;
+}
+
+
+static filter_t * main_create_filter( void )
+{
+	filter_t * chain = NULL;
+	filter_t * f = NULL;
+	int i = 0;
+
+	if( !g_filters_count )
+		return NULL;
+
+	if( g_filters_count == 1 )
+		return main_create_named_filter( g_filter[0], g_filter_value[0] );
+
+	chain = filter_create( filter_chain_get_implementation() );
+
+	if( !chain )
+		return NULL;
+
+	for( i = 0; i < g_filters_count; i++ )
+	{
+		f = main_create_named_filter( g_filter[i], g_filter_value[i] );
+
+		if( f && filter_chain_append( chain, f ) )
+			filter_destroy( f );
+	}
+
+	return chain;
+}
+
+
 /* ************************************************************************** */
 /* *                              main()                                    * */
 /* ************************************************************************** */
@@ -243,6 +523,7 @@ static int main_initialize( int argc, char * argv[] )
 int main( int argc , char * argv[] )
 {
 	filter_t * f = NULL;
+	workers_t * w = NULL;
 	animation_t * a = NULL;
 	player_t * p = NULL;
 	console_t * c = NULL;
@@ -250,13 +531,46 @@ int main( int argc , char * argv[] )
 	main_initialize( argc, argv );
 
 	p = player_create( g_player_impl );
-	f = filter_create( g_filter_impl );
+	f = main_create_filter();
+
+	if( f )
+		w = workers_create( g_threads );
 	a = animation_create( g_animation_impl );
 	c = console_get_instance();
 
 	player_set_animation( p, a );
 	player_set_filter( p, f );
+
+	if( w )
+		filter_set_workers( f, w );
+
 	player_set_console( p, c );
+	player_set_frames_limit( p, g_frames_limit );
+	player_set_unthrottled( p, g_unthrottled );
+	player_set_catchup_policy( p, g_catchup_policy );
+	player_set_simulation_rate( p, g_simulation_rate );
+	player_set_pipelined( p, g_pipelined );
+
+	if( g_color_depth )
+		player_set_color_depth( p, g_color_depth );
+
+	if( g_player_impl == player_terminal_get_implementation() )
+		player_terminal_set_mode( p, g_terminal_mode );
+
+#ifdef FELIX_SDL2
+	if( g_player_impl == player_graphmode_sdl2_get_implementation() )
+	{
+		player_graphmode_sdl2_set_scale( p, g_scale );
+		player_graphmode_sdl2_set_vsync( p, g_vsync );
+	}
+#endif
+
+	if( g_fps > 0.0 )
+		player_set_fps( p, g_fps );
+	player_set_stats_file( p, g_stats_file );
+
+	if( g_screen_ncols && g_screen_nrows )
+		player_set_screen_dimensions( p, g_screen_ncols, g_screen_nrows );
 
 	animation_set_console( a, c );
 
@@ -264,9 +578,17 @@ int main( int argc , char * argv[] )
 	player_play( p );
 	player_screen_finish( p );
 
-	console_destroy( c );
+	if( c )
+		console_destroy( c );
+
 	animation_destroy( a );
-	filter_destroy( f );
+
+	if( f )
+		filter_destroy( f );
+
+	if( w )
+		workers_destroy( w );
+
 	player_destroy( p );
 
 	return EXIT_SUCCESS;
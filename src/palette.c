@@ -6,10 +6,17 @@
 
 #include <stdlib.h>
 #include <string.h>
+#include <pthread.h>
 
+#include "pool.h"
 #include "palette.h"
 
-#define PALETTE_MAX_COLORS    (256)
+#define PALETTE_MAX_COLORS          (256)
+#define PALETTE_INVERSE_BITS        (5)
+#define PALETTE_INVERSE_SIZE        (1 << (3 * PALETTE_INVERSE_BITS))
+#define PALETTE_TABLES_CACHE_SIZE   (4)
+#define PALETTE_EXACT_BITS          (10)    /* Hash of the exact colors, 4 slots per color */
+#define PALETTE_EXACT_SIZE          (1 << PALETTE_EXACT_BITS)
 
 /*!
 	\brief Color Object Type Definition
@@ -35,28 +42,102 @@ struct palette_s
 {
 	int count;
 	color_t * color;
+	palette_revision_t revision;
+	uint32_t * changed;   /*!< Version of the last change of each color */
 };
 
 
+/*!
+	\brief Represents the Color Map of a set of colors, whatever order a palette has them in
+
+	The indexes it gives are positions in the sorted colors, the tables of
+	each palette translate them into its own indexes.
+*/
+struct palette_map_s
+{
+	uint32_t hash;
+	int count;
+	uint32_t rgb[ PALETTE_MAX_COLORS ];                         /*!< Sorted colors, 0xRRGGBB */
+	int refs;                                                   /*!< Tables built on the map */
+	int cached;                                                 /*!< Kept in the cache when no tables use it */
+	unsigned int used;                                          /*!< Last use, for the eviction */
+	uint32_t exact_key[ PALETTE_EXACT_SIZE ];                   /*!< RGB + 1 of the colors, 0 for an empty slot */
+	uint8_t exact_index[ PALETTE_EXACT_SIZE ];
+	uint8_t exact_cells[ PALETTE_INVERSE_SIZE / 8 ];            /*!< Cells of the inverse map holding a color */
+	uint16_t inverse[ PALETTE_INVERSE_SIZE ];                   /*!< 1 + nearest color of each cell, 0 until a lookup needs it */
+};
+
+typedef struct palette_map_s palette_map_t;
+
+
+/*!
+	\brief Represents the Lookup Tables of the colors of a palette
+*/
+struct palette_tables_s
+{
+	uint32_t hash;
+	int count;
+	color_t color[ PALETTE_MAX_COLORS ];
+	int refs;                                                   /*!< Users holding the tables */
+	int cached;                                                 /*!< Kept in the cache when nobody holds them */
+	unsigned int used;                                          /*!< Last use, for the eviction */
+	palette_map_t * map;
+	uint8_t index[ PALETTE_MAX_COLORS ];                        /*!< Palette index of each color of the map */
+};
+
+
+static pthread_mutex_t palette_tables_mutex = PTHREAD_MUTEX_INITIALIZER;
+static palette_tables_t * palette_tables_cache[ PALETTE_TABLES_CACHE_SIZE ];
+static palette_map_t * palette_maps_cache[ PALETTE_TABLES_CACHE_SIZE ];
+static unsigned int palette_tables_clock = 0;
+
+/* Versions and lineages are process wide so that no two palettes share one */
+static uint32_t palette_versions = 0;
+static uint32_t palette_lineages = 0;
+
+
+static inline uint32_t palette_next_version( void )
+{
+	return __atomic_add_fetch( &palette_versions, 1, __ATOMIC_RELAXED );
+}
+
+
+static void palette_touch( palette_t * this, int first, int count )
+{
+	uint32_t version = palette_next_version();
+	int i = 0;
+
+	for( i = first; i < first + count; i++ )
+		this->changed[i] = version;
+
+	this->revision.version = version;
+}
+
+
 palette_t * palette_create( void )
 {
 	palette_t * pal = NULL;
 
-	pal = (palette_t*) malloc( sizeof(palette_t) );
+	pal = (palette_t*) pool_alloc( sizeof(palette_t) );
 
 	if( !pal )
 		return NULL;
 
 	pal->count = PALETTE_MAX_COLORS;
 
-	pal->color = (color_t*) calloc( PALETTE_MAX_COLORS, sizeof(color_t) );
+	pal->color = (color_t*) pool_calloc( PALETTE_MAX_COLORS, sizeof(color_t) );
+	pal->changed = (uint32_t*) pool_calloc( PALETTE_MAX_COLORS, sizeof(uint32_t) );
 
-	if( !pal->color )
+	if( !pal->color || !pal->changed )
 	{
-		free( pal );
+		pool_free( pal->color );
+		pool_free( pal->changed );
+		pool_free( pal );
 		return NULL;
 	}
 
+	pal->revision.id = __atomic_add_fetch( &palette_lineages, 1, __ATOMIC_RELAXED );
+
 	palette_set_default( pal );
 
 	return pal;
@@ -65,17 +146,22 @@ palette_t * palette_create( void )
 
 void palette_destroy( palette_t * this )
 {
-	if( this->color )
-		free( this->color );
-
-	free( this );
+	pool_free( this->changed );
+	pool_free( this->color );
+	pool_free( this );
 }
 
 
 void palette_copy( palette_t * dst, palette_t * src )
 {
+	/* Nothing to do when dst already is that revision of src, e.g. a pipeline slot between palette changes */
+	if( (dst->revision.id == src->revision.id) && (dst->revision.version == src->revision.version) )
+		return;
+
 	dst->count = src->count;
+	dst->revision = src->revision;
 	memcpy( dst->color, src->color, sizeof(color_t) * src->count );
+	memcpy( dst->changed, src->changed, sizeof(uint32_t) * src->count );
 }
 
 
@@ -88,7 +174,7 @@ palette_t * palette_duplicate( palette_t * pal )
 	if(!new)
 		return NULL;
 
-	memcpy( new->color, pal->color, sizeof(color_t) * pal->count );
+	palette_copy( new, pal );
 
 	return new;
 }
@@ -97,11 +183,19 @@ palette_t * palette_duplicate( palette_t * pal )
 void palette_clear( palette_t * this )
 {
 	memset( this->color, 0, sizeof(color_t) * this->count );
+
+	palette_touch( this, 0, this->count );
 }
 
 
 void palette_set_color( palette_t * this, int idx, uint8_t red, uint8_t green, uint8_t blue )
 {
+	/* Setting a color to what it already is is not a change */
+	if( (this->color[idx].red == red) && (this->color[idx].green == green) && (this->color[idx].blue == blue) && this->changed[idx] )
+		return;
+
+	palette_touch( this, idx, 1 );
+
 	this->color[idx].red = red;
 	this->color[idx].green = green;
 	this->color[idx].blue = blue;
@@ -116,6 +210,44 @@ void palette_get_color( palette_t * this, int idx, uint8_t * red, uint8_t * gree
 }
 
 
+void palette_set_gradient( palette_t * this, int first, int last, uint8_t red1, uint8_t green1, uint8_t blue1, uint8_t red2, uint8_t green2, uint8_t blue2 )
+{
+	int span = last - first;
+	int i = 0;
+
+	if( !span )
+	{
+		palette_set_color( this, first, red1, green1, blue1 );
+		return;
+	}
+
+	for( i = 0; i <= span; i++ )
+	{
+		palette_set_color( this, first + i,
+						   red1 + ((int) red2 - red1) * i / span,
+						   green1 + ((int) green2 - green1) * i / span,
+						   blue1 + ((int) blue2 - blue1) * i / span );
+	}
+}
+
+
+void palette_expand( palette_t * this, uint32_t * lut, int first, int count, int rshift, int gshift, int bshift, uint32_t alpha )
+{
+	const color_t * c = NULL;
+	int i = 0;
+
+	if( first + count > this->count )
+		count = this->count - first;
+
+	for( i = first; i < first + count; i++ )
+	{
+		c = &this->color[i];
+
+		lut[i] = alpha | ((uint32_t) c->red << rshift) | ((uint32_t) c->green << gshift) | ((uint32_t) c->blue << bshift);
+	}
+}
+
+
 int palette_get_color_count( palette_t * pal  )
 {
 	return pal->count;
@@ -171,4 +303,406 @@ void palette_set_default( palette_t * this )
 	}
 }
 
+void palette_get_revision( palette_t * this, palette_revision_t * rev )
+{
+	*rev = this->revision;
+}
+
+
+int palette_get_changes( palette_t * this, const palette_revision_t * since, int * first, int * count )
+{
+	int last = -1;
+	int i = 0;
+
+	*first = 0;
+	*count = this->count;
+
+	if( since->id != this->revision.id )
+		return 1;
+
+	if( since->version == this->revision.version )
+		return 0;
+
+	*first = this->count;
+
+	for( i = 0; i < this->count; i++ )
+	{
+		if( this->changed[i] > since->version )
+		{
+			if( i < *first )
+				*first = i;
+
+			last = i;
+		}
+	}
+
+	*count = last - *first + 1;
+
+	return (last >= 0);
+}
+
+
+uint32_t palette_get_hash( palette_t * this )
+{
+	const uint8_t * p = (const uint8_t*) this->color;
+	uint32_t hash = 2166136261u;
+	size_t i = 0;
+
+	for( i = 0; i < sizeof(color_t) * this->count; i++ )
+	{
+		hash ^= p[i];
+		hash *= 16777619u;
+	}
+
+	return hash;
+}
+
+
+static inline uint32_t palette_exact_slot( uint32_t key )
+{
+	return (key * 2654435761u) >> (32 - PALETTE_EXACT_BITS);
+}
+
+
+static inline uint32_t palette_inverse_cell( uint32_t rgb )
+{
+	const int shift = 8 - PALETTE_INVERSE_BITS;
+
+	return ((((rgb >> 16) & 0xFF) >> shift) << (2 * PALETTE_INVERSE_BITS)) | ((((rgb >> 8) & 0xFF) >> shift) << PALETTE_INVERSE_BITS) | ((rgb & 0xFF) >> shift);
+}
+
+
+static int palette_compare_keys( const void * a, const void * b )
+{
+	uint64_t ka = *(const uint64_t*) a;
+	uint64_t kb = *(const uint64_t*) b;
+
+	return (ka > kb) - (ka < kb);
+}
+
+
+/*!
+	\brief Hash of the exact colors, so that a color of the map always maps back to itself
+	(the 15-bit inverse map may send it to a neighbour). Duplicates keep the lowest index.
+*/
+static void palette_build_exact_map( palette_map_t * map )
+{
+	uint32_t key = 0;
+	uint32_t slot = 0;
+	int i = 0;
+
+	for( i = 0; i < map->count; i++ )
+	{
+		key = map->rgb[i] + 1;
+		slot = palette_inverse_cell( map->rgb[i] );
+
+		map->exact_cells[ slot >> 3 ] |= (uint8_t) (1 << (slot & 7));
+
+		for( slot = palette_exact_slot( key ); map->exact_key[ slot ] && (map->exact_key[ slot ] != key); slot = (slot + 1) & (PALETTE_EXACT_SIZE - 1) );
+
+		if( !map->exact_key[ slot ] )
+		{
+			map->exact_key[ slot ] = key;
+			map->exact_index[ slot ] = (uint8_t) i;
+		}
+	}
+}
+
+
+/*!
+	\brief Nearest color of a cell of the inverse map, from its center. Ties go to the lowest index.
+
+	The cells are only filled when a lookup lands in them: a blur touches a
+	few thousand of the 32768, and a palette that fades builds a new map on
+	every frame. Threads holding the tables may fill the same cell at the
+	same time, they store the same value.
+*/
+static int palette_map_fill_cell( palette_map_t * map, uint32_t cell )
+{
+	const int shift = 8 - PALETTE_INVERSE_BITS;
+	const int mask = (1 << PALETTE_INVERSE_BITS) - 1;
+	const int half = 1 << (shift - 1);
+	int32_t red = ( ((cell >> (2 * PALETTE_INVERSE_BITS)) & mask) << shift ) + half;
+	int32_t green = ( ((cell >> PALETTE_INVERSE_BITS) & mask) << shift ) + half;
+	int32_t blue = ( (cell & mask) << shift ) + half;
+	int32_t dr = 0;
+	int32_t dg = 0;
+	int32_t db = 0;
+	uint32_t best = UINT32_MAX;
+	uint32_t d = 0;
+	int nearest = 0;
+	int i = 0;
+
+	for( i = 0; i < map->count; i++ )
+	{
+		dr = red - (int32_t) ((map->rgb[i] >> 16) & 0xFF);
+		dg = green - (int32_t) ((map->rgb[i] >> 8) & 0xFF);
+		db = blue - (int32_t) (map->rgb[i] & 0xFF);
+
+		d = (uint32_t) (dr * dr + dg * dg + db * db);
+
+		if( d < best )
+		{
+			best = d;
+			nearest = i;
+		}
+	}
+
+	__atomic_store_n( &map->inverse[ cell ], (uint16_t) (nearest + 1), __ATOMIC_RELAXED );
+
+	return nearest;
+}
+
+
+/*!
+	\brief Find or build the map of a set of sorted colors (called with the tables mutex held)
+*/
+static palette_map_t * palette_acquire_map( const uint32_t * rgb, int count )
+{
+	palette_map_t * map = NULL;
+	uint32_t hash = 2166136261u;
+	int slot = -1;
+	int i = 0;
+
+	for( i = 0; i < count; i++ )
+	{
+		hash ^= rgb[i];
+		hash *= 16777619u;
+	}
+
+	for( i = 0; i < PALETTE_TABLES_CACHE_SIZE; i++ )
+	{
+		map = palette_maps_cache[i];
+
+		if( map && (map->hash == hash) && (map->count == count) && !memcmp( map->rgb, rgb, count * sizeof(uint32_t) ) )
+		{
+			map->refs++;
+			map->used = ++palette_tables_clock;
+
+			return map;
+		}
+	}
+
+	/* An empty entry, or the least recently used one that no tables use, whose memory is taken over */
+	for( i = 0; i < PALETTE_TABLES_CACHE_SIZE; i++ )
+	{
+		map = palette_maps_cache[i];
+
+		if( !map )
+		{
+			slot = i;
+			break;
+		}
+
+		if( !map->refs && ( (slot < 0) || (map->used < palette_maps_cache[ slot ]->used) ) )
+			slot = i;
+	}
+
+	map = (slot >= 0) ? palette_maps_cache[ slot ] : NULL;
+
+	if( map )
+		memset( map, 0, sizeof(palette_map_t) );
+	else
+		map = (palette_map_t*) pool_calloc( 1, sizeof(palette_map_t) );
+
+	if( !map )
+		return NULL;
+
+	map->hash = hash;
+	map->count = count;
+	memcpy( map->rgb, rgb, count * sizeof(uint32_t) );
+
+	palette_build_exact_map( map );
+
+	if( slot >= 0 )
+	{
+		palette_maps_cache[ slot ] = map;
+		map->cached = 1;
+	}
+
+	map->refs = 1;
+	map->used = ++palette_tables_clock;
+
+	return map;
+}
+
+
+static void palette_release_map( palette_map_t * map )
+{
+	if( !--map->refs && !map->cached )
+		pool_free( map );
+}
+
+
+/*!
+	\brief Sort the colors of the tables into their map, every palette order of the same colors shares it
+*/
+static int palette_build_tables( palette_tables_t * tables )
+{
+	uint64_t key[ PALETTE_MAX_COLORS ];
+	uint32_t rgb[ PALETTE_MAX_COLORS ];
+	int first = 0;
+	int i = 0;
+
+	for( i = 0; i < tables->count; i++ )
+		key[i] = ( (((uint64_t) tables->color[i].red << 16) | ((uint64_t) tables->color[i].green << 8) | tables->color[i].blue) << 8 ) | (uint64_t) i;
+
+	qsort( key, tables->count, sizeof(uint64_t), palette_compare_keys );
+
+	/* A repeated color takes the lowest palette index of its run, as the exact map does */
+	for( i = 0; i < tables->count; i++ )
+	{
+		rgb[i] = (uint32_t) (key[i] >> 8);
+
+		if( (i == 0) || (rgb[i] != rgb[ i - 1 ]) )
+			first = i;
+
+		tables->index[i] = (uint8_t) (key[ first ] & 0xFF);
+	}
+
+	tables->map = palette_acquire_map( rgb, tables->count );
+
+	return (tables->map) ? 0 : -1;
+}
+
+
+static void palette_tables_free( palette_tables_t * tables )
+{
+	palette_release_map( tables->map );
+	pool_free( tables );
+}
+
+
+palette_tables_t * palette_acquire_tables( palette_t * this )
+{
+	palette_tables_t * tables = NULL;
+	palette_tables_t * victim = NULL;
+	uint32_t hash = palette_get_hash( this );
+	int slot = -1;
+	int i = 0;
+
+	pthread_mutex_lock( &palette_tables_mutex );
+
+	for( i = 0; i < PALETTE_TABLES_CACHE_SIZE; i++ )
+	{
+		tables = palette_tables_cache[i];
+
+		if( tables && (tables->hash == hash) && (tables->count == this->count) && !memcmp( tables->color, this->color, sizeof(color_t) * this->count ) )
+		{
+			tables->refs++;
+			tables->used = ++palette_tables_clock;
+
+			pthread_mutex_unlock( &palette_tables_mutex );
+
+			return tables;
+		}
+	}
+
+	/* An empty entry, or the least recently used one that nobody holds */
+	for( i = 0; i < PALETTE_TABLES_CACHE_SIZE; i++ )
+	{
+		victim = palette_tables_cache[i];
+
+		if( !victim )
+		{
+			slot = i;
+			break;
+		}
+
+		if( !victim->refs && ( (slot < 0) || (victim->used < palette_tables_cache[ slot ]->used) ) )
+			slot = i;
+	}
+
+	/* The tables of a palette that keeps changing take over the memory of the ones evicted */
+	if( (slot >= 0) && palette_tables_cache[ slot ] )
+	{
+		tables = palette_tables_cache[ slot ];
+		palette_tables_cache[ slot ] = NULL;
+
+		palette_release_map( tables->map );
+		memset( tables, 0, sizeof(palette_tables_t) );
+	}
+	else
+	{
+		tables = (palette_tables_t*) pool_calloc( 1, sizeof(palette_tables_t) );
+	}
+
+	/* Built while holding the lock: whoever else wants them would have to wait anyway */
+	if( tables )
+	{
+		tables->hash = hash;
+		tables->count = this->count;
+		memcpy( tables->color, this->color, sizeof(color_t) * this->count );
+
+		if( palette_build_tables( tables ) )
+		{
+			pool_free( tables );
+			tables = NULL;
+		}
+	}
+
+	if( !tables )
+	{
+		pthread_mutex_unlock( &palette_tables_mutex );
+		return NULL;
+	}
+
+	if( slot >= 0 )
+	{
+		palette_tables_cache[ slot ] = tables;
+		tables->cached = 1;
+	}
+
+	tables->refs = 1;
+	tables->used = ++palette_tables_clock;
+
+	pthread_mutex_unlock( &palette_tables_mutex );
+
+	return tables;
+}
+
+
+void palette_release_tables( palette_tables_t * tables )
+{
+	pthread_mutex_lock( &palette_tables_mutex );
+
+	if( !--tables->refs && !tables->cached )
+		palette_tables_free( tables );
+
+	pthread_mutex_unlock( &palette_tables_mutex );
+}
+
+
+void palette_tables_get_color( palette_tables_t * tables, int idx, uint8_t * red, uint8_t * green, uint8_t * blue )
+{
+	*red = tables->color[idx].red;
+	*green = tables->color[idx].green;
+	*blue = tables->color[idx].blue;
+}
+
+
+int palette_tables_get_nearest_color( palette_tables_t * tables, uint8_t red, uint8_t green, uint8_t blue )
+{
+	palette_map_t * map = tables->map;
+	uint32_t rgb = ((uint32_t) red << 16) | ((uint32_t) green << 8) | blue;
+	uint32_t cell = palette_inverse_cell( rgb );
+	uint32_t slot = 0;
+	int nearest = 0;
+
+	/* The palette colors themselves before the quantized map, looked up only in the cells that hold one */
+	if( map->exact_cells[ cell >> 3 ] & (1 << (cell & 7)) )
+	{
+		for( slot = palette_exact_slot( rgb + 1 ); map->exact_key[ slot ]; slot = (slot + 1) & (PALETTE_EXACT_SIZE - 1) )
+			if( map->exact_key[ slot ] == rgb + 1 )
+				return tables->index[ map->exact_index[ slot ] ];
+	}
+
+	nearest = __atomic_load_n( &map->inverse[ cell ], __ATOMIC_RELAXED );
+
+	if( nearest )
+		return tables->index[ nearest - 1 ];
+
+	return tables->index[ palette_map_fill_cell( map, cell ) ];
+}
+
 /* $Id: palette.c 293 2015-07-28 05:24:22Z tiago.ventura $ */
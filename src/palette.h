@@ -21,6 +21,39 @@ extern "C" {
 typedef struct palette_s palette_t;
 
 
+/*!
+	\brief Palette Revision Type Definition
+*/
+typedef struct palette_revision_s palette_revision_t;
+
+
+/*!
+	\brief Identifies the colors of a palette at some point in time
+
+	A copy of a palette carries the revision of its source, so whoever
+	keeps the revision it last saw can tell which colors changed since,
+	whatever copy it is handed now. A zeroed revision matches nothing.
+*/
+struct palette_revision_s
+{
+	uint32_t id;        /*!< Lineage: the palette the colors were created in */
+	uint32_t version;   /*!< Last change */
+};
+
+
+/*!
+	\brief Palette Lookup Tables Type Definition (opaque)
+
+	Tables derived from the colors of a palette, built on demand and shared
+	by every palette with the same colors. They are cached by the content
+	hash of the palette, so palettes that keep coming back (a copy in every
+	pipeline slot, a palette cycled between a few states) build them once.
+	The color map behind them only depends on the set of colors, so a
+	palette that rotates or swaps its colors only builds a new index table.
+*/
+typedef struct palette_tables_s palette_tables_t;
+
+
 /*!
 	\brief Palette Object Contructor
 	\return Palette Object
@@ -80,6 +113,40 @@ void palette_set_color( palette_t * this, int idx, uint8_t red, uint8_t green, u
 void palette_get_color( palette_t * this, int idx, uint8_t * red, uint8_t * green, uint8_t * blue );
 
 
+/*!
+	\brief Fill a range of colors with a linear gradient
+	\param this Palette Object
+	\param first First Color Element Index, gets the start color
+	\param last Last Color Element Index, gets the end color
+	\param red1 Start Red Component
+	\param green1 Start Green Component
+	\param blue1 Start Blue Component
+	\param red2 End Red Component
+	\param green2 End Green Component
+	\param blue2 End Blue Component
+*/
+void palette_set_gradient( palette_t * this, int first, int last, uint8_t red1, uint8_t green1, uint8_t blue1, uint8_t red2, uint8_t green2, uint8_t blue2 );
+
+
+/*!
+	\brief Expand a range of colors into 32-bit pixels
+
+	Builds the lookup table true color screens translate indexes with, so
+	each pixel costs a single load. Only the range that changed needs to be
+	expanded again.
+
+	\param this Palette Object
+	\param lut Lookup table, one pixel per color
+	\param first First Color Element Index
+	\param count Number of colors to expand
+	\param rshift Bit position of the red component in the pixel
+	\param gshift Bit position of the green component in the pixel
+	\param bshift Bit position of the blue component in the pixel
+	\param alpha Bits or'ed into every pixel (e.g. an opaque alpha channel)
+*/
+void palette_expand( palette_t * this, uint32_t * lut, int first, int count, int rshift, int gshift, int bshift, uint32_t alpha );
+
+
 /*!
 	\brief Set Palette Object Default Colors
 	\param this Palette Object
@@ -87,6 +154,75 @@ void palette_get_color( palette_t * this, int idx, uint8_t * red, uint8_t * gree
 void palette_set_default( palette_t * this );
 
 
+/*!
+	\brief Get the current revision of the palette colors
+	\param this Palette Object
+	\param rev Revision
+*/
+void palette_get_revision( palette_t * this, palette_revision_t * rev );
+
+
+/*!
+	\brief Get the range of colors that changed since a revision
+	\param this Palette Object
+	\param since Revision seen last (a zeroed one for everything)
+	\param first First changed color index
+	\param count Number of colors from first on that cover every change
+	\return 1 if any color changed, 0 if the palette is the same as in the revision
+*/
+int palette_get_changes( palette_t * this, const palette_revision_t * since, int * first, int * count );
+
+
+/*!
+	\brief Get the hash of the palette colors
+	\param this Palette Object
+	\return FNV-1a hash of the colors
+*/
+uint32_t palette_get_hash( palette_t * this );
+
+
+/*!
+	\brief Get the lookup tables of the current colors of a palette, building them if needed
+	\param this Palette Object
+	\return Palette Tables, to be released with palette_release_tables(), NULL if out of memory
+*/
+palette_tables_t * palette_acquire_tables( palette_t * this );
+
+
+/*!
+	\brief Release lookup tables got from palette_acquire_tables()
+	\param tables Palette Tables
+*/
+void palette_release_tables( palette_tables_t * tables );
+
+
+/*!
+	\brief Get a color of the palette the tables were built from
+	\param tables Palette Tables
+	\param idx Color Element Index
+	\param red Red Component
+	\param green Green Component
+	\param blue Blue Component
+*/
+void palette_tables_get_color( palette_tables_t * tables, int idx, uint8_t * red, uint8_t * green, uint8_t * blue );
+
+
+/*!
+	\brief Get the index of the palette color nearest to an RGB color
+
+	A color of the palette gives its own index (the lowest one if it is
+	repeated), any other the index of the color nearest to the center of
+	its 15-bit cell.
+
+	\param tables Palette Tables
+	\param red Red Component
+	\param green Green Component
+	\param blue Blue Component
+	\return Color Element Index
+*/
+int palette_tables_get_nearest_color( palette_tables_t * tables, uint8_t red, uint8_t green, uint8_t blue );
+
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,231 @@
+/*!
+	\file palette_animator.c
+	\brief Palette Animator Implementation
+	\author Tiago Ventura (tiago.ventura@gmail.com)
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "palette.h"
+#include "palette_animator.h"
+
+#define PALETTE_ANIMATOR_MAX_COLORS   (256)
+#define PALETTE_ANIMATOR_FADE_ONE     (256)
+
+
+/*!
+	\brief Represents a rotating range of colors
+*/
+struct palette_animator_cycle_s
+{
+	int first;
+	int count;
+	double speed;
+	double phase;   /*!< Current rotation, in colors, within [0,count) */
+};
+
+typedef struct palette_animator_cycle_s palette_animator_cycle_t;
+
+
+/*!
+	\brief Represents a Palette Animator Object
+*/
+struct palette_animator_s
+{
+	int count;
+	uint8_t base[ PALETTE_ANIMATOR_MAX_COLORS ][3];
+	uint8_t target[ PALETTE_ANIMATOR_MAX_COLORS ][3];
+	uint8_t mixed[ PALETTE_ANIMATOR_MAX_COLORS ][3];
+
+	double fade_time;
+	double fade_duration;
+	int fading;
+
+	int cycles_count;
+	palette_animator_cycle_t cycle[ PALETTE_ANIMATOR_MAX_CYCLES ];
+};
+
+
+static void palette_animator_load( uint8_t (*dst)[3], palette_t * pal, int count )
+{
+	int i = 0;
+
+	for( i = 0; i < count; i++ )
+		palette_get_color( pal, i, &dst[i][0], &dst[i][1], &dst[i][2] );
+}
+
+
+palette_animator_t * palette_animator_create( void )
+{
+	palette_animator_t * anim = NULL;
+
+	anim = (palette_animator_t*) calloc( 1, sizeof(palette_animator_t) );
+
+	if( !anim )
+		return NULL;
+
+	anim->count = PALETTE_ANIMATOR_MAX_COLORS;
+
+	return anim;
+}
+
+
+void palette_animator_destroy( palette_animator_t * this )
+{
+	free( this );
+}
+
+
+void palette_animator_set_base( palette_animator_t * this, palette_t * pal )
+{
+	this->count = palette_get_color_count( pal );
+
+	if( this->count > PALETTE_ANIMATOR_MAX_COLORS )
+		this->count = PALETTE_ANIMATOR_MAX_COLORS;
+
+	palette_animator_load( this->base, pal, this->count );
+
+	this->fading = 0;
+}
+
+
+int palette_animator_add_cycle( palette_animator_t * this, int first, int count, double speed )
+{
+	palette_animator_cycle_t * cyc = NULL;
+
+	if( this->cycles_count >= PALETTE_ANIMATOR_MAX_CYCLES )
+		return -1;
+
+	if( (first < 0) || (count < 2) || (first + count > this->count) )
+		return -1;
+
+	cyc = &this->cycle[ this->cycles_count ];
+
+	cyc->first = first;
+	cyc->count = count;
+	cyc->speed = speed;
+	cyc->phase = 0.0;
+
+	return this->cycles_count++;
+}
+
+
+void palette_animator_set_cycle_speed( palette_animator_t * this, int cycle, double speed )
+{
+	if( (cycle < 0) || (cycle >= this->cycles_count) )
+		return;
+
+	this->cycle[cycle].speed = speed;
+}
+
+
+void palette_animator_clear_cycles( palette_animator_t * this )
+{
+	this->cycles_count = 0;
+}
+
+
+int palette_animator_fade_to( palette_animator_t * this, palette_t * target, double duration )
+{
+	if( palette_get_color_count( target ) < this->count )
+		return -1;
+
+	/* A fade started halfway through another one starts from where that one is */
+	if( this->fading )
+		memcpy( this->base, this->mixed, sizeof(this->base) );
+
+	palette_animator_load( this->target, target, this->count );
+
+	this->fade_time = 0.0;
+	this->fade_duration = (duration > 0.0) ? duration : 0.0;
+	this->fading = 1;
+
+	return 0;
+}
+
+
+int palette_animator_is_fading( palette_animator_t * this )
+{
+	return this->fading;
+}
+
+
+static void palette_animator_mix( palette_animator_t * this )
+{
+	uint8_t * restrict dst = &this->mixed[0][0];
+	const uint8_t * restrict src = &this->base[0][0];
+	const uint8_t * restrict tgt = &this->target[0][0];
+	int n = this->count * 3;
+	int w = PALETTE_ANIMATOR_FADE_ONE;
+	int i = 0;
+
+	if( !this->fading )
+	{
+		memcpy( dst, src, n );
+		return;
+	}
+
+	if( this->fade_time < this->fade_duration )
+		w = (int) (this->fade_time * PALETTE_ANIMATOR_FADE_ONE / this->fade_duration);
+
+	/* Fixed point blend, w in [0,256] */
+	for( i = 0; i < n; i++ )
+		dst[i] = (uint8_t) ((src[i] * (PALETTE_ANIMATOR_FADE_ONE - w) + tgt[i] * w) >> 8);
+
+	/* Fade done: the target is the new base */
+	if( w == PALETTE_ANIMATOR_FADE_ONE )
+	{
+		memcpy( this->base, this->target, sizeof(this->base) );
+		this->fading = 0;
+	}
+}
+
+
+void palette_animator_update( palette_animator_t * this, palette_t * pal, double dt )
+{
+	uint8_t out[ PALETTE_ANIMATOR_MAX_COLORS ][3];
+	palette_animator_cycle_t * cyc = NULL;
+	int shift = 0;
+	int c = 0;
+	int i = 0;
+	int j = 0;
+
+	if( dt < 0.0 )
+		dt = 0.0;
+
+	if( this->fading )
+		this->fade_time += dt;
+
+	palette_animator_mix( this );
+
+	memcpy( out, this->mixed, sizeof(uint8_t) * 3 * this->count );
+
+	/* Rotate each range: the color at first+k moves to first+(k+shift)%count */
+	for( c = 0; c < this->cycles_count; c++ )
+	{
+		cyc = &this->cycle[c];
+
+		cyc->phase = fmod( cyc->phase + cyc->speed * dt, cyc->count );
+
+		if( cyc->phase < 0.0 )
+			cyc->phase += cyc->count;
+
+		shift = ((int) cyc->phase) % cyc->count;
+
+		for( i = 0, j = shift; i < cyc->count; i++ )
+		{
+			memcpy( out[ cyc->first + j ], this->mixed[ cyc->first + i ], 3 );
+
+			if( ++j == cyc->count )
+				j = 0;
+		}
+	}
+
+	/* Unchanged colors are no-ops in the palette and stay out of the next upload */
+	for( i = 0; i < this->count; i++ )
+		palette_set_color( pal, i, out[i][0], out[i][1], out[i][2] );
+}
+
+/* $Id$ */
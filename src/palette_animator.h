@@ -0,0 +1,118 @@
+/*!
+	\file palette_animator.h
+	\brief Palette Animator Interface
+	\author Tiago Ventura (tiago.ventura@gmail.com)
+*/
+
+
+#ifndef __PALETTE_ANIMATOR_H__
+#define __PALETTE_ANIMATOR_H__
+
+#include "palette.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/*!
+	\brief Maximum number of cycling ranges of a Palette Animator
+*/
+#define PALETTE_ANIMATOR_MAX_CYCLES   (16)
+
+
+/*!
+	\brief Palette Animator Object Type Definition
+
+	Animates a palette instead of the frame that uses it: ranges of
+	colors rotate (color cycling) and the whole set of colors cross-fades
+	towards a target palette. Every update costs O(colors), whatever the
+	size of the frame, and only the colors that really moved are written,
+	so players upload just those.
+*/
+typedef struct palette_animator_s palette_animator_t;
+
+
+/*!
+	\brief Palette Animator Object Constructor
+	\return Palette Animator Object
+*/
+palette_animator_t * palette_animator_create( void );
+
+
+/*!
+	\brief Palette Animator Object Destructor
+	\param this Palette Animator Object
+*/
+void palette_animator_destroy( palette_animator_t * this );
+
+
+/*!
+	\brief Set the colors the animation starts from (the palette is copied)
+	\param this Palette Animator Object
+	\param pal Base Palette
+*/
+void palette_animator_set_base( palette_animator_t * this, palette_t * pal );
+
+
+/*!
+	\brief Add a range of colors to rotate
+	\param this Palette Animator Object
+	\param first First Color Element Index of the range
+	\param count Number of colors in the range
+	\param speed Rotation speed in colors per second (negative rotates backwards)
+	\return Cycle index, -1 on error
+*/
+int palette_animator_add_cycle( palette_animator_t * this, int first, int count, double speed );
+
+
+/*!
+	\brief Change the speed of a cycling range
+	\param this Palette Animator Object
+	\param cycle Cycle index
+	\param speed Rotation speed in colors per second
+*/
+void palette_animator_set_cycle_speed( palette_animator_t * this, int cycle, double speed );
+
+
+/*!
+	\brief Remove every cycling range
+	\param this Palette Animator Object
+*/
+void palette_animator_clear_cycles( palette_animator_t * this );
+
+
+/*!
+	\brief Start a cross-fade from the current colors to another palette
+	\param this Palette Animator Object
+	\param target Target Palette (copied), becomes the base when the fade ends
+	\param duration Fade duration in seconds (0 switches at the next update)
+	\return 0 on success, -1 on error
+*/
+int palette_animator_fade_to( palette_animator_t * this, palette_t * target, double duration );
+
+
+/*!
+	\brief Tells whether a cross-fade is running
+	\param this Palette Animator Object
+	\return 1 while fading, 0 otherwise
+*/
+int palette_animator_is_fading( palette_animator_t * this );
+
+
+/*!
+	\brief Advance the animation and write the resulting colors
+	\param this Palette Animator Object
+	\param pal Palette to update, only the colors that change are written
+	\param dt Elapsed time in seconds
+*/
+void palette_animator_update( palette_animator_t * this, palette_t * pal, double dt );
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __PALETTE_ANIMATOR_H__ */
+
+/* $Id$ */
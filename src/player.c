@@ -9,8 +9,14 @@
 #include <string.h>
 #include <time.h>
 #include <math.h>
+#include <signal.h>
+#include <errno.h>
+#include <pthread.h>
 
 #include "common.h"
+#include "histogram.h"
+#include "queue.h"
+#include "pool.h"
 #include "player.h"
 #include "frame.h"
 #include "animation.h"
@@ -19,8 +25,30 @@
 #include "console.h"
 
 
-#define PLAYER_TEXT_STATUS_MAX_LEN         (512)
 #define PLAYER_DESCRIPTION_MAX_LEN         (64)
+#define PLAYER_CATCHUP_MAX_STEPS           (8)
+#define PLAYER_FPS_SMOOTHING               (0.1)
+#define PLAYER_FPS_SYNCH_TOLERANCE         (0.95)
+#define PLAYER_SIMULATION_MAX_LAG          (250000000L)
+#define PLAYER_PIPELINE_DEPTH              (3)
+#define PLAYER_DEFAULT_COLOR_DEPTH         (8)
+
+
+/*!
+	\brief Pipeline slot: a frame travelling from the simulation to the presentation stage
+*/
+struct player_slot_s
+{
+	frame_t * frame;
+	frame_t * filtered;
+	palette_t * palette;
+	int sequence;
+	int steps;
+	int last;
+};
+
+typedef struct player_slot_s player_slot_t;
+
 
 /*!
 	\brief Represents a Player Object
@@ -45,14 +73,47 @@ struct player_s
 	int console_row;
 	int console_ncols;
 	int console_nrows;
+	int unthrottled;
+	int frames_limit;
+	int frames_count;
+	histogram_t * stage_histogram[ player_stage_count ];
+	volatile sig_atomic_t dump_requested;
+	const char * stats_file;
+	player_catchup_t catchup;
+	double timeline_fps;
+	uint64_t timeline_epoch;
+	uint64_t timeline_index;
+	uint64_t last_present;
+	double simulation_rate;
+	double simulation_time;
+	int simulation_steps;
+	int simulation_late;
+	int pipelined;
+	int color_depth;
+	queue_t * free_slots;
+	queue_t * simulated_slots;
+	queue_t * filtered_slots;
+	player_slot_t slot[ PLAYER_PIPELINE_DEPTH ];
+	frame_t * filtered;
+	unsigned int frame_allocations;
+	uint64_t pool_allocations;
+	palette_revision_t palette_revision;   /*!< Colors the screen has */
+	unsigned int palette_uploads;
+	unsigned int palette_colors_uploaded;
 };
 
 
 static inline uint64_t player_timespec_diff( struct timespec * start, struct timespec * end );
-static void player_time_delay( player_t * this, int64_t elapsed );
-static void player_render_frame( player_t * this, frame_t * frm );
+static inline uint64_t player_get_time( void );
+static void player_timeline_reset( player_t * this, uint64_t epoch );
+static int player_time_delay( player_t * this );
+static uint64_t player_update_real_fps( player_t * this );
+static int player_get_simulation_steps( player_t * this, int frames, uint64_t interval );
+static uint64_t player_get_simulation_budget( player_t * this );
+static void player_stage_end( player_t * this, player_stage_t stage, struct timespec * mark );
+static void player_render_frame( player_t * this, frame_t * frm, struct timespec * mark );
 static void player_set_palette( player_t * this, palette_t * pal );
-static const char * player_get_status_text( player_t * this );
+static void player_add_status_line( player_t * this, int sequence, int steps );
 static void player_refresh_console( player_t * this );
 
 
@@ -65,6 +126,7 @@ player_t * player_get_instance( void )
 player_t * player_create( player_implementation_t * impl )
 {
 	static player_t * singleton = NULL;
+	int i = 0;
 
 	if(singleton)
 		return singleton;
@@ -77,9 +139,26 @@ player_t * player_create( player_implementation_t * impl )
 	if(!singleton)
 		return NULL;
 
+	for( i = 0; i < player_stage_count; i++ )
+	{
+		singleton->stage_histogram[i] = histogram_create();
+
+		if( !singleton->stage_histogram[i] )
+		{
+			while( i-- )
+				histogram_destroy( singleton->stage_histogram[i] );
+
+			free( singleton );
+			singleton = NULL;
+
+			return NULL;
+		}
+	}
+
 	singleton->fps = 1.0;
 	singleton->impl = impl;
 	singleton->screen_format = player_screen_format_undefined;
+	singleton->color_depth = PLAYER_DEFAULT_COLOR_DEPTH;
 	singleton->state = unitialized;
 
 	singleton->impl->create( singleton );
@@ -90,7 +169,13 @@ player_t * player_create( player_implementation_t * impl )
 
 void player_destroy( player_t * this )
 {
+	int i = 0;
+
 	this->impl->destroy( this );
+
+	for( i = 0; i < player_stage_count; i++ )
+		histogram_destroy( this->stage_histogram[i] );
+
 	free( this );
 }
 
@@ -107,6 +192,9 @@ int player_screen_initialize( player_t * this )
 	if( ret )
 		return -1;
 
+	/* A new screen has none of the colors yet */
+	memset( &this->palette_revision, 0, sizeof(palette_revision_t) );
+
 	this->state = stopped;
 
 	return 0;
@@ -123,39 +211,51 @@ void player_screen_finish( player_t * this )
 }
 
 
-static void player_render_frame( player_t * this, frame_t * frm )
+static void player_render_frame( player_t * this, frame_t * frm, struct timespec * mark )
 {
-	if( !this->filter )
+	if( this->filter && this->filtered )
 	{
-		this->impl->render_frame( this, frm );
+		filter_set_palette( this->filter, animation_get_palette( this->anim ) );
+		filter_frame( this->filter, this->filtered, frm );
+		player_stage_end( this, player_stage_filter, mark );
+
+		frm = this->filtered;
 	}
-	else
-	{
-		frame_t * frmaux = NULL;
 
-		frmaux = frame_duplicate( frm );
+	this->impl->render_frame( this, frm );
+	player_stage_end( this, player_stage_render, mark );
+}
 
-		if(!frmaux)
-			return;
 
-		filter_frame( this->filter, frmaux );
+/*!
+	\brief Upload the colors that changed since the last upload, nothing when the palette is the same
+*/
+static void player_set_palette( player_t * this, palette_t * pal )
+{
+	int first = 0;
+	int count = 0;
 
-		this->impl->render_frame( this, frmaux );
+	if( !palette_get_changes( pal, &this->palette_revision, &first, &count ) )
+		return;
 
-		frame_destroy( frmaux );
-	}
-}
+	this->impl->set_palette( this, pal, first, count );
 
+	palette_get_revision( pal, &this->palette_revision );
 
-static void player_set_palette( player_t * this, palette_t * pal )
-{
-	this->impl->set_palette( this, pal );
+	this->palette_uploads++;
+	this->palette_colors_uploaded += count;
 }
 
 
 void player_refresh_console( player_t * this )
 {
+	console_lock( this->console );
 	this->impl->refresh_console( this );
+	console_unlock( this->console );
+
+	/* Frame and console reach the screen together */
+	if( this->impl->present )
+		this->impl->present( this );
 }
 
 
@@ -358,6 +458,211 @@ const char * player_get_description( player_t * this )
 }
 
 
+void player_set_unthrottled( player_t * this, int unthrottled )
+{
+	this->unthrottled = unthrottled;
+}
+
+
+int player_get_unthrottled( player_t * this )
+{
+	return this->unthrottled;
+}
+
+
+void player_set_simulation_rate( player_t * this, double rate )
+{
+	this->simulation_rate = rate;
+}
+
+
+double player_get_simulation_rate( player_t * this )
+{
+	return this->simulation_rate;
+}
+
+
+void player_set_pipelined( player_t * this, int pipelined )
+{
+	this->pipelined = pipelined;
+}
+
+
+int player_get_pipelined( player_t * this )
+{
+	return this->pipelined;
+}
+
+
+void player_set_color_depth( player_t * this, int depth )
+{
+	this->color_depth = depth;
+}
+
+
+int player_get_color_depth( player_t * this )
+{
+	return this->color_depth;
+}
+
+
+void player_set_catchup_policy( player_t * this, player_catchup_t policy )
+{
+	this->catchup = policy;
+}
+
+
+player_catchup_t player_get_catchup_policy( player_t * this )
+{
+	return this->catchup;
+}
+
+
+void player_set_frames_limit( player_t * this, int nframes )
+{
+	this->frames_limit = nframes;
+}
+
+
+int player_get_frames_limit( player_t * this )
+{
+	return this->frames_limit;
+}
+
+
+unsigned int player_get_frame_allocations( player_t * this )
+{
+	return this->frame_allocations;
+}
+
+
+int player_get_frames_count( player_t * this )
+{
+	return this->frames_count;
+}
+
+
+uint64_t player_get_stage_time( player_t * this, player_stage_t stage )
+{
+	return histogram_get_sum( this->stage_histogram[ stage ] );
+}
+
+
+histogram_t * player_get_stage_histogram( player_t * this, player_stage_t stage )
+{
+	return this->stage_histogram[ stage ];
+}
+
+
+const char * player_get_stage_name( player_stage_t stage )
+{
+	static const char * names[ player_stage_count ] = { "animation", "filter", "palette", "render", "console", "delay", "frame" };
+
+	return names[ stage ];
+}
+
+
+void player_dump_stats( player_t * this, FILE * stream )
+{
+	int i = 0;
+	histogram_t * h = NULL;
+	pool_stats_t stats;
+
+	fprintf( stream, "%-10s %10s %10s %10s %10s %10s %10s\n", "stage(ms)", "count", "mean", "p50", "p99", "p99.9", "max" );
+
+	for( i = 0; i < player_stage_count; i++ )
+	{
+		h = this->stage_histogram[i];
+
+		fprintf( stream, "%-10s %10llu %10.3f %10.3f %10.3f %10.3f %10.3f\n",
+				 player_get_stage_name( i ),
+				 (unsigned long long) histogram_get_count( h ),
+				 histogram_get_mean( h ) / 1e6,
+				 histogram_get_percentile( h, 50.0 ) / 1e6,
+				 histogram_get_percentile( h, 99.0 ) / 1e6,
+				 histogram_get_percentile( h, 99.9 ) / 1e6,
+				 histogram_get_max( h ) / 1e6 );
+	}
+
+	pool_get_stats( &stats );
+
+	fprintf( stream, "frames allocated while playing: %u\n", this->frame_allocations );
+	fprintf( stream, "palette uploads: %u / colors uploaded: %u\n", this->palette_uploads, this->palette_colors_uploaded );
+	fprintf( stream, "pool: peak=%0.1fKiB / in use=%0.1fKiB / from system=%llu / allocations per frame=%0.2f\n",
+			 stats.peak_bytes / 1024.0,
+			 stats.bytes_in_use / 1024.0,
+			 (unsigned long long) stats.system_allocations,
+			 (this->frames_count) ? (double) this->pool_allocations / this->frames_count : 0.0 );
+
+	fflush( stream );
+}
+
+
+void player_request_stats_dump( player_t * this )
+{
+	this->dump_requested = 1;
+}
+
+
+void player_set_stats_file( player_t * this, const char * filename )
+{
+	this->stats_file = filename;
+}
+
+
+int player_export_stats( player_t * this, const char * filename )
+{
+	FILE * fp = NULL;
+	histogram_t * h = NULL;
+	size_t len = strlen( filename );
+	int json = ( (len > 5) && !strcmp( filename + len - 5, ".json" ) );
+	pool_stats_t stats;
+	int i = 0;
+
+	pool_get_stats( &stats );
+
+	fp = fopen( filename, "w" );
+
+	if( !fp )
+		return -1;
+
+	if( json )
+	{
+		fprintf( fp, "{\n  \"player\": \"%s\",\n  \"animation\": \"%s\",\n  \"fps\": %0.3f,\n  \"frames\": %d,\n  \"frame_allocations\": %u,\n  \"pool_allocations\": %llu,\n  \"pool_peak_bytes\": %llu,\n  \"palette_uploads\": %u,\n  \"palette_colors_uploaded\": %u,\n  \"stages\": [\n",
+				 this->description, animation_get_name( this->anim ), this->fps, this->frames_count, this->frame_allocations,
+				 (unsigned long long) this->pool_allocations, (unsigned long long) stats.peak_bytes,
+				 this->palette_uploads, this->palette_colors_uploaded );
+	}
+	else
+	{
+		fprintf( fp, "stage,count,mean_ns,p50_ns,p99_ns,p999_ns,max_ns\n" );
+	}
+
+	for( i = 0; i < player_stage_count; i++ )
+	{
+		h = this->stage_histogram[i];
+
+		fprintf( fp, (json) ? "    { \"stage\": \"%s\", \"count\": %llu, \"mean_ns\": %0.0f, \"p50_ns\": %llu, \"p99_ns\": %llu, \"p999_ns\": %llu, \"max_ns\": %llu }%s\n"
+							: "%s,%llu,%0.0f,%llu,%llu,%llu,%llu%s\n",
+				 player_get_stage_name( i ),
+				 (unsigned long long) histogram_get_count( h ),
+				 histogram_get_mean( h ),
+				 (unsigned long long) histogram_get_percentile( h, 50.0 ),
+				 (unsigned long long) histogram_get_percentile( h, 99.0 ),
+				 (unsigned long long) histogram_get_percentile( h, 99.9 ),
+				 (unsigned long long) histogram_get_max( h ),
+				 (json && (i < player_stage_count - 1)) ? "," : "" );
+	}
+
+	if( json )
+		fprintf( fp, "  ]\n}\n" );
+
+	fclose( fp );
+
+	return 0;
+}
+
+
 static inline uint64_t player_timespec_diff( struct timespec * start, struct timespec * end )
 {
 	struct timespec temp;
@@ -377,71 +682,209 @@ static inline uint64_t player_timespec_diff( struct timespec * start, struct tim
 }
 
 
-static const char * player_get_status_text( player_t * this )
+static void player_stage_end( player_t * this, player_stage_t stage, struct timespec * mark )
+{
+	struct timespec now;
+
+	clock_gettime( CLOCK_MONOTONIC, &now );
+
+	histogram_record( this->stage_histogram[ stage ], player_timespec_diff( mark, &now ) );
+
+	*mark = now;
+}
+
+
+static void player_add_status_line( player_t * this, int sequence, int steps )
 {
-	static char text[ PLAYER_TEXT_STATUS_MAX_LEN + 1 ] = {0};
-	animation_t * anim = player_get_animation(this);
 	double real_fps = player_get_real_fps(this);
 	double player_fps = player_get_fps(this);
-	int synch = (real_fps < player_fps) ? 0 : 1;
+	int synch = (real_fps < fabs( player_fps ) * PLAYER_FPS_SYNCH_TOLERANCE) ? 0 : 1;
+
+	/* Formatted by the console, only if the line gets shown */
+	console_add_line( this->console, "Player: seq=%d / fps=%0.1f / steps=%d / synch=%s", sequence, real_fps, steps, (synch)?"ok":"error" );
+}
 
-	snprintf( text, PLAYER_TEXT_STATUS_MAX_LEN, "Player: seq=%d / fps=%0.1f / synch=%s", animation_get_frame_sequence( anim ), real_fps, (synch)?"ok":"error" );
 
-	return text;
+static inline uint64_t player_get_time( void )
+{
+	struct timespec now;
+
+	clock_gettime( CLOCK_MONOTONIC, &now );
+
+	return (uint64_t) now.tv_sec * 1000000000L + now.tv_nsec;
 }
 
 
-static void player_time_delay( player_t * this, int64_t elapsed )
+static void player_timeline_reset( player_t * this, uint64_t epoch )
 {
-	struct timespec frmdelay;
-	int64_t frame_duration = 0;
-	int64_t delay = 0;
+	this->timeline_fps = this->fps;
+	this->timeline_epoch = epoch;
+	this->timeline_index = 0;
+}
 
-	frame_duration = 1000000000L / fabs( this->fps );
 
-	delay = frame_duration - elapsed;
+/*!
+	\brief Sleep until the next deadline of the frame timeline
+
+	Deadlines are absolute (epoch + index * period), so the time spent on a
+	frame never accumulates as drift and a single slow frame is absorbed by
+	the following ones. When the player is late by one or more whole periods
+	the catch-up policy decides what happens to the missed deadlines.
+
+	\param this Player Object
+	\return Number of animation steps to run on the next frame
+*/
+static int player_time_delay( player_t * this )
+{
+	struct timespec deadline;
+	uint64_t period = 0;
+	uint64_t target = 0;
+	uint64_t missed = 0;
+	uint64_t now = 0;
+	int steps = 1;
+
+	now = player_get_time();
 
-	if( delay > 0L )
+	/* Frame rate changed, start a new timeline from here */
+	if( this->timeline_fps != this->fps )
+		player_timeline_reset( this, now );
+
+	period = 1000000000L / fabs( this->fps );
+
+	this->timeline_index++;
+
+	target = this->timeline_epoch + this->timeline_index * period;
+
+	if( now < target )
 	{
-		frmdelay.tv_sec = delay / 1000000000L;
-		frmdelay.tv_nsec = delay % 1000000000L;
+		deadline.tv_sec = target / 1000000000L;
+		deadline.tv_nsec = target % 1000000000L;
 
-		nanosleep( &frmdelay, NULL );
+		while( clock_nanosleep( CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, NULL ) == EINTR );
 	}
-
-	if( elapsed > frame_duration )
+	else if( now - target >= period )
 	{
-		this->real_fps = 1000000000L / (double) elapsed;
+		missed = (now - target) / period;
+
+		switch( this->catchup )
+		{
+			case player_catchup_drop :
+			{
+				if( missed < PLAYER_CATCHUP_MAX_STEPS )
+				{
+					this->timeline_index += missed;
+					steps += missed;
+				}
+				else
+				{
+					/* Too far behind to ever catch up, give up on the lost time */
+					player_timeline_reset( this, now );
+					steps = PLAYER_CATCHUP_MAX_STEPS;
+				}
+
+				break;
+			}
+
+			case player_catchup_skip :
+			{
+				this->timeline_index += missed;
+				break;
+			}
+
+			case player_catchup_stretch :
+			default :
+			{
+				player_timeline_reset( this, now );
+				break;
+			}
+		}
 	}
-	else
+
+	return steps;
+}
+
+
+static uint64_t player_update_real_fps( player_t * this )
+{
+	uint64_t now = player_get_time();
+	uint64_t interval = 0;
+	double fps = 0.0;
+
+	if( this->last_present && (now > this->last_present) )
 	{
-		this->real_fps = 1000000000L / (double) frame_duration;
+		interval = now - this->last_present;
+		fps = 1000000000L / (double) interval;
+
+		if( this->real_fps > 0.0 )
+			this->real_fps += PLAYER_FPS_SMOOTHING * (fps - this->real_fps);
+		else
+			this->real_fps = fps;
 	}
+
+	this->last_present = now;
+
+	return interval;
 }
 
 
-void player_play( player_t * this )
+/*!
+	\brief Fixed timestep accumulator: how many animation steps fit in the time just presented
+	\param this Player Object
+	\param frames Number of timeline periods presented (more than one after dropped frames)
+	\param interval Measured time since the previous frame, used when unthrottled
+	\return Number of animation steps to run on the next frame (zero repeats the frame)
+*/
+static int player_get_simulation_steps( player_t * this, int frames, uint64_t interval )
 {
-	struct timespec start;
-	struct timespec end;
+	double period = 0.0;
+	int steps = 0;
 
+	if( this->simulation_rate <= 0.0 )
+		return frames;
 
-	if( (this->state != stopped) && (this->state != paused) )
-		return;
+	if( !this->unthrottled && (this->fps != 0.0) )
+		this->simulation_time += frames * (1000000000L / fabs( this->fps ));
+	else
+		this->simulation_time += interval;
 
-	this->state = playing;
+	/* Never owe more than a bounded amount of simulation, slow animations would spiral */
+	if( this->simulation_time > PLAYER_SIMULATION_MAX_LAG )
+		this->simulation_time = PLAYER_SIMULATION_MAX_LAG;
 
-	animation_initialize( this->anim, this->screen_ncols, this->screen_nrows );
+	period = 1000000000L / this->simulation_rate;
 
-	while( this->state == playing )
-	{
-		/* Stopwatch Started */
-		clock_gettime( CLOCK_REALTIME, &start );
+	steps = this->simulation_time / period;
+
+	this->simulation_time -= steps * period;
+
+	return steps;
+}
 
-		/* Console Output */
-		//console_clear( this->console );
-		console_add_line( this->console, player_get_status_text( this ) );
 
+static uint64_t player_get_simulation_budget( player_t * this )
+{
+	if( !this->unthrottled && (this->fps != 0.0) )
+		return 1000000000L / fabs( this->fps );
+
+	return PLAYER_SIMULATION_MAX_LAG;
+}
+
+
+/*!
+	\brief Step the animation in the current direction, within the frame budget
+	\param this Player Object
+	\param steps Number of steps due
+	\return Number of steps actually run
+*/
+static int player_step_animation( player_t * this, int steps )
+{
+	uint64_t budget = 0;
+	int i = 0;
+
+	budget = player_get_time() + player_get_simulation_budget( this );
+
+	for( i = 0; i < steps; i++ )
+	{
 		if( this->fps > 0.0 )
 		{
 			/* Animation Forward */
@@ -453,23 +896,414 @@ void player_play( player_t * this )
 			animation_previous_frame( this->anim );
 		}
 
+		/* Simulation slower than requested, present what we have and drop the backlog */
+		if( (this->simulation_rate > 0.0) && (player_get_time() >= budget) )
+		{
+			__atomic_store_n( &this->simulation_late, 1, __ATOMIC_RELAXED );
+			return i + 1;
+		}
+	}
+
+	return steps;
+}
+
+
+/*!
+	\brief Frame bookkeeping once it is on screen: statistics, frame rate synchronization and stop conditions
+	\param this Player Object
+	\param start Time the frame started
+	\param mark Time the last stage ended
+*/
+static void player_end_frame( player_t * this, struct timespec * start, struct timespec * mark )
+{
+	uint64_t interval = 0;
+	int frames = 1;
+
+	histogram_record( this->stage_histogram[ player_stage_frame ], player_timespec_diff( start, mark ) );
+
+	/* Frame time delay */
+	if( !this->unthrottled && (this->fps != 0.0) )
+	{
+		frames = player_time_delay( this );
+		player_stage_end( this, player_stage_delay, mark );
+	}
+
+	interval = player_update_real_fps( this );
+
+	if( __atomic_exchange_n( &this->simulation_late, 0, __ATOMIC_RELAXED ) )
+		this->simulation_time = 0.0;
+
+	__atomic_store_n( &this->simulation_steps, player_get_simulation_steps( this, frames, interval ), __ATOMIC_RELAXED );
+
+	this->frames_count++;
+
+	if( this->frames_limit && (this->frames_count >= this->frames_limit) )
+		player_stop( this );
+
+	if( this->dump_requested )
+	{
+		this->dump_requested = 0;
+		player_dump_stats( this, stdout );
+	}
+}
+
+
+/*!
+	\brief Start counting the allocations of the play loop
+*/
+static void player_allocations_begin( player_t * this )
+{
+	pool_stats_t stats;
+
+	pool_get_stats( &stats );
+
+	this->frame_allocations = frame_get_allocations_count();
+	this->pool_allocations = stats.allocations;
+}
+
+
+/*!
+	\brief Stop counting the allocations of the play loop
+*/
+static void player_allocations_end( player_t * this )
+{
+	pool_stats_t stats;
+
+	pool_get_stats( &stats );
+
+	this->frame_allocations = frame_get_allocations_count() - this->frame_allocations;
+	this->pool_allocations = stats.allocations - this->pool_allocations;
+}
+
+
+static void player_play_serial( player_t * this )
+{
+	struct timespec start;
+	struct timespec mark;
+	int steps = 0;
+
+	/* Scratch frame the filter writes into, allocated once per run */
+	if( this->filter )
+		this->filtered = frame_duplicate( animation_get_frame( this->anim ) );
+
+	player_allocations_begin( this );
+
+	while( this->state == playing )
+	{
+		/* Stopwatch Started */
+		clock_gettime( CLOCK_MONOTONIC, &start );
+		mark = start;
+
+		steps = player_step_animation( this, this->simulation_steps );
+		player_stage_end( this, player_stage_animation, &mark );
+
+		/* Console Output */
+		//console_clear( this->console );
+		player_add_status_line( this, animation_get_frame_sequence( this->anim ), steps );
+
 		/* Set Palette */
 		player_set_palette( this, animation_get_palette( this->anim ) );
+		player_stage_end( this, player_stage_palette, &mark );
 
-		/* Render Frame */
-		player_render_frame( this, animation_get_frame( this->anim ) );
+		/* Filter and Render Frame */
+		player_render_frame( this, animation_get_frame( this->anim ), &mark );
 
 		/* Refresh Console */
 		player_refresh_console( this );
+		player_stage_end( this, player_stage_console, &mark );
+
+		player_end_frame( this, &start, &mark );
+	}
+
+	player_allocations_end( this );
+
+	if( this->filtered )
+		frame_destroy( this->filtered );
+
+	this->filtered = NULL;
+}
+
 
-		/* Stopwatch Finished */
-		clock_gettime( CLOCK_REALTIME, &end );
+/*!
+	\brief Pipeline stage 1: step the animation and snapshot its frame and palette into a free slot
+*/
+static void * player_simulation_thread( void * arg )
+{
+	player_t * this = (player_t*) arg;
+	player_slot_t * slot = NULL;
+	struct timespec mark;
+	int last = 0;
 
-		/* Frame time delay */
-		player_time_delay( this, player_timespec_diff( &start, &end ) );
+	do
+	{
+		slot = (player_slot_t*) queue_pop( this->free_slots );
+
+		/* The slot belongs to the next stage as soon as it is pushed */
+		last = ( __atomic_load_n( &this->state, __ATOMIC_RELAXED ) != playing );
+
+		slot->last = last;
+
+		if( !last )
+		{
+			clock_gettime( CLOCK_MONOTONIC, &mark );
+
+			slot->steps = player_step_animation( this, __atomic_load_n( &this->simulation_steps, __ATOMIC_RELAXED ) );
+			slot->sequence = animation_get_frame_sequence( this->anim );
+
+			frame_copy( slot->frame, animation_get_frame( this->anim ) );
+			palette_copy( slot->palette, animation_get_palette( this->anim ) );
+
+			player_stage_end( this, player_stage_animation, &mark );
+		}
+
+		queue_push( this->simulated_slots, slot );
 	}
+	while( !last );
+
+	return NULL;
+}
+
+
+/*!
+	\brief Pipeline stage 2: filter the frame of a simulated slot in place
+*/
+static void * player_filter_thread( void * arg )
+{
+	player_t * this = (player_t*) arg;
+	player_slot_t * slot = NULL;
+	struct timespec mark;
+	int last = 0;
+
+	do
+	{
+		slot = (player_slot_t*) queue_pop( this->simulated_slots );
+
+		last = slot->last;
+
+		if( !last && slot->filtered )
+		{
+			clock_gettime( CLOCK_MONOTONIC, &mark );
+
+			filter_set_palette( this->filter, slot->palette );
+			filter_frame( this->filter, slot->filtered, slot->frame );
+
+			player_stage_end( this, player_stage_filter, &mark );
+		}
+
+		queue_push( this->filtered_slots, slot );
+	}
+	while( !last );
+
+	return NULL;
+}
+
+
+static void player_pipeline_destroy( player_t * this )
+{
+	int i = 0;
+
+	for( i = 0; i < PLAYER_PIPELINE_DEPTH; i++ )
+	{
+		if( this->slot[i].frame )
+			frame_destroy( this->slot[i].frame );
+
+		if( this->slot[i].filtered )
+			frame_destroy( this->slot[i].filtered );
+
+		if( this->slot[i].palette )
+			palette_destroy( this->slot[i].palette );
+
+		this->slot[i].frame = NULL;
+		this->slot[i].filtered = NULL;
+		this->slot[i].palette = NULL;
+	}
+
+	if( this->free_slots )
+		queue_destroy( this->free_slots );
+
+	if( this->simulated_slots )
+		queue_destroy( this->simulated_slots );
+
+	if( this->filtered_slots )
+		queue_destroy( this->filtered_slots );
+
+	this->free_slots = NULL;
+	this->simulated_slots = NULL;
+	this->filtered_slots = NULL;
+}
+
+
+static int player_pipeline_create( player_t * this )
+{
+	int i = 0;
+
+	this->free_slots = queue_create( PLAYER_PIPELINE_DEPTH );
+	this->simulated_slots = queue_create( PLAYER_PIPELINE_DEPTH );
+	this->filtered_slots = queue_create( PLAYER_PIPELINE_DEPTH );
+
+	if( !this->free_slots || !this->simulated_slots || !this->filtered_slots )
+	{
+		player_pipeline_destroy( this );
+		return -1;
+	}
+
+	/* The whole pool is allocated up front and recycled, frames never get allocated while playing */
+	for( i = 0; i < PLAYER_PIPELINE_DEPTH; i++ )
+	{
+		this->slot[i].frame = frame_duplicate( animation_get_frame( this->anim ) );
+		this->slot[i].filtered = (this->filter) ? frame_duplicate( this->slot[i].frame ) : NULL;
+		this->slot[i].palette = palette_create();
+
+		if( !this->slot[i].frame || (this->filter && !this->slot[i].filtered) || !this->slot[i].palette )
+		{
+			player_pipeline_destroy( this );
+			return -1;
+		}
+
+		queue_push( this->free_slots, &this->slot[i] );
+	}
+
+	return 0;
+}
+
+
+/*!
+	\brief Pipeline stage 3 (caller thread): present the filtered slots and recycle them
+
+	The animation and the filter run on their own threads, one slot ahead of
+	each other, so the frame rate is bound by the slowest stage instead of
+	the sum of all of them. Presentation stays on the thread that owns the
+	screen.
+
+	\param this Player Object
+	\return 0 on success, -1 if the pipeline could not be started
+*/
+static int player_play_pipelined( player_t * this )
+{
+	pthread_t simulation;
+	pthread_t filter;
+	player_slot_t * slot = NULL;
+	struct timespec start;
+	struct timespec mark;
+	int last = 0;
+
+	if( player_pipeline_create( this ) )
+		return -1;
+
+	player_allocations_begin( this );
+
+	if( pthread_create( &simulation, NULL, player_simulation_thread, this ) )
+	{
+		player_pipeline_destroy( this );
+		return -1;
+	}
+
+	if( pthread_create( &filter, NULL, player_filter_thread, this ) )
+	{
+		/* Drain the simulation stage by hand */
+		player_stop( this );
+
+		do
+		{
+			slot = (player_slot_t*) queue_pop( this->simulated_slots );
+			last = slot->last;
+			queue_push( this->free_slots, slot );
+		}
+		while( !last );
+
+		pthread_join( simulation, NULL );
+		player_pipeline_destroy( this );
+		return -1;
+	}
+
+	for( ;; )
+	{
+		slot = (player_slot_t*) queue_pop( this->filtered_slots );
+
+		if( slot->last )
+			break;
+
+		/* Once stopped keep recycling until the end of the pipeline shows up */
+		if( this->state == playing )
+		{
+			clock_gettime( CLOCK_MONOTONIC, &start );
+			mark = start;
+
+			/* Console Output */
+			player_add_status_line( this, slot->sequence, slot->steps );
+
+			/* Set Palette */
+			player_set_palette( this, slot->palette );
+			player_stage_end( this, player_stage_palette, &mark );
+
+			/* Render Frame */
+			this->impl->render_frame( this, (slot->filtered) ? slot->filtered : slot->frame );
+			player_stage_end( this, player_stage_render, &mark );
+
+			/* Refresh Console */
+			player_refresh_console( this );
+			player_stage_end( this, player_stage_console, &mark );
+
+			player_end_frame( this, &start, &mark );
+		}
+
+		queue_push( this->free_slots, slot );
+	}
+
+	pthread_join( simulation, NULL );
+	pthread_join( filter, NULL );
+
+	player_allocations_end( this );
+
+	player_pipeline_destroy( this );
+
+	return 0;
+}
+
+
+void player_play( player_t * this )
+{
+	int i = 0;
+
+
+	if( (this->state != stopped) && (this->state != paused) )
+		return;
+
+	this->state = playing;
+	this->frames_count = 0;
+	this->real_fps = 0.0;
+	this->last_present = 0;
+	this->simulation_time = 0.0;
+	this->simulation_steps = 1;
+	this->simulation_late = 0;
+
+	/* Every run starts with a fresh pool and fresh statistics */
+	pool_reset();
+
+	for( i = 0; i < player_stage_count; i++ )
+		histogram_reset( this->stage_histogram[i] );
+
+	this->palette_uploads = 0;
+	this->palette_colors_uploaded = 0;
+
+	animation_initialize( this->anim, this->screen_ncols, this->screen_nrows );
+
+	player_timeline_reset( this, player_get_time() );
+
+	if( !this->pipelined || player_play_pipelined( this ) )
+		player_play_serial( this );
 
 	animation_finish( this->anim );
+
+#ifdef _DEBUG
+	if( this->frame_allocations )
+		fprintf( stderr, "Warning: %u frames were allocated while playing\n", this->frame_allocations );
+#endif
+
+	player_dump_stats( this, stdout );
+
+	if( this->stats_file && player_export_stats( this, this->stats_file ) )
+		fprintf( stderr, "Could not export player statistics to '%s'\n", this->stats_file );
 }
 
 
@@ -8,7 +8,11 @@
 #define __PLAYER_H__
 
 
+#include <stdio.h>
+#include <stdint.h>
+
 #include "frame.h"
+#include "histogram.h"
 #include "filter.h"
 #include "animation.h"
 #include "console.h"
@@ -47,6 +51,44 @@ enum player_screen_format_e
 	player_screen_format_graphic
 };
 
+/*!
+	\brief Player Frame Stage Type Definition
+*/
+typedef enum player_stage_e player_stage_t;
+
+
+/*!
+	\brief Player Catch-Up Policy Type Definition
+*/
+typedef enum player_catchup_e player_catchup_t;
+
+
+/*!
+	\brief Enumerate what the player does when it falls behind its deadline timeline
+*/
+enum player_catchup_e
+{
+	player_catchup_drop,       /*!< Keep the timeline: step the animation for every missed deadline, present once */
+	player_catchup_skip,       /*!< Keep the timeline: forget the missed deadlines, the animation slows down */
+	player_catchup_stretch     /*!< Restart the timeline at the late frame, time stretches */
+};
+
+
+/*!
+	\brief Enumerate the stages of a played frame
+*/
+enum player_stage_e
+{
+	player_stage_animation,    /*!< Animation step */
+	player_stage_filter,       /*!< Frame filtering */
+	player_stage_palette,      /*!< Palette upload */
+	player_stage_render,       /*!< Frame rendering */
+	player_stage_console,      /*!< Console refresh */
+	player_stage_delay,        /*!< Frame rate synchronization */
+	player_stage_frame,        /*!< Whole frame, all the stages but the delay */
+	player_stage_count
+};
+
 /*!
 	\brief Enumerate the player possible states
 */
@@ -68,9 +110,10 @@ struct player_implementation_s
 	void (*destroy)( player_t * );
 	int (*screen_initialize)( player_t * );
 	void (*screen_finish)(  player_t * );
-	void (*set_palette) ( player_t *, palette_t * );
+	void (*set_palette) ( player_t *, palette_t *, int first, int count );  /*!< Upload the colors [first, first + count) of the palette */
 	void (*render_frame)( player_t *, frame_t * );
 	void (*refresh_console)( player_t * );
+	void (*present)( player_t * );   /*!< Optional: show the frame and the console drawn so far, once per frame */
 };
 
 /*!
@@ -346,6 +389,193 @@ void player_set_description( player_t * this, const char * desc );
 
 const char * player_get_description( player_t * this );
 
+
+/*!
+	\brief Skip the frame rate synchronization (frames are played as fast as possible)
+	\param this
+	\param unthrottled
+*/
+void player_set_unthrottled( player_t * this, int unthrottled );
+
+
+/*!
+	\brief
+	\param this
+	\return
+*/
+int player_get_unthrottled( player_t * this );
+
+
+/*!
+	\brief Set the simulation rate, independent of the presentation rate (fps)
+
+	With a non-zero rate the animation is stepped on a fixed timestep of
+	1/rate seconds: several steps run per presented frame when the rate is
+	above the fps, and frames are presented again unchanged when it is below.
+	Zero ties one animation step to each presented frame.
+
+	\param this
+	\param rate Animation steps per second (zero follows the fps)
+*/
+void player_set_simulation_rate( player_t * this, double rate );
+
+
+/*!
+	\brief
+	\param this
+	\return
+*/
+double player_get_simulation_rate( player_t * this );
+
+
+/*!
+	\brief Run the animation, the filter and the presentation as a three stage pipeline
+
+	The animation and the filter get a thread each and hand frames over
+	through lock-free queues; the presentation stays on the calling thread.
+	Frames come from a small pool allocated when playing starts.
+
+	\param this
+	\param pipelined Non-zero enables the pipeline
+*/
+void player_set_pipelined( player_t * this, int pipelined );
+
+
+/*!
+	\brief
+	\param this
+	\return
+*/
+int player_get_pipelined( player_t * this );
+
+
+/*!
+	\brief Select the pixel depth of the screen
+
+	8 bits gives an indexed screen that takes palette uploads, 32 bits a
+	true color one where the player expands the palette into pixels itself,
+	which avoids the slow emulation of indexed modes by modern displays.
+	Players that only have indexed modes keep using 8 bits.
+
+	\param this
+	\param depth Bits per pixel: 8 or 32
+*/
+void player_set_color_depth( player_t * this, int depth );
+
+
+/*!
+	\brief
+	\param this
+	\return Bits per pixel
+*/
+int player_get_color_depth( player_t * this );
+
+
+/*!
+	\brief Set what the player does when a frame misses its deadline
+	\param this
+	\param policy
+*/
+void player_set_catchup_policy( player_t * this, player_catchup_t policy );
+
+
+/*!
+	\brief
+	\param this
+	\return
+*/
+player_catchup_t player_get_catchup_policy( player_t * this );
+
+
+/*!
+	\brief Stop playing after a fixed number of frames (zero plays forever)
+	\param this
+	\param nframes
+*/
+void player_set_frames_limit( player_t * this, int nframes );
+
+
+/*!
+	\brief
+	\param this
+	\return
+*/
+int player_get_frames_limit( player_t * this );
+
+
+/*!
+	\brief Get the number of frames played since player_play() was called
+	\param this
+	\return
+*/
+int player_get_frames_count( player_t * this );
+
+
+/*!
+	\brief Number of frames created by the last play loop once it was running (zero in steady state)
+	\param this
+	\return Frames count
+*/
+unsigned int player_get_frame_allocations( player_t * this );
+
+
+/*!
+	\brief Get the accumulated time spent in a frame stage
+	\param this
+	\param stage
+	\return Time in nanoseconds
+*/
+uint64_t player_get_stage_time( player_t * this, player_stage_t stage );
+
+
+/*!
+	\brief Get the histogram of the time spent in a frame stage (nanoseconds)
+	\param this
+	\param stage
+	\return
+*/
+histogram_t * player_get_stage_histogram( player_t * this, player_stage_t stage );
+
+
+/*!
+	\brief Print the frame stages statistics (p50/p99/p99.9/max)
+	\param this
+	\param stream
+*/
+void player_dump_stats( player_t * this, FILE * stream );
+
+
+/*!
+	\brief Ask the player to dump its statistics on the next frame (async-signal-safe)
+	\param this
+*/
+void player_request_stats_dump( player_t * this );
+
+
+/*!
+	\brief Export the frame stages statistics to a file when the play is over
+	\param this
+	\param filename CSV file, or JSON if the name ends with ".json" (NULL disables it)
+*/
+void player_set_stats_file( player_t * this, const char * filename );
+
+
+/*!
+	\brief Write the frame stages statistics to a file
+	\param this
+	\param filename CSV file, or JSON if the name ends with ".json"
+	\return Zero on success and non-zero on failure
+*/
+int player_export_stats( player_t * this, const char * filename );
+
+
+/*!
+	\brief Get a printable name of a frame stage
+	\param stage
+	\return
+*/
+const char * player_get_stage_name( player_stage_t stage );
+
 #ifdef __cplusplus
 }
 #endif
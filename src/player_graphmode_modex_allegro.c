@@ -35,7 +35,7 @@ static player_t * player_graphmode_modex_allegro_create( player_t * parent );
 static void player_graphmode_modex_allegro_destroy( player_t * this );
 static int player_graphmode_modex_allegro_initialize( player_t * this );
 static void player_graphmode_modex_allegro_finish( player_t * this );
-static void player_graphmode_modex_allegro_set_palette( player_t * this, palette_t * pal );
+static void player_graphmode_modex_allegro_set_palette( player_t * this, palette_t * pal, int first, int count );
 static void player_graphmode_modex_allegro_render_frame( player_t * this, frame_t * frm );
 static void player_graphmode_modex_allegro_refresh_console( player_t * this );
 
@@ -176,20 +176,16 @@ static void player_graphmode_modex_allegro_finish( player_t * this )
 }
 
 
-static void player_graphmode_modex_allegro_set_palette( player_t * this, palette_t * pal )
+static void player_graphmode_modex_allegro_set_palette( player_t * this, palette_t * pal, int first, int count )
 {
 	int i = 0;
-	int count = 0;
 	PALETTE palette;
 
-	count = palette_get_color_count( pal );
-
-	for( i = 0; i < count; i++ )
+	for( i = first; i < first + count; i++ )
 		palette_get_color( pal, i, &palette[i].r, &palette[i].g, &palette[i].b );
 
-	vsync();
-
-	set_palette( palette );
+	/* Only the changed entries, synchronized with the vertical retrace */
+	set_palette_range( palette, first, first + count - 1, TRUE );
 }
 
 
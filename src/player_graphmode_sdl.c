@@ -7,6 +7,7 @@
 #include <SDL.h>
 #include <SDL_ttf.h>
 
+#include "pool.h"
 #include "frame.h"
 #include "player.h"
 #include "player_graphmode_sdl.h"
@@ -17,12 +18,26 @@
 #define PLAYER_GRAPHMODE_SDL_ROWS_COUNT            (480)
 #define PLAYER_GRAPHMODE_SDL_FONT_SIZE             (8)
 #define PLAYER_GRAPHMODE_SDL_FONT_FILE             "./felix.ttf"
+#define PLAYER_GRAPHMODE_SDL_COLOR_COUNT           (256)
+#define PLAYER_GRAPHMODE_SDL_FIRST_GLYPH           (0x20)
+#define PLAYER_GRAPHMODE_SDL_GLYPH_COUNT           (0x7F - PLAYER_GRAPHMODE_SDL_FIRST_GLYPH)
+#define PLAYER_GRAPHMODE_SDL_MISSING_GLYPH         ('?')
+#define PLAYER_GRAPHMODE_SDL_LINE_LEN              (128)
 
 
 struct player_graphmode_sdl_data_s
 {
 	SDL_Surface * screen;
 	TTF_Font * font;
+	int depth;
+	Uint32 lut[ PLAYER_GRAPHMODE_SDL_COLOR_COUNT ];   /*!< Palette expanded into screen pixels (32 bits) */
+	SDL_Surface * atlas;                              /*!< Printable ASCII glyphs rendered once, side by side */
+	int glyph_width;                                  /*!< Width of a glyph cell in the atlas */
+	int glyph_advance[ PLAYER_GRAPHMODE_SDL_GLYPH_COUNT ];
+	int font_height;
+	int nlines;
+	char * lines;                                     /*!< Console text on the screen, one line every LINE_LEN */
+	int lines_valid;
 };
 
 typedef struct player_graphmode_sdl_data_s player_graphmode_sdl_data_t;
@@ -32,9 +47,10 @@ static player_t * player_graphmode_sdl_create( player_t * parent );
 static void player_graphmode_sdl_destroy( player_t * this );
 static int player_graphmode_sdl_initialize( player_t * this );
 static void player_graphmode_sdl_finish( player_t * this );
-static void player_graphmode_sdl_set_palette( player_t * this, palette_t * pal );
+static void player_graphmode_sdl_set_palette( player_t * this, palette_t * pal, int first, int count );
 static void player_graphmode_sdl_render_frame( player_t * this, frame_t * frm );
 static void player_graphmode_sdl_refresh_console( player_t * this );
+static void player_graphmode_sdl_present( player_t * this );
 
 
 player_implementation_t * player_graphmode_sdl_get_implementation( void )
@@ -48,6 +64,7 @@ player_implementation_t * player_graphmode_sdl_get_implementation( void )
 	impl.set_palette = player_graphmode_sdl_set_palette;
 	impl.render_frame = player_graphmode_sdl_render_frame;
 	impl.refresh_console = player_graphmode_sdl_refresh_console;
+	impl.present = player_graphmode_sdl_present;
 
 	return &impl;
 };
@@ -98,6 +115,88 @@ static void player_graphmode_sdl_destroy( player_t * this )
 }
 
 
+static void player_graphmode_sdl_release_console( player_graphmode_sdl_data_t * data )
+{
+	if( data->atlas )
+		SDL_FreeSurface( data->atlas );
+
+	pool_free( data->lines );
+
+	data->atlas = NULL;
+	data->lines = NULL;
+	data->nlines = 0;
+	data->lines_valid = 0;
+}
+
+
+/* Renders every printable glyph once, console lines are then made of rectangles of this surface */
+static int player_graphmode_sdl_build_atlas( player_graphmode_sdl_data_t * data )
+{
+	int i = 0;
+	int row = 0;
+	int w = 0;
+	int h = 0;
+	char str[2] = { 0, 0 };
+	SDL_Surface * glyph = NULL;
+	SDL_Color color = { .r = 255, .g = 255, .b = 255 };
+
+	data->font_height = TTF_FontHeight( data->font );
+	data->glyph_width = 0;
+
+	for( i = 0; i < PLAYER_GRAPHMODE_SDL_GLYPH_COUNT; i++ )
+	{
+		str[0] = PLAYER_GRAPHMODE_SDL_FIRST_GLYPH + i;
+
+		if( TTF_SizeText( data->font, str, &w, &h ) )
+			w = 0;
+
+		data->glyph_advance[i] = w;
+
+		if( w > data->glyph_width )
+			data->glyph_width = w;
+	}
+
+	if( !data->glyph_width || (data->font_height <= 0) )
+		return -1;
+
+	data->atlas = SDL_CreateRGBSurface( SDL_SWSURFACE, data->glyph_width * PLAYER_GRAPHMODE_SDL_GLYPH_COUNT, data->font_height, 8, 0, 0, 0, 0 );
+
+	if( !data->atlas )
+		return -1;
+
+	SDL_FillRect( data->atlas, NULL, 0 );
+
+	for( i = 0; i < PLAYER_GRAPHMODE_SDL_GLYPH_COUNT; i++ )
+	{
+		str[0] = PLAYER_GRAPHMODE_SDL_FIRST_GLYPH + i;
+
+		/* Rendered as text, so that glyphs sit on the baseline like in a line */
+		glyph = TTF_RenderText_Solid( data->font, str, color );
+
+		if( !glyph )
+			continue;
+
+		/* Solid glyphs are 8-bit: 0 is the background, the other colors are the same for every glyph */
+		if( !i )
+			SDL_SetColors( data->atlas, glyph->format->palette->colors, 0, glyph->format->palette->ncolors );
+
+		w = (glyph->w < data->glyph_width) ? glyph->w : data->glyph_width;
+		h = (glyph->h < data->font_height) ? glyph->h : data->font_height;
+
+		for( row = 0; row < h; row++ )
+			memcpy( (Uint8*) data->atlas->pixels + row * data->atlas->pitch + i * data->glyph_width,
+					(Uint8*) glyph->pixels + row * glyph->pitch,
+					w );
+
+		SDL_FreeSurface( glyph );
+	}
+
+	SDL_SetColorKey( data->atlas, SDL_SRCCOLORKEY, 0 );
+
+	return 0;
+}
+
+
 static int player_graphmode_sdl_initialize( player_t * this )
 {
 	int nlines = 0;
@@ -133,16 +232,38 @@ static int player_graphmode_sdl_initialize( player_t * this )
 	SDL_WM_SetCaption(	PLAYER_GRAPHMODE_SDL_DESC,
 						"FelixTheCat" );
 
+	data->depth = (player_get_color_depth( this ) == 32) ? 32 : 8;
+
+	/* Indexed surfaces are emulated by most displays, true color ones are blitted as they are */
 	data->screen = SDL_SetVideoMode( 	player_get_real_cols_count(this),
 										player_get_real_rows_count(this),
-										8,
-										SDL_DOUBLEBUF | SDL_SWSURFACE | SDL_HWPALETTE );
+										data->depth,
+										SDL_DOUBLEBUF | SDL_SWSURFACE | ((data->depth == 8) ? SDL_HWPALETTE : 0) );
 	if( !data->screen )
 	{
 		SDL_Quit();
 		return -1;
 	}
 
+	if( data->screen->format->BitsPerPixel != data->depth )
+	{
+		SDL_Quit();
+		return -1;
+	}
+
+	if( con && nlines )
+	{
+		data->nlines = nlines;
+		data->lines = (char*) pool_calloc( nlines, PLAYER_GRAPHMODE_SDL_LINE_LEN );
+
+		if( !data->lines || player_graphmode_sdl_build_atlas( data ) )
+		{
+			player_graphmode_sdl_release_console( data );
+			SDL_Quit();
+			return -1;
+		}
+	}
+
 	return 0;
 }
 
@@ -151,31 +272,39 @@ static void player_graphmode_sdl_finish( player_t * this )
 {
 	player_graphmode_sdl_data_t * data = player_get_data( this );
 
+	player_graphmode_sdl_release_console( data );
+
 	SDL_FreeSurface( data->screen );
 	SDL_Quit();
 }
 
 
-static void player_graphmode_sdl_set_palette( player_t * this, palette_t * pal )
+static void player_graphmode_sdl_set_palette( player_t * this, palette_t * pal, int first, int count )
 {
 	int i = 0;
 	uint8_t red = 0;
 	uint8_t green = 0;
 	uint8_t blue = 0;
-	int count = 0;
 	SDL_Color * colors = NULL;
+	SDL_PixelFormat * fmt = NULL;
 	player_graphmode_sdl_data_t * data = player_get_data( this );
 
-	count = palette_get_color_count( pal );
+	if( data->depth == 32 )
+	{
+		fmt = data->screen->format;
+
+		palette_expand( pal, data->lut, first, count, fmt->Rshift, fmt->Gshift, fmt->Bshift, fmt->Amask );
+		return;
+	}
 
-	colors = (SDL_Color*) calloc( count, sizeof(SDL_Color) );
+	colors = (SDL_Color*) pool_calloc( count, sizeof(SDL_Color) );
 
 	if(!colors)
 		return;
 
 	for( i = 0; i < count; i++ )
 	{
-		palette_get_color( pal, i, &red, &green, &blue );
+		palette_get_color( pal, first + i, &red, &green, &blue );
 
 		colors[i].r = red;
 		colors[i].g = green;
@@ -184,89 +313,157 @@ static void player_graphmode_sdl_set_palette( player_t * this, palette_t * pal )
 
 	SDL_SetColors(	data->screen,
 					colors,
-					0,
+					first,
 					count );
 
-	free( colors );
+	pool_free( colors );
+
+	/* The text was drawn with the screen colors closest to its own, which may just have moved */
+	data->lines_valid = 0;
 }
 
 
 static void player_graphmode_sdl_render_frame( player_t * this, frame_t * frm )
 {
-	int col = 0;
-	int row = 0;
 	int ncols = 0;
 	int nrows = 0;
-	Uint8 * video_buffer = NULL;
-	int i = 0;
-	frame_point_t pt;
+	int scr_ncols = 0;
+	int scr_nrows = 0;
+	frame_rect_t area = { .col = 0, .row = 0, .ncols = 0, .nrows = 0 };
+	SDL_Rect uncovered = { .x = 0, .y = 0, .w = 0, .h = 0 };
 	player_graphmode_sdl_data_t * data = player_get_data( this );
+	SDL_Surface * screen = data->screen;
 
 	frame_get_dimensions( frm, &ncols, &nrows );
+	player_get_screen_dimensions( this, &scr_ncols, &scr_nrows );
 
-	video_buffer = (Uint8*) data->screen->pixels;
+	/* Only the part of the frame that fits the screen area above the console is drawn */
+	area.ncols = (ncols < scr_ncols) ? ncols : scr_ncols;
+	area.nrows = (nrows < scr_nrows) ? nrows : scr_nrows;
 
-	for( row = 0; row < nrows; row++ )
+	/* A smaller frame leaves part of that area uncovered (fills need an unlocked surface) */
+	if( area.ncols < scr_ncols )
 	{
-		for( col = 0; col < ncols; col++ )
-		{
-			frame_get_point( frm, col, row, &pt );
-			video_buffer[ i++ ] = pt.color;
-		}
+		uncovered.x = area.ncols;
+		uncovered.y = 0;
+		uncovered.w = scr_ncols - area.ncols;
+		uncovered.h = scr_nrows;
+
+		SDL_FillRect( screen, &uncovered, 0 );
 	}
 
-	SDL_Flip( data->screen );
+	if( area.nrows < scr_nrows )
+	{
+		uncovered.x = 0;
+		uncovered.y = area.nrows;
+		uncovered.w = area.ncols;
+		uncovered.h = scr_nrows - area.nrows;
+
+		SDL_FillRect( screen, &uncovered, 0 );
+	}
+
+	if( SDL_MUSTLOCK( screen ) && (SDL_LockSurface( screen ) < 0) )
+		return;
+
+	/* Rows go straight into the surface, a pitch apart */
+	if( data->depth == 32 )
+		frame_pack_pixels( frm, &area, (Uint32*) screen->pixels, screen->pitch, data->lut );
+	else
+		frame_pack_colors( frm, &area, (Uint8*) screen->pixels, screen->pitch );
+
+	if( SDL_MUSTLOCK( screen ) )
+		SDL_UnlockSurface( screen );
+}
+
+
+static void player_graphmode_sdl_draw_text( player_graphmode_sdl_data_t * data, const char * text, int xpos, int ypos, int xdim )
+{
+	int idx = 0;
+	int x = xpos;
+	SDL_Rect glyph = { .x = 0, .y = 0, .w = 0, .h = 0 };
+	SDL_Rect location = { .x = 0, .y = 0, .w = 0, .h = 0 };
+
+	for( ; *text && (x < xpos + xdim); text++ )
+	{
+		idx = (unsigned char) *text - PLAYER_GRAPHMODE_SDL_FIRST_GLYPH;
+
+		if( (idx < 0) || (idx >= PLAYER_GRAPHMODE_SDL_GLYPH_COUNT) )
+			idx = PLAYER_GRAPHMODE_SDL_MISSING_GLYPH - PLAYER_GRAPHMODE_SDL_FIRST_GLYPH;
+
+		glyph.x = idx * data->glyph_width;
+		glyph.w = data->glyph_advance[ idx ];
+		glyph.h = data->font_height;
+
+		if( x + glyph.w > xpos + xdim )
+			glyph.w = xpos + xdim - x;
+
+		location.x = x;
+		location.y = ypos;
+
+		SDL_BlitSurface( data->atlas, &glyph, data->screen, &location );
+
+		x += data->glyph_advance[ idx ];
+	}
 }
 
 
 static void player_graphmode_sdl_refresh_console( player_t * this )
 {
 	int i = 0;
-	int txt_height = 0;
 	int count = 0;
 	int ydim = 0;
 	int ypos = 0;
 	int xdim = 0;
 	int xpos = 0;
-	SDL_Surface * text = NULL;
-	SDL_Color color = { .r = 255, .g = 255, .b = 255 };
+	char * cached = NULL;
+	const char * text = NULL;
 	SDL_Rect location = { .x = 0, .y = 0, .w = 0, .h = 0 };
 	player_graphmode_sdl_data_t * data = player_get_data( this );
 	console_t * con = player_get_console( this );
 
-	if( !con )
+	if( !con || !data->atlas )
 		return;
 
 	player_get_console_position( this, &xpos, &ypos );
 	player_get_console_dimension( this, &xdim, &ydim );
 
-	txt_height = TTF_FontHeight(data->font);
 	count = console_get_lines_count( con );
 
-	location.x = xpos;
-	location.y = ypos;
-	location.w = xdim;
-	location.h = ydim;
-
-	SDL_FillRect( data->screen, &location, 0 );
+	if( count > data->nlines )
+		count = data->nlines;
 
+	/* The console area keeps its pixels between frames, only the lines whose text changed are drawn again */
 	for( i = 0; i < count; i++ )
 	{
-		text = TTF_RenderText_Solid(	data->font,
-										console_get_line( con, i ),
-										color );
+		text = console_get_line( con, i );
+		cached = data->lines + i * PLAYER_GRAPHMODE_SDL_LINE_LEN;
+
+		if( !text )
+			text = "";
+
+		if( data->lines_valid && !strncmp( cached, text, PLAYER_GRAPHMODE_SDL_LINE_LEN - 1 ) )
+			continue;
 
 		location.x = xpos;
-		location.y = ypos + (txt_height * i);
+		location.y = ypos + (data->font_height * i);
 		location.w = xdim;
-		location.h = txt_height;
+		location.h = data->font_height;
+
+		SDL_FillRect( data->screen, &location, 0 );
+
+		player_graphmode_sdl_draw_text( data, text, xpos, location.y, xdim );
 
-		SDL_BlitSurface(	text,
-							NULL,
-							data->screen,
-							&location );
+		strncpy( cached, text, PLAYER_GRAPHMODE_SDL_LINE_LEN - 1 );
 	}
 
+	data->lines_valid = 1;
+}
+
+
+static void player_graphmode_sdl_present( player_t * this )
+{
+	player_graphmode_sdl_data_t * data = player_get_data( this );
+
 	SDL_Flip( data->screen );
 }
 
@@ -0,0 +1,440 @@
+/*!
+	\file player_graphmode_sdl2.c
+	\brief Animation Player in Graphical Mode Object (SDL2)
+
+	Frames are expanded into 32-bit pixels straight into a streaming
+	texture and the renderer scales them to the window by an integer
+	factor, so the CPU never touches more than one pixel per point. When
+	no accelerated renderer is available (e.g. SDL_VIDEODRIVER=dummy on a
+	machine without a display) the software renderer is used instead.
+
+	\author Tiago Ventura (tiago.ventura@gmail.com)
+*/
+
+#include <string.h>
+
+#include <SDL.h>
+#include <SDL_ttf.h>
+
+#include "pool.h"
+#include "frame.h"
+#include "palette.h"
+#include "player.h"
+#include "player_graphmode_sdl2.h"
+
+
+#define PLAYER_GRAPHMODE_SDL2_DESC                 "Streaming Texture 32-bit (SDL2)"
+#define PLAYER_GRAPHMODE_SDL2_COLS_COUNT           (640)
+#define PLAYER_GRAPHMODE_SDL2_ROWS_COUNT           (480)
+#define PLAYER_GRAPHMODE_SDL2_FONT_SIZE            (8)
+#define PLAYER_GRAPHMODE_SDL2_FONT_FILE            "./felix.ttf"
+#define PLAYER_GRAPHMODE_SDL2_COLOR_COUNT          (256)
+#define PLAYER_GRAPHMODE_SDL2_MAX_SCALE            (16)
+#define PLAYER_GRAPHMODE_SDL2_LINE_LEN             (128)
+
+
+struct player_graphmode_sdl2_data_s
+{
+	SDL_Window * window;
+	SDL_Renderer * renderer;
+	SDL_Texture * texture;                                 /*!< Frame, written while locked */
+	SDL_Texture * console_texture;
+	SDL_Surface * console_surface;                         /*!< Console text is drawn here, then uploaded */
+	int nlines;
+	char * lines;                                          /*!< Console text in the texture, one line every LINE_LEN */
+	int lines_valid;
+	TTF_Font * font;
+	int scale;
+	int vsync;
+	Uint32 lut[ PLAYER_GRAPHMODE_SDL2_COLOR_COUNT ];       /*!< Palette expanded into ARGB8888 pixels */
+};
+
+typedef struct player_graphmode_sdl2_data_s player_graphmode_sdl2_data_t;
+
+
+static player_t * player_graphmode_sdl2_create( player_t * parent );
+static void player_graphmode_sdl2_destroy( player_t * this );
+static int player_graphmode_sdl2_initialize( player_t * this );
+static void player_graphmode_sdl2_finish( player_t * this );
+static void player_graphmode_sdl2_set_palette( player_t * this, palette_t * pal, int first, int count );
+static void player_graphmode_sdl2_render_frame( player_t * this, frame_t * frm );
+static void player_graphmode_sdl2_refresh_console( player_t * this );
+static void player_graphmode_sdl2_present( player_t * this );
+
+
+player_implementation_t * player_graphmode_sdl2_get_implementation( void )
+{
+	static player_implementation_t impl;
+
+	impl.create = player_graphmode_sdl2_create;
+	impl.destroy = player_graphmode_sdl2_destroy;
+	impl.screen_initialize = player_graphmode_sdl2_initialize;
+	impl.screen_finish = player_graphmode_sdl2_finish;
+	impl.set_palette = player_graphmode_sdl2_set_palette;
+	impl.render_frame = player_graphmode_sdl2_render_frame;
+	impl.refresh_console = player_graphmode_sdl2_refresh_console;
+	impl.present = player_graphmode_sdl2_present;
+
+	return &impl;
+};
+
+
+void player_graphmode_sdl2_set_scale( player_t * this, int scale )
+{
+	player_graphmode_sdl2_data_t * data = player_get_data( this );
+
+	if( scale < 1 )
+		scale = 1;
+
+	if( scale > PLAYER_GRAPHMODE_SDL2_MAX_SCALE )
+		scale = PLAYER_GRAPHMODE_SDL2_MAX_SCALE;
+
+	data->scale = scale;
+}
+
+
+void player_graphmode_sdl2_set_vsync( player_t * this, int vsync )
+{
+	player_graphmode_sdl2_data_t * data = player_get_data( this );
+
+	data->vsync = vsync;
+}
+
+
+static player_t * player_graphmode_sdl2_create( player_t * parent )
+{
+	player_graphmode_sdl2_data_t * data = NULL;
+
+	data = (player_graphmode_sdl2_data_t*) calloc( 1, sizeof(player_graphmode_sdl2_data_t) );
+
+	if( !data )
+		return NULL;
+
+	if( TTF_Init() == -1 )
+	{
+		free( data );
+		return NULL;
+	}
+
+	data->font = TTF_OpenFont( PLAYER_GRAPHMODE_SDL2_FONT_FILE, PLAYER_GRAPHMODE_SDL2_FONT_SIZE );
+
+	if( !data->font )
+	{
+		TTF_Quit();
+		free( data );
+
+		return NULL;
+	}
+
+	data->scale = 1;
+	data->vsync = 0;
+
+	player_set_data( parent, (void*) data );
+	player_set_description( parent, PLAYER_GRAPHMODE_SDL2_DESC );
+	player_set_screen_format( parent, player_screen_format_graphic );
+	player_set_screen_cols_count( parent, PLAYER_GRAPHMODE_SDL2_COLS_COUNT );
+	player_set_screen_rows_count( parent, PLAYER_GRAPHMODE_SDL2_ROWS_COUNT );
+
+	return parent;
+}
+
+
+static void player_graphmode_sdl2_destroy( player_t * this )
+{
+	player_graphmode_sdl2_data_t * data = player_get_data( this );
+
+	TTF_CloseFont( data->font );
+	TTF_Quit();
+
+	free( data );
+}
+
+
+static void player_graphmode_sdl2_release( player_graphmode_sdl2_data_t * data )
+{
+	if( data->console_surface )
+		SDL_FreeSurface( data->console_surface );
+
+	pool_free( data->lines );
+	data->lines = NULL;
+	data->nlines = 0;
+	data->lines_valid = 0;
+
+	if( data->console_texture )
+		SDL_DestroyTexture( data->console_texture );
+
+	if( data->texture )
+		SDL_DestroyTexture( data->texture );
+
+	if( data->renderer )
+		SDL_DestroyRenderer( data->renderer );
+
+	if( data->window )
+		SDL_DestroyWindow( data->window );
+
+	data->console_surface = NULL;
+	data->console_texture = NULL;
+	data->texture = NULL;
+	data->renderer = NULL;
+	data->window = NULL;
+
+	SDL_Quit();
+}
+
+
+static int player_graphmode_sdl2_initialize( player_t * this )
+{
+	int nlines = 0;
+	int ncols = 0;
+	int nrows = 0;
+	int font_width = 0;
+	int font_height = 0;
+	int con_nrows = 0;
+	Uint32 flags = 0;
+	player_graphmode_sdl2_data_t * data = player_get_data( this );
+	console_t * con = player_get_console( this );
+
+	if(con)
+		nlines = console_get_lines_count( con );
+
+	TTF_SizeText(	data->font,
+					"\x20",
+					&font_width,
+					&font_height );
+
+	player_get_screen_dimensions( this, &ncols, &nrows );
+
+	con_nrows = font_height * nlines;
+
+	player_set_real_cols_count( this, ncols );
+	player_set_real_rows_count( this, nrows + con_nrows );
+
+	if(con)
+	{
+		player_set_console_dimension( this, ncols, con_nrows );
+		player_set_console_position( this, 0, nrows );
+	}
+
+	if(SDL_Init( SDL_INIT_VIDEO ))
+		return -1;
+
+	data->window = SDL_CreateWindow(	PLAYER_GRAPHMODE_SDL2_DESC,
+										SDL_WINDOWPOS_UNDEFINED,
+										SDL_WINDOWPOS_UNDEFINED,
+										player_get_real_cols_count(this) * data->scale,
+										player_get_real_rows_count(this) * data->scale,
+										0 );
+	if( !data->window )
+	{
+		player_graphmode_sdl2_release( data );
+		return -1;
+	}
+
+	flags = SDL_RENDERER_ACCELERATED | ((data->vsync) ? SDL_RENDERER_PRESENTVSYNC : 0);
+
+	data->renderer = SDL_CreateRenderer( data->window, -1, flags );
+
+	/* No GPU (or no display at all): the software renderer still does the scaling */
+	if( !data->renderer )
+		data->renderer = SDL_CreateRenderer( data->window, -1, SDL_RENDERER_SOFTWARE );
+
+	if( !data->renderer )
+	{
+		player_graphmode_sdl2_release( data );
+		return -1;
+	}
+
+	/* Integer scaling by the renderer, sharp pixels */
+	SDL_SetHint( SDL_HINT_RENDER_SCALE_QUALITY, "nearest" );
+	SDL_RenderSetLogicalSize( data->renderer, player_get_real_cols_count(this), player_get_real_rows_count(this) );
+	SDL_RenderSetIntegerScale( data->renderer, SDL_TRUE );
+
+	data->texture = SDL_CreateTexture(	data->renderer,
+										SDL_PIXELFORMAT_ARGB8888,
+										SDL_TEXTUREACCESS_STREAMING,
+										ncols,
+										nrows );
+	if( !data->texture )
+	{
+		player_graphmode_sdl2_release( data );
+		return -1;
+	}
+
+	/* ARGB8888 textures are created blended, the frame is opaque whatever its alpha byte */
+	SDL_SetTextureBlendMode( data->texture, SDL_BLENDMODE_NONE );
+
+	if( con && con_nrows )
+	{
+		data->console_surface = SDL_CreateRGBSurface( 0, ncols, con_nrows, 32, 0x00FF0000, 0x0000FF00, 0x000000FF, 0 );
+
+		data->console_texture = SDL_CreateTexture(	data->renderer,
+													SDL_PIXELFORMAT_ARGB8888,
+													SDL_TEXTUREACCESS_STREAMING,
+													ncols,
+													con_nrows );
+
+		data->nlines = nlines;
+		data->lines = (char*) pool_calloc( nlines, PLAYER_GRAPHMODE_SDL2_LINE_LEN );
+
+		if( !data->console_surface || !data->console_texture || !data->lines )
+		{
+			player_graphmode_sdl2_release( data );
+			return -1;
+		}
+
+		/* The console surface has no alpha, uploaded it would be fully transparent */
+		SDL_SetTextureBlendMode( data->console_texture, SDL_BLENDMODE_NONE );
+	}
+
+	return 0;
+}
+
+
+static void player_graphmode_sdl2_finish( player_t * this )
+{
+	player_graphmode_sdl2_release( player_get_data( this ) );
+}
+
+
+static void player_graphmode_sdl2_set_palette( player_t * this, palette_t * pal, int first, int count )
+{
+	player_graphmode_sdl2_data_t * data = player_get_data( this );
+
+	/* Texture renderers have no indexed formats: the palette becomes a table of pixels */
+	palette_expand( pal, data->lut, first, count, 16, 8, 0, 0xFF000000 );
+}
+
+
+static void player_graphmode_sdl2_render_frame( player_t * this, frame_t * frm )
+{
+	int ncols = 0;
+	int nrows = 0;
+	int scr_ncols = 0;
+	int scr_nrows = 0;
+	int pitch = 0;
+	int row = 0;
+	void * pixels = NULL;
+	frame_rect_t area = { .col = 0, .row = 0, .ncols = 0, .nrows = 0 };
+	player_graphmode_sdl2_data_t * data = player_get_data( this );
+
+	frame_get_dimensions( frm, &ncols, &nrows );
+	player_get_screen_dimensions( this, &scr_ncols, &scr_nrows );
+
+	area.ncols = (ncols < scr_ncols) ? ncols : scr_ncols;
+	area.nrows = (nrows < scr_nrows) ? nrows : scr_nrows;
+
+	if( SDL_LockTexture( data->texture, NULL, &pixels, &pitch ) < 0 )
+		return;
+
+	/* A locked streaming texture holds garbage, whatever the frame does not cover is cleared */
+	if( (area.ncols < scr_ncols) || (area.nrows < scr_nrows) )
+		for( row = 0; row < scr_nrows; row++ )
+			memset( (Uint8*) pixels + (size_t) row * pitch, 0, scr_ncols * sizeof(Uint32) );
+
+	frame_pack_pixels( frm, &area, (Uint32*) pixels, pitch, data->lut );
+
+	SDL_UnlockTexture( data->texture );
+}
+
+
+static void player_graphmode_sdl2_refresh_console( player_t * this )
+{
+	int i = 0;
+	int txt_height = 0;
+	int count = 0;
+	int changed = 0;
+	char * cached = NULL;
+	const char * line = NULL;
+	SDL_Surface * text = NULL;
+	SDL_Color color = { .r = 255, .g = 255, .b = 255, .a = 255 };
+	SDL_Rect location = { .x = 0, .y = 0, .w = 0, .h = 0 };
+	player_graphmode_sdl2_data_t * data = player_get_data( this );
+	console_t * con = player_get_console( this );
+
+	if( !con || !data->console_surface )
+		return;
+
+	txt_height = TTF_FontHeight(data->font);
+	count = console_get_lines_count( con );
+
+	if( count > data->nlines )
+		count = data->nlines;
+
+	/* Only the lines whose text changed are rendered again */
+	for( i = 0; i < count; i++ )
+	{
+		line = console_get_line( con, i );
+		cached = data->lines + i * PLAYER_GRAPHMODE_SDL2_LINE_LEN;
+
+		if( !line )
+			line = "";
+
+		if( data->lines_valid && !strncmp( cached, line, PLAYER_GRAPHMODE_SDL2_LINE_LEN - 1 ) )
+			continue;
+
+		location.x = 0;
+		location.y = txt_height * i;
+		location.w = data->console_surface->w;
+		location.h = txt_height;
+
+		SDL_FillRect( data->console_surface, &location, 0 );
+
+		text = (*line) ? TTF_RenderText_Solid( data->font, line, color ) : NULL;
+
+		if( text )
+		{
+			SDL_BlitSurface(	text,
+								NULL,
+								data->console_surface,
+								&location );
+
+			SDL_FreeSurface( text );
+		}
+
+		strncpy( cached, line, PLAYER_GRAPHMODE_SDL2_LINE_LEN - 1 );
+		changed = 1;
+	}
+
+	data->lines_valid = 1;
+
+	if( !changed )
+		return;
+
+	SDL_UpdateTexture(	data->console_texture,
+						NULL,
+						data->console_surface->pixels,
+						data->console_surface->pitch );
+}
+
+
+static void player_graphmode_sdl2_present( player_t * this )
+{
+	int scr_ncols = 0;
+	int scr_nrows = 0;
+	SDL_Rect location = { .x = 0, .y = 0, .w = 0, .h = 0 };
+	player_graphmode_sdl2_data_t * data = player_get_data( this );
+
+	player_get_screen_dimensions( this, &scr_ncols, &scr_nrows );
+
+	SDL_RenderClear( data->renderer );
+
+	location.w = scr_ncols;
+	location.h = scr_nrows;
+
+	SDL_RenderCopy( data->renderer, data->texture, NULL, &location );
+
+	if( data->console_texture )
+	{
+		player_get_console_position( this, &location.x, &location.y );
+		player_get_console_dimension( this, &location.w, &location.h );
+
+		SDL_RenderCopy( data->renderer, data->console_texture, NULL, &location );
+	}
+
+	SDL_RenderPresent( data->renderer );
+
+	/* Keeps the window responsive */
+	SDL_PumpEvents();
+}
+
+/* $Id$ */
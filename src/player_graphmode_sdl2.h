@@ -0,0 +1,48 @@
+/*!
+	\file player_graphmode_sdl2.h
+	\brief Animation Player in Graphic Mode Object (SDL2)
+	\author Tiago Ventura (tiago.ventura@gmail.com)
+*/
+
+#ifndef __PLAYER_GRAPHMODE_SDL2_H__
+#define __PLAYER_GRAPHMODE_SDL2_H__
+
+#include "player.h"
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+player_implementation_t * player_graphmode_sdl2_get_implementation( void );
+
+
+/*!
+	\brief Set the integer factor the renderer scales the screen by (takes effect on the next screen initialization)
+	\param this Player Object
+	\param scale Scale factor, 1 or more
+*/
+void player_graphmode_sdl2_set_scale( player_t * this, int scale );
+
+
+/*!
+	\brief Synchronize the presentation with the vertical retrace (takes effect on the next screen initialization)
+
+	Only accelerated renderers honour it, the software renderer presents
+	as soon as the frame is ready.
+
+	\param this Player Object
+	\param vsync Non-zero enables it
+*/
+void player_graphmode_sdl2_set_vsync( player_t * this, int vsync );
+
+
+#ifdef __cplusplus
+}
+#endif
+
+
+#endif /* __PLAYER_GRAPHMODE_SDL2_H__ */
+
+/* $Id$ */
@@ -0,0 +1,220 @@
+/*!
+	\file player_headless.c
+	\brief Animation Player Without Display (Offscreen)
+
+	Frames are rendered into an in-memory 8-bit indexed buffer, or a 32-bit
+	true color one when the player is set to 32 bits per pixel. When the
+	screen is finished a report with the frame rate, the time spent in each
+	frame stage and a checksum of the last rendered frame is printed, which
+	makes this player suitable for benchmarking on machines without a display.
+
+	\author Tiago Ventura (tiago.ventura@gmail.com)
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "pool.h"
+#include "frame.h"
+#include "palette.h"
+#include "player.h"
+#include "player_headless.h"
+
+
+#define PLAYER_HEADLESS_DESC                  "Offscreen 8-bit Indexed Buffer (Headless)"
+#define PLAYER_HEADLESS_TRUECOLOR_DESC        "Offscreen 32-bit True Color Buffer (Headless)"
+#define PLAYER_HEADLESS_COLS_COUNT            (640)
+#define PLAYER_HEADLESS_ROWS_COUNT            (480)
+#define PLAYER_HEADLESS_COLOR_COUNT           (256)
+
+
+/* Private Structures */
+struct player_headless_data_s
+{
+	uint8_t * buffer;
+	int pitch;
+	int depth;
+	uint8_t palette[ PLAYER_HEADLESS_COLOR_COUNT ][3];
+	uint32_t lut[ PLAYER_HEADLESS_COLOR_COUNT ];   /*!< Palette expanded into XRGB8888 pixels */
+	int frames;
+	struct timespec first;
+	struct timespec last;
+};
+
+/* Private Types */
+typedef struct player_headless_data_s player_headless_data_t;
+
+
+/* Abstract Functions Implementation Prototypes */
+static player_t * player_headless_create( player_t * parent );
+static void player_headless_destroy( player_t * this );
+static int player_headless_initialize( player_t * this );
+static void player_headless_finish( player_t * this );
+static void player_headless_set_palette( player_t * this, palette_t * pal, int first, int count );
+static void player_headless_render_frame( player_t * this, frame_t * frm );
+static void player_headless_refresh_console( player_t * this );
+
+
+/* Implementation */
+player_implementation_t * player_headless_get_implementation( void )
+{
+	static player_implementation_t impl;
+
+	impl.create = player_headless_create;
+	impl.destroy = player_headless_destroy;
+	impl.screen_initialize = player_headless_initialize;
+	impl.screen_finish = player_headless_finish;
+	impl.set_palette = player_headless_set_palette;
+	impl.render_frame = player_headless_render_frame;
+	impl.refresh_console = player_headless_refresh_console;
+
+	return &impl;
+};
+
+
+static player_t * player_headless_create( player_t * parent )
+{
+	player_headless_data_t * data = NULL;
+
+	data = (player_headless_data_t*) calloc( 1, sizeof(player_headless_data_t) );
+
+	if( !data )
+		return NULL;
+
+	player_set_data( parent, (void*) data );
+	player_set_description( parent, PLAYER_HEADLESS_DESC );
+	player_set_screen_format( parent, player_screen_format_graphic );
+	player_set_screen_cols_count( parent, PLAYER_HEADLESS_COLS_COUNT );
+	player_set_screen_rows_count( parent, PLAYER_HEADLESS_ROWS_COUNT );
+
+	return parent;
+}
+
+
+static void player_headless_destroy( player_t * this )
+{
+	free( player_get_data( this ) );
+}
+
+
+static int player_headless_initialize( player_t * this )
+{
+	int ncols = 0;
+	int nrows = 0;
+	player_headless_data_t * data = player_get_data( this );
+
+	/* The screen dimensions may have been changed after create() */
+	player_get_screen_dimensions( this, &ncols, &nrows );
+
+	if( (ncols <= 0) || (nrows <= 0) )
+		return -1;
+
+	player_set_real_dimensions( this, ncols, nrows );
+	player_set_console_position( this, 0, nrows );
+	player_set_console_dimension( this, 0, 0 );
+
+	data->depth = (player_get_color_depth( this ) == 32) ? 32 : 8;
+	data->pitch = ncols * (data->depth / 8);
+
+	player_set_description( this, (data->depth == 32) ? PLAYER_HEADLESS_TRUECOLOR_DESC : PLAYER_HEADLESS_DESC );
+
+	data->frames = 0;
+	data->buffer = (uint8_t*) pool_calloc( nrows, data->pitch );
+
+	if( !data->buffer )
+		return -1;
+
+	return 0;
+}
+
+
+static uint32_t player_headless_checksum( const uint8_t * buf, size_t len )
+{
+	uint32_t hash = 2166136261u;
+	size_t i = 0;
+
+	/* FNV-1a */
+	for( i = 0; i < len; i++ )
+	{
+		hash ^= buf[i];
+		hash *= 16777619u;
+	}
+
+	return hash;
+}
+
+
+static void player_headless_report( player_t * this )
+{
+	int ncols = 0;
+	int nrows = 0;
+	double elapsed = 0.0;
+	player_headless_data_t * data = player_get_data( this );
+
+	player_get_real_dimensions( this, &ncols, &nrows );
+
+	elapsed = ( data->last.tv_sec - data->first.tv_sec ) + ( data->last.tv_nsec - data->first.tv_nsec ) / 1e9;
+
+	fprintf( stdout, "%s: %dx%d / frames=%d / elapsed=%0.3fs / fps=%0.1f / checksum=%08x\n",
+			 player_get_description( this ), ncols, nrows, data->frames, elapsed,
+			 ( (elapsed > 0.0) && (data->frames > 1) ) ? (data->frames - 1) / elapsed : 0.0,
+			 player_headless_checksum( data->buffer, (size_t) data->pitch * nrows ) );
+}
+
+
+static void player_headless_finish( player_t * this )
+{
+	player_headless_data_t * data = player_get_data( this );
+
+	player_headless_report( this );
+
+	pool_free( data->buffer );
+	data->buffer = NULL;
+}
+
+
+static void player_headless_set_palette( player_t * this, palette_t * pal, int first, int count )
+{
+	int i = 0;
+	player_headless_data_t * data = player_get_data( this );
+
+	if( first + count > PLAYER_HEADLESS_COLOR_COUNT )
+		count = PLAYER_HEADLESS_COLOR_COUNT - first;
+
+	for( i = first; i < first + count; i++ )
+		palette_get_color( pal, i, &data->palette[i][0], &data->palette[i][1], &data->palette[i][2] );
+
+	if( data->depth == 32 )
+		palette_expand( pal, data->lut, first, count, 16, 8, 0, 0xFF000000 );
+}
+
+
+static void player_headless_render_frame( player_t * this, frame_t * frm )
+{
+	frame_rect_t area = { .col = 0, .row = 0, .ncols = 0, .nrows = 0 };
+	player_headless_data_t * data = player_get_data( this );
+
+	/* A frame larger than the buffer is clipped to it */
+	player_get_real_dimensions( this, &area.ncols, &area.nrows );
+
+	if( data->depth == 32 )
+		frame_pack_pixels( frm, &area, (uint32_t*) data->buffer, data->pitch, data->lut );
+	else
+		frame_pack_colors( frm, &area, data->buffer, data->pitch );
+
+	clock_gettime( CLOCK_MONOTONIC, &data->last );
+
+	if( !data->frames )
+		data->first = data->last;
+
+	data->frames++;
+}
+
+
+static void player_headless_refresh_console( player_t * this )
+{
+}
+
+/* $Id$ */
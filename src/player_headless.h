@@ -0,0 +1,28 @@
+/*!
+	\file player_headless.h
+	\brief Animation Player Without Display (Offscreen) Interface
+	\author Tiago Ventura (tiago.ventura@gmail.com)
+*/
+
+#ifndef __PLAYER_HEADLESS_H__
+#define __PLAYER_HEADLESS_H__
+
+#include "player.h"
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+player_implementation_t * player_headless_get_implementation( void );
+
+
+#ifdef __cplusplus
+}
+#endif
+
+
+#endif /* __PLAYER_HEADLESS_H__ */
+
+/* $Id$ */
@@ -0,0 +1,785 @@
+/*!
+	\file player_terminal.c
+	\brief Animation Player on an ANSI Terminal
+
+	Renders the characters and colors of the frame points to the terminal
+	on the standard output with ANSI escape sequences and the xterm 256
+	color palette. A shadow copy of the screen is kept, so each frame
+	only sends the cells that changed, with the shortest cursor moves and
+	color changes, in a single write(). When the screen is finished the
+	bytes sent per frame are reported, which tells whether an animation
+	streams well over a slow link.
+
+	Graphic animations can use more than one pixel per cell: Unicode half
+	blocks show 1x2 pixels and braille patterns 2x4 pixels. Their frames
+	are packed into a plane of colors first, then each row of cells is
+	computed from it by a branchless loop the compiler vectorizes.
+
+	\author Tiago Ventura (tiago.ventura@gmail.com)
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+
+#include "pool.h"
+#include "console.h"
+#include "frame.h"
+#include "palette.h"
+#include "player.h"
+#include "player_terminal.h"
+
+
+#define PLAYER_TERMINAL_DESC                  "ANSI Terminal (256 colors)"
+#define PLAYER_TERMINAL_HALFBLOCK_DESC        "ANSI Terminal (256 colors, half blocks)"
+#define PLAYER_TERMINAL_BRAILLE_DESC          "ANSI Terminal (256 colors, braille)"
+#define PLAYER_TERMINAL_COLS_COUNT            (80)
+#define PLAYER_TERMINAL_ROWS_COUNT            (24)
+#define PLAYER_TERMINAL_COLOR_COUNT           (256)
+#define PLAYER_TERMINAL_CELL_MAX_BYTES        (40)     /* Cursor move + both colors + character */
+#define PLAYER_TERMINAL_MAX_GAP               (4)      /* Bytes of unchanged cells rewritten instead of moving the cursor */
+#define PLAYER_TERMINAL_LINE_LEN              (128)
+
+
+/* Private Structures */
+struct player_terminal_cell_s
+{
+	uint8_t chr;
+	uint8_t color;      /*!< xterm color */
+	uint8_t bgcolor;    /*!< xterm color */
+};
+
+struct player_terminal_data_s
+{
+	player_terminal_mode_t mode;
+	int sx;                                   /*!< Pixels per cell */
+	int sy;
+	uint8_t blank;                            /*!< Cell code showing only the background */
+	int ncols;
+	int nrows;
+	uint8_t * plane;                          /*!< Colors of the frame (pixel modes) */
+	int pitch;
+	uint8_t * code;                           /*!< Row of cells: character or pixel pattern */
+	uint8_t * fg;                             /*!< Row of cells: palette colors */
+	uint8_t * bg;
+	struct player_terminal_cell_s * shadow;   /*!< Cells as they are on the terminal */
+	int shadow_valid;
+	uint8_t xterm[ PLAYER_TERMINAL_COLOR_COUNT ];   /*!< Closest xterm color of each palette color */
+	char * out;                               /*!< Escape sequences of the frame being built */
+	size_t out_len;
+	size_t out_size;
+	int cursor_col;                           /*!< -1 when unknown */
+	int cursor_row;
+	int color;                                /*!< Current colors, -1 when unknown */
+	int bgcolor;
+	int nlines;
+	char * lines;                             /*!< Console text on the terminal */
+	int lines_valid;
+	unsigned int frames;
+	uint64_t bytes;
+	size_t max_bytes;
+};
+
+/* Private Types */
+typedef struct player_terminal_data_s player_terminal_data_t;
+typedef struct player_terminal_cell_s player_terminal_cell_t;
+
+
+/* Abstract Functions Implementation Prototypes */
+static player_t * player_terminal_create( player_t * parent );
+static void player_terminal_destroy( player_t * this );
+static int player_terminal_initialize( player_t * this );
+static void player_terminal_finish( player_t * this );
+static void player_terminal_set_palette( player_t * this, palette_t * pal, int first, int count );
+static void player_terminal_render_frame( player_t * this, frame_t * frm );
+static void player_terminal_refresh_console( player_t * this );
+static void player_terminal_present( player_t * this );
+
+
+/* Implementation */
+player_implementation_t * player_terminal_get_implementation( void )
+{
+	static player_implementation_t impl;
+
+	impl.create = player_terminal_create;
+	impl.destroy = player_terminal_destroy;
+	impl.screen_initialize = player_terminal_initialize;
+	impl.screen_finish = player_terminal_finish;
+	impl.set_palette = player_terminal_set_palette;
+	impl.render_frame = player_terminal_render_frame;
+	impl.refresh_console = player_terminal_refresh_console;
+	impl.present = player_terminal_present;
+
+	return &impl;
+};
+
+
+static player_t * player_terminal_create( player_t * parent )
+{
+	struct winsize ws;
+	int ncols = PLAYER_TERMINAL_COLS_COUNT;
+	int nrows = PLAYER_TERMINAL_ROWS_COUNT;
+	player_terminal_data_t * data = NULL;
+
+	data = (player_terminal_data_t*) calloc( 1, sizeof(player_terminal_data_t) );
+
+	if( !data )
+		return NULL;
+
+	/* The whole terminal, unless a resolution is given */
+	if( !ioctl( STDOUT_FILENO, TIOCGWINSZ, &ws ) && ws.ws_col && ws.ws_row )
+	{
+		ncols = ws.ws_col;
+		nrows = ws.ws_row;
+	}
+
+	data->mode = player_terminal_mode_text;
+	data->sx = 1;
+	data->sy = 1;
+
+	player_set_data( parent, (void*) data );
+	player_set_description( parent, PLAYER_TERMINAL_DESC );
+	player_set_screen_format( parent, player_screen_format_text );
+	player_set_screen_cols_count( parent, ncols );
+	player_set_screen_rows_count( parent, nrows );
+
+	return parent;
+}
+
+
+static void player_terminal_destroy( player_t * this )
+{
+	free( player_get_data( this ) );
+}
+
+
+void player_terminal_set_mode( player_t * this, player_terminal_mode_t mode )
+{
+	int ncols = 0;
+	int nrows = 0;
+	player_terminal_data_t * data = player_get_data( this );
+
+	/* The screen is kept in pixels: back to cells, then to the pixels of the new mode */
+	player_get_screen_dimensions( this, &ncols, &nrows );
+
+	ncols /= data->sx;
+	nrows /= data->sy;
+
+	switch( mode )
+	{
+		case player_terminal_mode_halfblock:
+			data->sx = 1;
+			data->sy = 2;
+			player_set_description( this, PLAYER_TERMINAL_HALFBLOCK_DESC );
+			player_set_screen_format( this, player_screen_format_graphic );
+			break;
+
+		case player_terminal_mode_braille:
+			data->sx = 2;
+			data->sy = 4;
+			player_set_description( this, PLAYER_TERMINAL_BRAILLE_DESC );
+			player_set_screen_format( this, player_screen_format_graphic );
+			break;
+
+		default:
+			mode = player_terminal_mode_text;
+			data->sx = 1;
+			data->sy = 1;
+			player_set_description( this, PLAYER_TERMINAL_DESC );
+			player_set_screen_format( this, player_screen_format_text );
+			break;
+	}
+
+	data->mode = mode;
+
+	player_set_screen_dimensions( this, ncols * data->sx, nrows * data->sy );
+}
+
+
+static inline void player_terminal_put( player_terminal_data_t * data, const char * str, size_t len )
+{
+	memcpy( data->out + data->out_len, str, len );
+	data->out_len += len;
+}
+
+
+static inline void player_terminal_put_number( player_terminal_data_t * data, unsigned int n )
+{
+	char digits[10];
+	int i = 0;
+
+	do
+	{
+		digits[ i++ ] = '0' + (n % 10);
+		n /= 10;
+	}
+	while( n );
+
+	while( i )
+		data->out[ data->out_len++ ] = digits[ --i ];
+}
+
+
+static int player_terminal_flush( player_terminal_data_t * data )
+{
+	size_t done = 0;
+	ssize_t ret = 0;
+
+	while( done < data->out_len )
+	{
+		ret = write( STDOUT_FILENO, data->out + done, data->out_len - done );
+
+		if( ret < 0 )
+		{
+			if( (errno == EINTR) || (errno == EAGAIN) )
+				continue;
+
+			break;
+		}
+
+		done += ret;
+	}
+
+	ret = (done == data->out_len) ? 0 : -1;
+
+	data->out_len = 0;
+
+	return (int) ret;
+}
+
+
+static void player_terminal_release( player_terminal_data_t * data )
+{
+	pool_free( data->shadow );
+	pool_free( data->plane );
+	pool_free( data->code );
+	pool_free( data->fg );
+	pool_free( data->bg );
+	pool_free( data->out );
+	pool_free( data->lines );
+
+	data->shadow = NULL;
+	data->plane = NULL;
+	data->code = NULL;
+	data->fg = NULL;
+	data->bg = NULL;
+	data->out = NULL;
+	data->lines = NULL;
+}
+
+
+static int player_terminal_initialize( player_t * this )
+{
+	static const char setup[] = "\x1b[?1049h\x1b[?25l\x1b[0m\x1b[2J";
+	int i = 0;
+	int ncols = 0;
+	int nrows = 0;
+	int nlines = 0;
+	player_terminal_data_t * data = player_get_data( this );
+	console_t * con = player_get_console( this );
+
+	if(con)
+		nlines = console_get_lines_count( con );
+
+	player_get_screen_dimensions( this, &ncols, &nrows );
+
+	data->ncols = (ncols + data->sx - 1) / data->sx;
+	data->nrows = (nrows + data->sy - 1) / data->sy;
+
+	/* The console takes the last lines of the terminal */
+	if( data->nrows > nlines )
+		data->nrows -= nlines;
+
+	if( (data->ncols <= 0) || (data->nrows <= 0) )
+		return -1;
+
+	/* Screen in pixels, whole cells only; real dimensions in cells */
+	player_set_screen_dimensions( this, data->ncols * data->sx, data->nrows * data->sy );
+	player_set_real_dimensions( this, data->ncols, data->nrows + nlines );
+	player_set_console_position( this, 0, data->nrows );
+	player_set_console_dimension( this, data->ncols, nlines );
+
+	data->nlines = nlines;
+	data->shadow = (player_terminal_cell_t*) pool_calloc( data->ncols * data->nrows, sizeof(player_terminal_cell_t) );
+	data->code = (uint8_t*) pool_alloc( data->ncols );
+	data->fg = (uint8_t*) pool_alloc( data->ncols );
+	data->bg = (uint8_t*) pool_alloc( data->ncols );
+	data->lines = (char*) pool_calloc( nlines + 1, PLAYER_TERMINAL_LINE_LEN );
+	data->out_size = (size_t) data->ncols * (data->nrows + nlines) * PLAYER_TERMINAL_CELL_MAX_BYTES + sizeof(setup);
+	data->out = (char*) pool_alloc( data->out_size );
+
+	if( !data->shadow || !data->code || !data->fg || !data->bg || !data->lines || !data->out )
+	{
+		player_terminal_release( data );
+		return -1;
+	}
+
+	if( data->mode != player_terminal_mode_text )
+	{
+		data->pitch = data->ncols * data->sx;
+		data->plane = (uint8_t*) pool_calloc( data->nrows * data->sy, data->pitch );
+
+		if( !data->plane )
+		{
+			player_terminal_release( data );
+			return -1;
+		}
+	}
+
+	data->blank = (data->mode == player_terminal_mode_text) ? ' ' : 0;
+
+	data->shadow_valid = 0;
+	data->lines_valid = 0;
+	data->frames = 0;
+	data->bytes = 0;
+	data->max_bytes = 0;
+
+	/* Until a palette shows up: identity */
+	for( i = 0; i < PLAYER_TERMINAL_COLOR_COUNT; i++ )
+		data->xterm[i] = i;
+
+	/* Alternate screen, no cursor, default colors, cleared */
+	data->out_len = 0;
+	player_terminal_put( data, setup, sizeof(setup) - 1 );
+	player_terminal_flush( data );
+
+	data->cursor_col = -1;
+	data->cursor_row = -1;
+	data->color = -1;
+	data->bgcolor = -1;
+
+	return 0;
+}
+
+
+static void player_terminal_report( player_t * this, player_terminal_data_t * data )
+{
+	fprintf( stdout, "%s: %dx%d / frames=%u / bytes=%llu / bytes per frame=%0.1f / max=%lu\n",
+			 player_get_description( this ), data->ncols, data->nrows, data->frames,
+			 (unsigned long long) data->bytes,
+			 (data->frames) ? (double) data->bytes / data->frames : 0.0,
+			 (unsigned long) data->max_bytes );
+}
+
+
+static void player_terminal_finish( player_t * this )
+{
+	static const char restore[] = "\x1b[0m\x1b[?25h\x1b[?1049l";
+	player_terminal_data_t * data = player_get_data( this );
+
+	if( data->out )
+	{
+		data->out_len = 0;
+		player_terminal_put( data, restore, sizeof(restore) - 1 );
+		player_terminal_flush( data );
+	}
+
+	/* The statistics printed when playing stopped went away with the alternate screen */
+	if( isatty( STDOUT_FILENO ) )
+		player_dump_stats( this, stdout );
+
+	player_terminal_report( this, data );
+
+	player_terminal_release( data );
+}
+
+
+/* Closest color of the xterm palette: the 6x6x6 cube (16-231) or the gray ramp (232-255) */
+static uint8_t player_terminal_xterm_color( uint8_t red, uint8_t green, uint8_t blue )
+{
+	static const int level[6] = { 0, 95, 135, 175, 215, 255 };
+	int rgb[3] = { red, green, blue };
+	int idx[3] = { 0, 0, 0 };
+	int cube_dist = 0;
+	int gray_dist = 0;
+	int gray = 0;
+	int avg = 0;
+	int d = 0;
+	int i = 0;
+
+	for( i = 0; i < 3; i++ )
+	{
+		idx[i] = (rgb[i] < 48) ? 0 : (rgb[i] < 115) ? 1 : (rgb[i] - 35) / 40;
+		d = rgb[i] - level[ idx[i] ];
+		cube_dist += d * d;
+	}
+
+	avg = (red + green + blue) / 3;
+	gray = (avg > 238) ? 23 : (avg < 8) ? 0 : (avg - 3) / 10;
+
+	for( i = 0; i < 3; i++ )
+	{
+		d = rgb[i] - (8 + 10 * gray);
+		gray_dist += d * d;
+	}
+
+	if( gray_dist < cube_dist )
+		return 232 + gray;
+
+	return 16 + 36 * idx[0] + 6 * idx[1] + idx[2];
+}
+
+
+static void player_terminal_set_palette( player_t * this, palette_t * pal, int first, int count )
+{
+	int i = 0;
+	uint8_t red = 0;
+	uint8_t green = 0;
+	uint8_t blue = 0;
+	player_terminal_data_t * data = player_get_data( this );
+
+	if( first + count > PLAYER_TERMINAL_COLOR_COUNT )
+		count = PLAYER_TERMINAL_COLOR_COUNT - first;
+
+	/* The shadow holds xterm colors: only cells whose xterm color moved get sent again */
+	for( i = first; i < first + count; i++ )
+	{
+		palette_get_color( pal, i, &red, &green, &blue );
+		data->xterm[i] = player_terminal_xterm_color( red, green, blue );
+	}
+}
+
+
+static inline int player_terminal_glyph_len( player_terminal_data_t * data, uint8_t code )
+{
+	return ((data->mode == player_terminal_mode_text) || (code == data->blank)) ? 1 : 3;
+}
+
+
+static inline void player_terminal_put_glyph( player_terminal_data_t * data, uint8_t code )
+{
+	uint8_t * out = (uint8_t*) data->out + data->out_len;
+
+	if( (data->mode == player_terminal_mode_text) || (code == data->blank) )
+	{
+		out[0] = (code == data->blank) ? ' ' : code;
+		data->out_len++;
+		return;
+	}
+
+	/* UTF-8 of U+2580 (upper half block) or U+2800 + dots (braille pattern) */
+	if( data->mode == player_terminal_mode_halfblock )
+	{
+		out[0] = 0xE2;
+		out[1] = 0x96;
+		out[2] = 0x80;
+	}
+	else
+	{
+		out[0] = 0xE2;
+		out[1] = 0xA0 | (code >> 6);
+		out[2] = 0x80 | (code & 0x3F);
+	}
+
+	data->out_len += 3;
+}
+
+
+static void player_terminal_move_to( player_terminal_data_t * data, int col, int row )
+{
+	const player_terminal_cell_t * gap = NULL;
+	int n = col - data->cursor_col;
+	int len = 0;
+	int i = 0;
+
+	if( (row == data->cursor_row) && (col == data->cursor_col) )
+		return;
+
+	/* Relative moves only from a known column, the gap only over the frame rows the shadow covers */
+	if( (data->cursor_col >= 0) && (row == data->cursor_row) && (n > 0) )
+	{
+		/* A few unchanged cells in the current colors are cheaper to send again than a move */
+		if( (n <= PLAYER_TERMINAL_MAX_GAP) && (row < data->nrows) )
+		{
+			gap = data->shadow + row * data->ncols + data->cursor_col;
+
+			for( i = 0; i < n; i++ )
+			{
+				if( (gap[i].bgcolor != data->bgcolor) || ((gap[i].color != data->color) && (gap[i].chr != data->blank)) )
+					break;
+
+				len += player_terminal_glyph_len( data, gap[i].chr );
+			}
+
+			if( (i == n) && (len <= PLAYER_TERMINAL_MAX_GAP) )
+			{
+				for( i = 0; i < n; i++ )
+					player_terminal_put_glyph( data, gap[i].chr );
+
+				data->cursor_col = col;
+				return;
+			}
+		}
+
+		/* Cursor Forward */
+		player_terminal_put( data, "\x1b[", 2 );
+		player_terminal_put_number( data, n );
+		data->out[ data->out_len++ ] = 'C';
+	}
+	else
+	{
+		/* Cursor Position (1-based) */
+		player_terminal_put( data, "\x1b[", 2 );
+		player_terminal_put_number( data, row + 1 );
+		data->out[ data->out_len++ ] = ';';
+		player_terminal_put_number( data, col + 1 );
+		data->out[ data->out_len++ ] = 'H';
+	}
+
+	data->cursor_col = col;
+	data->cursor_row = row;
+}
+
+
+static void player_terminal_set_colors( player_terminal_data_t * data, int color, int bgcolor )
+{
+	if( (color == data->color) && (bgcolor == data->bgcolor) )
+		return;
+
+	player_terminal_put( data, "\x1b[", 2 );
+
+	if( color != data->color )
+	{
+		player_terminal_put( data, "38;5;", 5 );
+		player_terminal_put_number( data, color );
+	}
+
+	if( bgcolor != data->bgcolor )
+	{
+		if( color != data->color )
+			data->out[ data->out_len++ ] = ';';
+
+		player_terminal_put( data, "48;5;", 5 );
+		player_terminal_put_number( data, bgcolor );
+	}
+
+	data->out[ data->out_len++ ] = 'm';
+
+	data->color = color;
+	data->bgcolor = bgcolor;
+}
+
+
+static void player_terminal_put_cell( player_terminal_data_t * data, int col, int row, const player_terminal_cell_t * cell )
+{
+	player_terminal_move_to( data, col, row );
+	player_terminal_set_colors( data, cell->color, cell->bgcolor );
+	player_terminal_put_glyph( data, cell->chr );
+
+	/* Past the last column the terminal may or may not have wrapped */
+	if( ++data->cursor_col >= data->ncols )
+		data->cursor_col = -1;
+}
+
+
+/* One cell per point */
+static void player_terminal_pack_text( const frame_point_t * src, uint8_t * restrict code, uint8_t * restrict fg, uint8_t * restrict bg, int n )
+{
+	int i = 0;
+
+	for( i = 0; i < n; i++ )
+	{
+		code[i] = (isprint( (unsigned char) src[i].chr )) ? src[i].chr : ' ';
+		fg[i] = (uint8_t) src[i].color;
+		bg[i] = (uint8_t) src[i].bgcolor;
+	}
+}
+
+
+/* Upper half block: the top pixel in the foreground, the bottom one in the background */
+static void player_terminal_pack_halfblock( const uint8_t * restrict top, const uint8_t * restrict bottom,
+											uint8_t * restrict code, uint8_t * restrict fg, uint8_t * restrict bg, int n )
+{
+	int i = 0;
+
+	for( i = 0; i < n; i++ )
+	{
+		code[i] = (top[i] != bottom[i]);
+		fg[i] = top[i];
+		bg[i] = bottom[i];
+	}
+}
+
+
+#define PLAYER_TERMINAL_MAX(a,b)   (((a) > (b)) ? (a) : (b))
+
+/* Braille pattern: a dot for each pixel not in color 0, shown in the highest color of the cell */
+static void player_terminal_pack_braille( const uint8_t * restrict p0, const uint8_t * restrict p1,
+										  const uint8_t * restrict p2, const uint8_t * restrict p3,
+										  uint8_t * restrict code, uint8_t * restrict fg, uint8_t * restrict bg, int n )
+{
+	uint8_t l0, l1, l2, l3, r0, r1, r2, r3;
+	int i = 0;
+
+	for( i = 0; i < n; i++ )
+	{
+		l0 = p0[2*i]; r0 = p0[2*i+1];
+		l1 = p1[2*i]; r1 = p1[2*i+1];
+		l2 = p2[2*i]; r2 = p2[2*i+1];
+		l3 = p3[2*i]; r3 = p3[2*i+1];
+
+		/* Dots 1,2,3,7 down the left column, 4,5,6,8 down the right one */
+		code[i] = (l0 != 0)        | ((l1 != 0) << 1) | ((l2 != 0) << 2) | ((r0 != 0) << 3) |
+				  ((r1 != 0) << 4) | ((r2 != 0) << 5) | ((l3 != 0) << 6) | ((r3 != 0) << 7);
+
+		fg[i] = PLAYER_TERMINAL_MAX( PLAYER_TERMINAL_MAX( PLAYER_TERMINAL_MAX( l0, r0 ), PLAYER_TERMINAL_MAX( l1, r1 ) ),
+									 PLAYER_TERMINAL_MAX( PLAYER_TERMINAL_MAX( l2, r2 ), PLAYER_TERMINAL_MAX( l3, r3 ) ) );
+		bg[i] = 0;
+	}
+}
+
+
+static void player_terminal_pack_row( player_terminal_data_t * data, frame_t * frm, int row, int ncols )
+{
+	const uint8_t * p = data->plane + (size_t) row * data->sy * data->pitch;
+
+	switch( data->mode )
+	{
+		case player_terminal_mode_halfblock:
+			player_terminal_pack_halfblock( p, p + data->pitch, data->code, data->fg, data->bg, ncols );
+			break;
+
+		case player_terminal_mode_braille:
+			player_terminal_pack_braille( p, p + data->pitch, p + 2 * data->pitch, p + 3 * data->pitch,
+										  data->code, data->fg, data->bg, ncols );
+			break;
+
+		default:
+			player_terminal_pack_text( frame_get_row( frm, row ), data->code, data->fg, data->bg, ncols );
+			break;
+	}
+}
+
+
+static void player_terminal_render_frame( player_t * this, frame_t * frm )
+{
+	int col = 0;
+	int row = 0;
+	int ncols = 0;
+	int nrows = 0;
+	player_terminal_cell_t * shadow = NULL;
+	player_terminal_cell_t cell;
+	player_terminal_data_t * data = player_get_data( this );
+
+	if( data->mode == player_terminal_mode_text )
+	{
+		frame_get_dimensions( frm, &ncols, &nrows );
+
+		if( ncols > data->ncols )
+			ncols = data->ncols;
+
+		if( nrows > data->nrows )
+			nrows = data->nrows;
+	}
+	else
+	{
+		/* Pixels out of the frame stay in color 0 */
+		frame_pack_colors( frm, NULL, data->plane, data->pitch );
+
+		ncols = data->ncols;
+		nrows = data->nrows;
+	}
+
+	data->out_len = 0;
+
+	for( row = 0; row < nrows; row++ )
+	{
+		player_terminal_pack_row( data, frm, row, ncols );
+
+		shadow = data->shadow + row * data->ncols;
+
+		for( col = 0; col < ncols; col++ )
+		{
+			cell.chr = data->code[col];
+			cell.color = data->xterm[ data->fg[col] ];
+			cell.bgcolor = data->xterm[ data->bg[col] ];
+
+			/* Both halves mapped to the same color */
+			if( (data->mode == player_terminal_mode_halfblock) && (cell.color == cell.bgcolor) )
+				cell.chr = data->blank;
+
+			/* Blanks only show the background */
+			if( cell.chr == data->blank )
+				cell.color = (data->color >= 0) ? data->color : cell.bgcolor;
+
+			if( data->shadow_valid &&
+				(shadow[col].chr == cell.chr) &&
+				(shadow[col].bgcolor == cell.bgcolor) &&
+				((shadow[col].color == cell.color) || (cell.chr == data->blank)) )
+				continue;
+
+			player_terminal_put_cell( data, col, row, &cell );
+			shadow[col] = cell;
+		}
+	}
+
+	data->shadow_valid = 1;
+}
+
+
+static void player_terminal_refresh_console( player_t * this )
+{
+	int i = 0;
+	int len = 0;
+	char * cached = NULL;
+	const char * line = NULL;
+	player_terminal_data_t * data = player_get_data( this );
+	console_t * con = player_get_console( this );
+
+	if( !con || !data->nlines )
+		return;
+
+	for( i = 0; i < data->nlines; i++ )
+	{
+		line = console_get_line( con, i );
+		cached = data->lines + i * PLAYER_TERMINAL_LINE_LEN;
+
+		if( !line )
+			line = "";
+
+		if( data->lines_valid && !strncmp( cached, line, PLAYER_TERMINAL_LINE_LEN - 1 ) )
+			continue;
+
+		strncpy( cached, line, PLAYER_TERMINAL_LINE_LEN - 1 );
+
+		len = strlen( cached );
+
+		if( len > data->ncols )
+			len = data->ncols;
+
+		/* Default colors, the line, then erase what is left of the previous one */
+		data->cursor_col = -1;
+		player_terminal_move_to( data, 0, data->nrows + i );
+		player_terminal_put( data, "\x1b[0m", 4 );
+		player_terminal_put( data, cached, len );
+		player_terminal_put( data, "\x1b[K", 3 );
+
+		data->color = -1;
+		data->bgcolor = -1;
+		data->cursor_col = (len < data->ncols) ? len : -1;
+	}
+
+	data->lines_valid = 1;
+}
+
+
+static void player_terminal_present( player_t * this )
+{
+	player_terminal_data_t * data = player_get_data( this );
+
+	data->frames++;
+	data->bytes += data->out_len;
+
+	if( data->out_len > data->max_bytes )
+		data->max_bytes = data->out_len;
+
+	if( data->out_len )
+		player_terminal_flush( data );
+}
+
+/* $Id$ */
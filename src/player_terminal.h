@@ -0,0 +1,50 @@
+/*!
+	\file player_terminal.h
+	\brief Animation Player on an ANSI Terminal Interface
+	\author Tiago Ventura (tiago.ventura@gmail.com)
+*/
+
+#ifndef __PLAYER_TERMINAL_H__
+#define __PLAYER_TERMINAL_H__
+
+#include "player.h"
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/*!
+	\brief Terminal Rendering Mode Type Definition
+*/
+typedef enum player_terminal_mode_e player_terminal_mode_t;
+
+
+enum player_terminal_mode_e
+{
+	player_terminal_mode_text,        /*!< One frame point per cell, with its character */
+	player_terminal_mode_halfblock,   /*!< 1x2 pixels per cell, with half blocks */
+	player_terminal_mode_braille      /*!< 2x4 pixels per cell, with braille patterns */
+};
+
+
+player_implementation_t * player_terminal_get_implementation( void );
+
+
+/*!
+	\brief Set how the frames are drawn, before the screen is initialized
+	\param this Player Object
+	\param mode Terminal Rendering Mode, the screen dimensions are scaled to its pixels per cell
+*/
+void player_terminal_set_mode( player_t * this, player_terminal_mode_t mode );
+
+
+#ifdef __cplusplus
+}
+#endif
+
+
+#endif /* __PLAYER_TERMINAL_H__ */
+
+/* $Id$ */
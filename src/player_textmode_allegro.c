@@ -6,6 +6,7 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <ctype.h>
 
 #include <allegro5/allegro.h>
@@ -13,8 +14,10 @@
 #include <allegro5/allegro_ttf.h>
 #include <allegro5/allegro_primitives.h>
 
+#include "pool.h"
 #include "console.h"
 #include "frame.h"
+#include "palette.h"
 #include "player.h"
 #include "player_textmode_allegro.h"
 
@@ -24,19 +27,45 @@
 #define PLAYER_TEXTMODE_ALLEGRO_ROWS_COUNT          (480)
 #define PLAYER_TEXTMODE_ALLEGRO_FONT_FILE           "./felix.ttf"
 #define PLAYER_TEXTMODE_ALLEGRO_FONT_SIZE           (8)
+#define PLAYER_TEXTMODE_ALLEGRO_COLOR_COUNT         (256)
+#define PLAYER_TEXTMODE_ALLEGRO_FIRST_GLYPH         (0x20)
+#define PLAYER_TEXTMODE_ALLEGRO_GLYPH_COUNT         (0x7F - PLAYER_TEXTMODE_ALLEGRO_FIRST_GLYPH)
+#define PLAYER_TEXTMODE_ALLEGRO_SOLID_CELL          (PLAYER_TEXTMODE_ALLEGRO_GLYPH_COUNT)
+#define PLAYER_TEXTMODE_ALLEGRO_LINE_LEN            (128)
 
 
 /* Private Structures */
+struct player_textmode_allegro_cell_s
+{
+	int chr;
+	int color;
+	int bgcolor;
+};
+
 struct player_textmode_allegro_data_s
 {
 	ALLEGRO_DISPLAY * display;
 	ALLEGRO_FONT * font;
-	ALLEGRO_BITMAP * buffer;
+	ALLEGRO_BITMAP * buffer;                                        /*!< Text screen, keeps the cells between frames */
 	ALLEGRO_BITMAP * console_buffer;
+	ALLEGRO_BITMAP * atlas;                                         /*!< A cell per printable glyph plus a solid one for backgrounds */
+	int cell_width;
+	int cell_height;
+	ALLEGRO_COLOR colors[ PLAYER_TEXTMODE_ALLEGRO_COLOR_COUNT ];
+	unsigned char dirty[ PLAYER_TEXTMODE_ALLEGRO_COLOR_COUNT ];     /*!< Colors changed since the cells were drawn */
+	int dirty_count;
+	struct player_textmode_allegro_cell_s * shadow;                 /*!< Cells as they are in the buffer */
+	int shadow_ncols;
+	int shadow_nrows;
+	int shadow_valid;
+	char * lines;                                                   /*!< Console text in the console buffer */
+	int nlines;
+	int lines_valid;
 };
 
 /* Private Types */
 typedef struct player_textmode_allegro_data_s player_textmode_allegro_data_t;
+typedef struct player_textmode_allegro_cell_s player_textmode_allegro_cell_t;
 
 
 /* Abstract Functions Implementation Prototypes */
@@ -44,9 +73,10 @@ static player_t * player_textmode_allegro_create( player_t * parent );
 static void player_textmode_allegro_destroy( player_t * this );
 static int player_textmode_allegro_initialize( player_t * this );
 static void player_textmode_allegro_finish( player_t * this );
-static void player_textmode_allegro_set_palette( player_t * this, palette_t * pal );
+static void player_textmode_allegro_set_palette( player_t * this, palette_t * pal, int first, int count );
 static void player_textmode_allegro_render_frame( player_t * this, frame_t * frm );
 static void player_textmode_allegro_refresh_console( player_t * this );
+static void player_textmode_allegro_present( player_t * this );
 
 
 /* Implementation */
@@ -61,6 +91,7 @@ player_implementation_t * player_textmode_allegro_get_implementation( void )
 	impl.set_palette = player_textmode_allegro_set_palette;
 	impl.render_frame = player_textmode_allegro_render_frame;
 	impl.refresh_console = player_textmode_allegro_refresh_console;
+	impl.present = player_textmode_allegro_present;
 
 	return &impl;
 };
@@ -83,6 +114,7 @@ static player_t * player_textmode_allegro_create( player_t * parent )
 
 	al_init_font_addon();
 	al_init_ttf_addon();
+	al_init_primitives_addon();
 
 	data->font = al_load_font( PLAYER_TEXTMODE_ALLEGRO_FONT_FILE, PLAYER_TEXTMODE_ALLEGRO_FONT_SIZE, 0 );
 
@@ -109,9 +141,73 @@ static void player_textmode_allegro_destroy( player_t * this )
 }
 
 
+/* Draws every printable glyph once, in white, so cells can be drawn tinted from a single texture */
+static ALLEGRO_BITMAP * player_textmode_allegro_create_atlas( player_textmode_allegro_data_t * data )
+{
+	int i = 0;
+	char str[2] = { 0, 0 };
+	ALLEGRO_BITMAP * atlas = NULL;
+
+	atlas = al_create_bitmap( data->cell_width * (PLAYER_TEXTMODE_ALLEGRO_GLYPH_COUNT + 1), data->cell_height );
+
+	if( !atlas )
+		return NULL;
+
+	al_set_target_bitmap( atlas );
+	al_clear_to_color( al_map_rgba( 0, 0, 0, 0 ) );
+
+	for( i = 0; i < PLAYER_TEXTMODE_ALLEGRO_GLYPH_COUNT; i++ )
+	{
+		str[0] = PLAYER_TEXTMODE_ALLEGRO_FIRST_GLYPH + i;
+
+		/* Glyphs wider than a cell must not bleed into the next one */
+		al_set_clipping_rectangle( i * data->cell_width, 0, data->cell_width, data->cell_height );
+		al_draw_text( data->font, al_map_rgb( 255, 255, 255 ), i * data->cell_width, 0, ALLEGRO_ALIGN_LEFT, str );
+	}
+
+	al_reset_clipping_rectangle();
+
+	al_draw_filled_rectangle(	PLAYER_TEXTMODE_ALLEGRO_SOLID_CELL * data->cell_width,
+								0,
+								(PLAYER_TEXTMODE_ALLEGRO_SOLID_CELL + 1) * data->cell_width,
+								data->cell_height,
+								al_map_rgb( 255, 255, 255 ) );
+
+	return atlas;
+}
+
+
+static void player_textmode_allegro_release( player_textmode_allegro_data_t * data )
+{
+	if( data->atlas )
+		al_destroy_bitmap( data->atlas );
+
+	if( data->buffer )
+		al_destroy_bitmap( data->buffer );
+
+	if( data->console_buffer )
+		al_destroy_bitmap( data->console_buffer );
+
+	if( data->display )
+		al_destroy_display( data->display );
+
+	pool_free( data->shadow );
+	pool_free( data->lines );
+
+	data->atlas = NULL;
+	data->buffer = NULL;
+	data->console_buffer = NULL;
+	data->display = NULL;
+	data->shadow = NULL;
+	data->lines = NULL;
+	data->shadow_valid = 0;
+	data->lines_valid = 0;
+}
+
+
 static int player_textmode_allegro_initialize( player_t * this )
 {
-	int ret = 0;
+	int i = 0;
 	int nlines = 0;
 	int font_height = 0;
 	int font_length = 0;
@@ -137,11 +233,37 @@ static int player_textmode_allegro_initialize( player_t * this )
 		player_set_console_position( this, 0, PLAYER_TEXTMODE_ALLEGRO_ROWS_COUNT );
 	}
 
-	data->buffer = al_create_bitmap(	player_get_real_cols_count(this),
+	al_set_new_display_flags( ALLEGRO_PROGRAMMABLE_PIPELINE | ALLEGRO_OPENGL );
+
+	data->display = al_create_display(	player_get_real_cols_count(this),
 										player_get_real_rows_count(this) );
 
-	if( !data->buffer )
+	if( !data->display )
+		return -1;
+
+	al_set_window_title( data->display, PLAYER_TEXTMODE_ALLEGRO_DESC );
+
+	/* Created after the display, so that they are video bitmaps */
+	al_set_new_bitmap_format( ALLEGRO_PIXEL_FORMAT_ANY_WITH_ALPHA );
+
+	data->cell_width = font_length;
+	data->cell_height = font_height;
+
+	data->buffer = al_create_bitmap(	PLAYER_TEXTMODE_ALLEGRO_COLS_COUNT,
+										PLAYER_TEXTMODE_ALLEGRO_ROWS_COUNT );
+
+	data->atlas = player_textmode_allegro_create_atlas( data );
+
+	player_get_screen_dimensions( this, &data->shadow_ncols, &data->shadow_nrows );
+
+	data->shadow = (player_textmode_allegro_cell_t*) pool_calloc( data->shadow_ncols * data->shadow_nrows, sizeof(player_textmode_allegro_cell_t) );
+	data->shadow_valid = 0;
+
+	if( !data->buffer || !data->atlas || !data->shadow )
+	{
+		player_textmode_allegro_release( data );
 		return -1;
+	}
 
 	if( con )
 	{
@@ -153,28 +275,20 @@ static int player_textmode_allegro_initialize( player_t * this )
 		data->console_buffer = al_create_bitmap(	console_ncols,
 													console_nrows );
 
-		if( !data->console_buffer )
+		data->nlines = nlines;
+		data->lines = (char*) pool_calloc( nlines, PLAYER_TEXTMODE_ALLEGRO_LINE_LEN );
+		data->lines_valid = 0;
+
+		if( !data->console_buffer || !data->lines )
 		{
-			al_destroy_bitmap( data->buffer );
+			player_textmode_allegro_release( data );
 			return -1;
 		}
 	}
 
-	al_set_new_bitmap_format( ALLEGRO_PIXEL_FORMAT_SINGLE_CHANNEL_8 );
-
-	al_set_new_display_flags( ALLEGRO_PROGRAMMABLE_PIPELINE | ALLEGRO_OPENGL );
-
-	data->display = al_create_display(	player_get_real_cols_count(this),
-										player_get_real_rows_count(this) );
-
-	if( ret < 0 )
-	{
-		al_destroy_bitmap( data->buffer );
-		al_destroy_bitmap( data->console_buffer );
-		return -1;
-	}
-
-	al_set_window_title( data->display, PLAYER_TEXTMODE_ALLEGRO_DESC );
+	/* Until a palette shows up: white on black */
+	for( i = 0; i < PLAYER_TEXTMODE_ALLEGRO_COLOR_COUNT; i++ )
+		data->colors[i] = (i) ? al_map_rgb( 255, 255, 255 ) : al_map_rgb( 0, 0, 0 );
 
 	return 0;
 }
@@ -182,32 +296,33 @@ static int player_textmode_allegro_initialize( player_t * this )
 
 static void player_textmode_allegro_finish( player_t * this )
 {
-	player_textmode_allegro_data_t * data = player_get_data( this );
-
-	al_destroy_bitmap( data->buffer );
-	al_destroy_bitmap( data->console_buffer );
-	al_destroy_display( data->display );
+	player_textmode_allegro_release( player_get_data( this ) );
 }
 
 
-static void player_textmode_allegro_set_palette( player_t * this, palette_t * pal )
+static void player_textmode_allegro_set_palette( player_t * this, palette_t * pal, int first, int count )
 {
-	/*
 	int i = 0;
-	int count = 0;
-	PALETTE palette;
-
-		palette[256];
-
-	count = palette_get_color_count( pal );
+	uint8_t red = 0;
+	uint8_t green = 0;
+	uint8_t blue = 0;
+	player_textmode_allegro_data_t * data = player_get_data( this );
 
-	for( i = 0; i < count; i++ )
-		palette_get_color( pal, i, &palette[i].r, &palette[i].g, &palette[i].b );
+	if( first + count > PLAYER_TEXTMODE_ALLEGRO_COLOR_COUNT )
+		count = PLAYER_TEXTMODE_ALLEGRO_COLOR_COUNT - first;
 
-	al_wait_for_vsync();
+	for( i = first; i < first + count; i++ )
+	{
+		palette_get_color( pal, i, &red, &green, &blue );
+		data->colors[i] = al_map_rgb( red, green, blue );
 
-	set_palette( palette );
-	*/
+		/* Cells are drawn in true color, the ones in a new color are drawn again */
+		if( !data->dirty[i] )
+		{
+			data->dirty[i] = 1;
+			data->dirty_count++;
+		}
+	}
 }
 
 
@@ -215,38 +330,75 @@ static void player_textmode_allegro_render_frame( player_t * this, frame_t * frm
 {
 	int col = 0;
 	int row = 0;
-	int txtrow = 0;
-	int txtcol = 0;
 	int ncols = 0;
 	int nrows = 0;
-	int font_height = 0;
-	int font_length = 0;
-	frame_point_t pt;
+	int chr = 0;
+	int color = 0;
+	int bgcolor = 0;
+	const frame_point_t * src = NULL;
+	player_textmode_allegro_cell_t * cell = NULL;
 	player_textmode_allegro_data_t * data = player_get_data( this );
+	int cw = data->cell_width;
+	int ch = data->cell_height;
 
 	frame_get_dimensions( frm, &ncols, &nrows );
 
-	font_height =  al_get_font_line_height( data->font );
-	font_length = al_get_text_width( data->font, "\x20" );
+	if( ncols > data->shadow_ncols )
+		ncols = data->shadow_ncols;
+
+	if( nrows > data->shadow_nrows )
+		nrows = data->shadow_nrows;
+
+	al_set_target_bitmap( data->buffer );
 
-	for( row = 0, txtrow = 0; row < nrows; row++, txtrow += font_height )
+	/* Every cell comes from the atlas: the draws are batched into a few calls */
+	al_hold_bitmap_drawing( true );
+
+	for( row = 0; row < nrows; row++ )
 	{
-		for( col = 0, txtcol = 0; col < ncols; col++, txtcol += font_length )
+		src = frame_get_row( frm, row );
+		cell = data->shadow + row * data->shadow_ncols;
+
+		for( col = 0; col < ncols; col++, cell++ )
 		{
-			frame_get_point( frm, col, row, &pt );
+			chr = (unsigned char) src[col].chr;
+			color = src[col].color & (PLAYER_TEXTMODE_ALLEGRO_COLOR_COUNT - 1);
+			bgcolor = src[col].bgcolor & (PLAYER_TEXTMODE_ALLEGRO_COLOR_COUNT - 1);
+
+			if( !isprint( chr ) )
+				chr = '\x20';
+
+			/* The buffer keeps what was drawn, only the cells that changed, or whose colors did, are drawn again */
+			if( data->shadow_valid && (cell->chr == chr) && (cell->color == color) && (cell->bgcolor == bgcolor) &&
+				( !data->dirty_count || ( !data->dirty[ bgcolor ] && ( (chr == '\x20') || !data->dirty[ color ] ) ) ) )
+				continue;
 
-			if(!isprint(pt.chr))
-				pt.chr = '\x20';
+			cell->chr = chr;
+			cell->color = color;
+			cell->bgcolor = bgcolor;
 
-			/* Text Backgroud Color */
-			al_draw_filled_rectangle( txtcol, txtrow, txtcol + font_length, txtrow + font_height, al_map_rgb( 0, 0, 0 ) );
+			/* Text Background Color */
+			al_draw_tinted_bitmap_region(	data->atlas, data->colors[ bgcolor ],
+											PLAYER_TEXTMODE_ALLEGRO_SOLID_CELL * cw, 0, cw, ch,
+											col * cw, row * ch, 0 );
 
 			/* Text Draw */
-			al_draw_textf( data->font, al_map_rgb( 0, 128, 0 ), txtcol, txtrow, ALLEGRO_ALIGN_LEFT, "%c", pt.chr );
+			if( chr != '\x20' )
+				al_draw_tinted_bitmap_region(	data->atlas, data->colors[ color ],
+												(chr - PLAYER_TEXTMODE_ALLEGRO_FIRST_GLYPH) * cw, 0, cw, ch,
+												col * cw, row * ch, 0 );
 		}
 	}
 
-	al_flip_display();
+	al_hold_bitmap_drawing( false );
+
+	if( data->dirty_count )
+	{
+		memset( data->dirty, 0, sizeof(data->dirty) );
+		data->dirty_count = 0;
+	}
+
+	data->shadow_valid = 1;
 }
 
 
@@ -255,49 +407,71 @@ static void player_textmode_allegro_refresh_console( player_t * this )
 	int i = 0;
 	int txt_height = 0;
 	int count = 0;
-	int ydim = 0;
-	int ypos = 0;
-	int xdim = 0;
-	int xpos = 0;
+	char * cached = NULL;
+	const char * line = NULL;
 	console_t * con = player_get_console( this );
 	player_textmode_allegro_data_t * data = player_get_data( this );
 
-
-	if( !con )
+	if( !con || !data->console_buffer )
 		return;
 
 	txt_height =  al_get_font_line_height( data->font );
 
 	count = console_get_lines_count( con );
 
-	//al_clear_bitmap( data->console_buffer );
-	//al_clear_to_color( al_map_rgb( 0, 0, 0) )
+	if( count > data->nlines )
+		count = data->nlines;
+
+	al_set_target_bitmap( data->console_buffer );
 
+	/* Only the lines whose text changed are drawn again */
 	for( i = 0; i < count; i++ )
 	{
-		al_draw_textf(	data->font,
+		line = console_get_line( con, i );
+		cached = data->lines + i * PLAYER_TEXTMODE_ALLEGRO_LINE_LEN;
+
+		if( !line )
+			line = "";
+
+		if( data->lines_valid && !strncmp( cached, line, PLAYER_TEXTMODE_ALLEGRO_LINE_LEN - 1 ) )
+			continue;
+
+		al_set_clipping_rectangle( 0, txt_height * i, al_get_bitmap_width( data->console_buffer ), txt_height );
+		al_clear_to_color( al_map_rgb( 0, 0, 0 ) );
+
+		al_draw_text(	data->font,
 						al_map_rgb( 255, 255, 255),
 						0,
 						txt_height * i,
 						ALLEGRO_ALIGN_LEFT,
-						"%s",
-						console_get_line( con, i ) );
+						line );
+
+		strncpy( cached, line, PLAYER_TEXTMODE_ALLEGRO_LINE_LEN - 1 );
 	}
 
-	player_get_console_position( this, &xpos, &ypos );
-	player_get_console_dimension( this, &xdim, &ydim );
-
-	//al_draw_bitmap_region( data->console_buffer, 0, 0, float sw, float sh, float dx, float dy, int flags );
-/*
-	blit(	data->console_buffer,
-			screen,
-			0,
-			0,
-			xpos,
-			ypos,
-			xdim,
-			ydim );
-*/
+	al_reset_clipping_rectangle();
+
+	data->lines_valid = 1;
+}
+
+
+static void player_textmode_allegro_present( player_t * this )
+{
+	int xpos = 0;
+	int ypos = 0;
+	player_textmode_allegro_data_t * data = player_get_data( this );
+
+	al_set_target_backbuffer( data->display );
+
+	al_draw_bitmap( data->buffer, 0, 0, 0 );
+
+	if( data->console_buffer )
+	{
+		player_get_console_position( this, &xpos, &ypos );
+		al_draw_bitmap( data->console_buffer, xpos, ypos, 0 );
+	}
+
+	al_flip_display();
 }
 
 /* $Id: player_textmode_allegro.c 307 2015-08-13 20:18:23Z tiago.ventura $ */
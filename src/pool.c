@@ -0,0 +1,224 @@
+/*!
+	\file pool.c
+	\brief Memory Pool Implementation
+	\author Tiago Ventura (tiago.ventura@gmail.com)
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "pool.h"
+
+
+#define POOL_MIN_SHIFT       (4)
+#define POOL_MAX_SHIFT       (28)
+#define POOL_MIN_BLOCK       (1 << POOL_MIN_SHIFT)
+#define POOL_CLASS_COUNT     ( ((POOL_MAX_SHIFT - POOL_MIN_SHIFT) * 4) + 1 )
+#define POOL_NO_CLASS        (-1)
+
+
+/*!
+	\brief Pool Block Header Type Definition
+*/
+typedef struct pool_block_s pool_block_t;
+
+
+/*!
+	\brief Header in front of every block, keeps the payload 16 bytes aligned
+*/
+struct pool_block_s
+{
+	pool_block_t * next;
+	size_t size;
+	int sclass;
+} __attribute__(( aligned( 16 ) ));
+
+
+/*!
+	\brief Represents the Pool
+*/
+struct pool_s
+{
+	pthread_mutex_t mutex;
+	pool_block_t * free_list[ POOL_CLASS_COUNT ];
+	pool_stats_t stats;
+};
+
+
+static struct pool_s pool = { PTHREAD_MUTEX_INITIALIZER, { NULL }, { 0 } };
+
+
+/*!
+	\brief Map a size to its class: 16 bytes, then 4 classes per power of two
+	\param size Requested size in bytes
+	\param csize Size of the class in bytes
+	\return Class index, POOL_NO_CLASS if too large to be pooled
+*/
+static int pool_get_class( size_t size, size_t * csize )
+{
+	int shift = 0;
+	size_t step = 0;
+	size_t sub = 0;
+
+	if( size <= POOL_MIN_BLOCK )
+	{
+		*csize = POOL_MIN_BLOCK;
+		return 0;
+	}
+
+	/* 2^shift <= size - 1 < 2^(shift + 1) */
+	shift = 63 - __builtin_clzll( (unsigned long long) (size - 1) );
+
+	if( shift >= POOL_MAX_SHIFT )
+	{
+		*csize = size;
+		return POOL_NO_CLASS;
+	}
+
+	step = ((size_t) 1) << (shift - 2);
+	sub = ((size - 1) >> (shift - 2)) & 3;
+
+	*csize = (((size_t) 1) << shift) + (sub + 1) * step;
+
+	return ((shift - POOL_MIN_SHIFT) * 4) + (int) sub + 1;
+}
+
+
+void * pool_alloc( size_t size )
+{
+	pool_block_t * blk = NULL;
+	size_t csize = 0;
+	int sclass = 0;
+
+	sclass = pool_get_class( size, &csize );
+
+	pthread_mutex_lock( &pool.mutex );
+
+	if( sclass != POOL_NO_CLASS )
+	{
+		blk = pool.free_list[ sclass ];
+
+		if( blk )
+		{
+			pool.free_list[ sclass ] = blk->next;
+			pool.stats.cached_bytes -= csize;
+		}
+	}
+
+	if( !blk )
+	{
+		pool.stats.system_allocations++;
+
+		/* Do not hold the pool while malloc() works */
+		pthread_mutex_unlock( &pool.mutex );
+
+		blk = (pool_block_t*) malloc( sizeof(pool_block_t) + csize );
+
+		if( !blk )
+			return NULL;
+
+		blk->size = csize;
+		blk->sclass = sclass;
+
+		pthread_mutex_lock( &pool.mutex );
+	}
+
+	pool.stats.allocations++;
+	pool.stats.bytes_in_use += csize;
+
+	if( pool.stats.bytes_in_use > pool.stats.peak_bytes )
+		pool.stats.peak_bytes = pool.stats.bytes_in_use;
+
+	pthread_mutex_unlock( &pool.mutex );
+
+	blk->next = NULL;
+
+	return (void*) (blk + 1);
+}
+
+
+void * pool_calloc( size_t count, size_t size )
+{
+	void * ptr = NULL;
+
+	if( size && (count > ((size_t) -1) / size) )
+		return NULL;
+
+	ptr = pool_alloc( count * size );
+
+	if( ptr )
+		memset( ptr, 0, count * size );
+
+	return ptr;
+}
+
+
+void pool_free( void * ptr )
+{
+	pool_block_t * blk = NULL;
+
+	if( !ptr )
+		return;
+
+	blk = ((pool_block_t*) ptr) - 1;
+
+	pthread_mutex_lock( &pool.mutex );
+
+	pool.stats.frees++;
+	pool.stats.bytes_in_use -= blk->size;
+
+	if( blk->sclass != POOL_NO_CLASS )
+	{
+		blk->next = pool.free_list[ blk->sclass ];
+		pool.free_list[ blk->sclass ] = blk;
+		pool.stats.cached_bytes += blk->size;
+		blk = NULL;
+	}
+
+	pthread_mutex_unlock( &pool.mutex );
+
+	free( blk );
+}
+
+
+void pool_reset( void )
+{
+	pool_block_t * list[ POOL_CLASS_COUNT ];
+	pool_block_t * blk = NULL;
+	int i = 0;
+
+	pthread_mutex_lock( &pool.mutex );
+
+	memcpy( list, pool.free_list, sizeof(list) );
+	memset( pool.free_list, 0, sizeof(pool.free_list) );
+
+	/* Blocks in use are still in use */
+	pool.stats.allocations = 0;
+	pool.stats.system_allocations = 0;
+	pool.stats.frees = 0;
+	pool.stats.cached_bytes = 0;
+	pool.stats.peak_bytes = pool.stats.bytes_in_use;
+
+	pthread_mutex_unlock( &pool.mutex );
+
+	for( i = 0; i < POOL_CLASS_COUNT; i++ )
+	{
+		while( list[i] )
+		{
+			blk = list[i];
+			list[i] = blk->next;
+			free( blk );
+		}
+	}
+}
+
+
+void pool_get_stats( pool_stats_t * stats )
+{
+	pthread_mutex_lock( &pool.mutex );
+	*stats = pool.stats;
+	pthread_mutex_unlock( &pool.mutex );
+}
+
+/* $Id$ */
@@ -0,0 +1,90 @@
+/*!
+	\file pool.h
+	\brief Memory Pool Interface
+	\author Tiago Ventura (tiago.ventura@gmail.com)
+*/
+
+#ifndef __POOL_H__
+#define __POOL_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/*!
+	\brief Pool Statistics Type Definition
+*/
+typedef struct pool_stats_s pool_stats_t;
+
+
+/*!
+	\brief Pool Statistics, counted since the last pool_reset()
+*/
+struct pool_stats_s
+{
+	uint64_t allocations;          /*!< Blocks handed out */
+	uint64_t system_allocations;   /*!< Blocks that had to come from malloc() (not recycled) */
+	uint64_t frees;                /*!< Blocks given back */
+	uint64_t bytes_in_use;         /*!< Bytes currently handed out (block sizes) */
+	uint64_t peak_bytes;           /*!< Highest bytes_in_use */
+	uint64_t cached_bytes;         /*!< Bytes kept in the free lists for recycling */
+};
+
+
+/*!
+	\brief Allocate a block from the process wide pool
+
+	Blocks are rounded up to a size class (4 classes per power of two) and
+	recycled through a free list per class, so objects that are created
+	and destroyed over and over (frames, palettes, scratch buffers) stop
+	reaching malloc() once the pool is warm. Thread-safe.
+
+	\param size Size in bytes
+	\return Block, NULL on failure
+*/
+void * pool_alloc( size_t size );
+
+
+/*!
+	\brief Allocate a zero filled block from the pool
+	\param count Elements count
+	\param size Element size in bytes
+	\return Block, NULL on failure
+*/
+void * pool_calloc( size_t count, size_t size );
+
+
+/*!
+	\brief Give a block back to the pool
+	\param ptr Block returned by pool_alloc() or pool_calloc(), NULL is ignored
+*/
+void pool_free( void * ptr );
+
+
+/*!
+	\brief Start over: release the cached blocks to the system and clear the counters
+
+	Blocks still in use stay valid (and counted in use) and can be freed
+	after the reset.
+*/
+void pool_reset( void );
+
+
+/*!
+	\brief Read the pool statistics
+	\param stats Statistics
+*/
+void pool_get_stats( pool_stats_t * stats );
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __POOL_H__ */
+
+/* $Id$ */
@@ -0,0 +1,132 @@
+/*!
+	\file queue.c
+	\brief Single Producer / Single Consumer Queue Object Implementation
+	\author Tiago Ventura (tiago.ventura@gmail.com)
+*/
+
+#include <stdlib.h>
+#include <errno.h>
+#include <semaphore.h>
+
+#include "queue.h"
+
+
+#define QUEUE_CACHE_LINE_SIZE   (64)
+
+
+/*!
+	\brief Represents a Queue Object
+
+	The head is only written by the consumer and the tail only by the
+	producer, each on its own cache line. The semaphores count the items
+	and the free slots, so a thread sleeps instead of spinning when it
+	cannot make progress.
+*/
+struct queue_s
+{
+	unsigned int head __attribute__(( aligned( QUEUE_CACHE_LINE_SIZE ) ));
+	unsigned int tail __attribute__(( aligned( QUEUE_CACHE_LINE_SIZE ) ));
+	unsigned int capacity __attribute__(( aligned( QUEUE_CACHE_LINE_SIZE ) ));
+	sem_t items;
+	sem_t slots;
+	void ** ring;
+};
+
+
+queue_t * queue_create( int capacity )
+{
+	queue_t * q = NULL;
+
+	if( capacity <= 0 )
+		return NULL;
+
+	if( posix_memalign( (void**) &q, QUEUE_CACHE_LINE_SIZE, sizeof(queue_t) ) )
+		return NULL;
+
+	q->head = 0;
+	q->tail = 0;
+	q->capacity = capacity;
+	q->ring = (void**) calloc( capacity, sizeof(void*) );
+
+	if( !q->ring )
+	{
+		free( q );
+		return NULL;
+	}
+
+	sem_init( &q->items, 0, 0 );
+	sem_init( &q->slots, 0, capacity );
+
+	return q;
+}
+
+
+void queue_destroy( queue_t * this )
+{
+	sem_destroy( &this->items );
+	sem_destroy( &this->slots );
+
+	free( this->ring );
+	free( this );
+}
+
+
+static inline void queue_wait( sem_t * sem )
+{
+	while( sem_wait( sem ) && (errno == EINTR) );
+}
+
+
+void queue_push( queue_t * this, void * item )
+{
+	unsigned int tail = 0;
+
+	queue_wait( &this->slots );
+
+	tail = __atomic_load_n( &this->tail, __ATOMIC_RELAXED );
+
+	this->ring[ tail ] = item;
+
+	__atomic_store_n( &this->tail, (tail + 1) % this->capacity, __ATOMIC_RELEASE );
+
+	sem_post( &this->items );
+}
+
+
+static inline void * queue_take( queue_t * this )
+{
+	unsigned int head = 0;
+	void * item = NULL;
+
+	/* The items count guarantees the slot at head was published */
+	head = __atomic_load_n( &this->head, __ATOMIC_RELAXED );
+
+	(void) __atomic_load_n( &this->tail, __ATOMIC_ACQUIRE );
+
+	item = this->ring[ head ];
+
+	__atomic_store_n( &this->head, (head + 1) % this->capacity, __ATOMIC_RELEASE );
+
+	sem_post( &this->slots );
+
+	return item;
+}
+
+
+void * queue_pop( queue_t * this )
+{
+	queue_wait( &this->items );
+
+	return queue_take( this );
+}
+
+
+void * queue_try_pop( queue_t * this )
+{
+	if( sem_trywait( &this->items ) )
+		return NULL;
+
+	return queue_take( this );
+}
+
+/* $Id$ */
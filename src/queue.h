@@ -0,0 +1,70 @@
+/*!
+	\file queue.h
+	\brief Single Producer / Single Consumer Queue Object Interface
+	\author Tiago Ventura (tiago.ventura@gmail.com)
+*/
+
+#ifndef __QUEUE_H__
+#define __QUEUE_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/*!
+	\brief Queue Object Type Definition (opaque)
+
+	Bounded ring of pointers shared by exactly one producer thread and one
+	consumer thread. Pushing and popping never take a lock; a thread only
+	goes to sleep when the ring is full (producer) or empty (consumer).
+*/
+typedef struct queue_s queue_t;
+
+
+/*!
+	\brief Queue Object Constructor
+	\param capacity Maximum number of queued items
+	\return Queue Object
+*/
+queue_t * queue_create( int capacity );
+
+
+/*!
+	\brief Queue Object Destructor
+	\param this Queue Object
+*/
+void queue_destroy( queue_t * this );
+
+
+/*!
+	\brief Append an item, waiting while the queue is full (producer side)
+	\param this Queue Object
+	\param item Item (must not be NULL)
+*/
+void queue_push( queue_t * this, void * item );
+
+
+/*!
+	\brief Remove the oldest item, waiting while the queue is empty (consumer side)
+	\param this Queue Object
+	\return Item
+*/
+void * queue_pop( queue_t * this );
+
+
+/*!
+	\brief Remove the oldest item without waiting (consumer side)
+	\param this Queue Object
+	\return Item, NULL if the queue is empty
+*/
+void * queue_try_pop( queue_t * this );
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __QUEUE_H__ */
+
+/* $Id$ */
@@ -0,0 +1,316 @@
+/*!
+	\file workers.c
+	\brief Worker Threads Pool Object Implementation
+	\author Tiago Ventura (tiago.ventura@gmail.com)
+*/
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "workers.h"
+
+
+#define WORKERS_CACHE_LINE_SIZE   (64)
+
+
+/*!
+	\brief Represents one thread of the pool
+
+	The range of tasks left to the thread is packed as (first << 32 | end)
+	so that the owner taking from the front and the thieves taking from
+	the back agree with a single compare and swap.
+*/
+struct workers_thread_s
+{
+	uint64_t range __attribute__(( aligned( WORKERS_CACHE_LINE_SIZE ) ));
+	pthread_t thread;
+	workers_t * pool;
+	int index;
+};
+
+typedef struct workers_thread_s workers_thread_t;
+
+
+/*!
+	\brief Represents a Workers Object
+*/
+struct workers_s
+{
+	workers_thread_t thread[ WORKERS_MAX_THREADS ];
+	int nthreads;
+	int spawned;
+	pthread_mutex_t mutex;
+	pthread_cond_t start;
+	pthread_cond_t done;
+	unsigned int generation;
+	int active;
+	int quit;
+	workers_task_fn fn;
+	void * arg;
+};
+
+
+/* Index of the thread in the pool it works for */
+static __thread int workers_thread_index = 0;
+
+
+static inline uint64_t workers_pack_range( uint32_t first, uint32_t end )
+{
+	return ((uint64_t) first << 32) | end;
+}
+
+
+/*!
+	\brief Take the next task from the front of the thread's own range
+	\return Task index, -1 if the range is empty
+*/
+static int workers_take( workers_thread_t * thr )
+{
+	uint64_t range = __atomic_load_n( &thr->range, __ATOMIC_ACQUIRE );
+	uint32_t first = 0;
+	uint32_t end = 0;
+
+	do
+	{
+		first = (uint32_t) (range >> 32);
+		end = (uint32_t) range;
+
+		if( first >= end )
+			return -1;
+	}
+	while( !__atomic_compare_exchange_n( &thr->range, &range, workers_pack_range( first + 1, end ), 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE ) );
+
+	return (int) first;
+}
+
+
+/*!
+	\brief Move the back half of another thread's range into the thread's own
+	\return 1 when something was stolen, 0 when every range is empty
+*/
+static int workers_steal( workers_thread_t * thr )
+{
+	workers_t * pool = thr->pool;
+	workers_thread_t * victim = NULL;
+	uint64_t range = 0;
+	uint32_t first = 0;
+	uint32_t end = 0;
+	uint32_t half = 0;
+	int i = 0;
+
+	for( i = 1; i < pool->nthreads; i++ )
+	{
+		victim = &pool->thread[ (thr->index + i) % pool->nthreads ];
+
+		range = __atomic_load_n( &victim->range, __ATOMIC_ACQUIRE );
+
+		do
+		{
+			first = (uint32_t) (range >> 32);
+			end = (uint32_t) range;
+
+			if( first >= end )
+				break;
+
+			half = (end - first + 1) / 2;
+		}
+		while( !__atomic_compare_exchange_n( &victim->range, &range, workers_pack_range( first, end - half ), 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE ) );
+
+		if( first < end )
+		{
+			__atomic_store_n( &thr->range, workers_pack_range( end - half, end ), __ATOMIC_RELEASE );
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+
+static void workers_work( workers_thread_t * thr, workers_task_fn fn, void * arg )
+{
+	int task = 0;
+
+	do
+	{
+		while( (task = workers_take( thr )) >= 0 )
+			fn( arg, task );
+	}
+	while( workers_steal( thr ) );
+}
+
+
+static void * workers_thread_main( void * arg )
+{
+	workers_thread_t * thr = (workers_thread_t*) arg;
+	workers_t * pool = thr->pool;
+	unsigned int generation = 0;
+	workers_task_fn fn = NULL;
+	void * fnarg = NULL;
+
+	workers_thread_index = thr->index;
+
+	for(;;)
+	{
+		pthread_mutex_lock( &pool->mutex );
+
+		while( (pool->generation == generation) && !pool->quit )
+			pthread_cond_wait( &pool->start, &pool->mutex );
+
+		if( pool->quit )
+		{
+			pthread_mutex_unlock( &pool->mutex );
+			break;
+		}
+
+		generation = pool->generation;
+		fn = pool->fn;
+		fnarg = pool->arg;
+
+		pthread_mutex_unlock( &pool->mutex );
+
+		workers_work( thr, fn, fnarg );
+
+		pthread_mutex_lock( &pool->mutex );
+
+		if( --pool->active == 0 )
+			pthread_cond_signal( &pool->done );
+
+		pthread_mutex_unlock( &pool->mutex );
+	}
+
+	return NULL;
+}
+
+
+workers_t * workers_create( int nthreads )
+{
+	workers_t * pool = NULL;
+	long ncpus = 0;
+	int i = 0;
+
+	if( nthreads <= 0 )
+	{
+		ncpus = sysconf( _SC_NPROCESSORS_ONLN );
+		nthreads = (ncpus < 1) ? 1 : (int) ncpus;
+	}
+
+	if( nthreads > WORKERS_MAX_THREADS )
+		nthreads = WORKERS_MAX_THREADS;
+
+	if( posix_memalign( (void**) &pool, WORKERS_CACHE_LINE_SIZE, sizeof(workers_t) ) )
+		return NULL;
+
+	pool->nthreads = nthreads;
+	pool->spawned = 0;
+	pool->generation = 0;
+	pool->active = 0;
+	pool->quit = 0;
+	pool->fn = NULL;
+	pool->arg = NULL;
+
+	pthread_mutex_init( &pool->mutex, NULL );
+	pthread_cond_init( &pool->start, NULL );
+	pthread_cond_init( &pool->done, NULL );
+
+	for( i = 0; i < nthreads; i++ )
+	{
+		pool->thread[i].range = 0;
+		pool->thread[i].pool = pool;
+		pool->thread[i].index = i;
+	}
+
+	/* Thread 0 is whoever calls workers_run() */
+	for( i = 1; i < nthreads; i++ )
+	{
+		if( pthread_create( &pool->thread[i].thread, NULL, workers_thread_main, &pool->thread[i] ) )
+			break;
+
+		pool->spawned++;
+	}
+
+	pool->nthreads = pool->spawned + 1;
+
+	return pool;
+}
+
+
+void workers_destroy( workers_t * this )
+{
+	int i = 0;
+
+	pthread_mutex_lock( &this->mutex );
+	this->quit = 1;
+	pthread_cond_broadcast( &this->start );
+	pthread_mutex_unlock( &this->mutex );
+
+	for( i = 1; i <= this->spawned; i++ )
+		pthread_join( this->thread[i].thread, NULL );
+
+	pthread_cond_destroy( &this->done );
+	pthread_cond_destroy( &this->start );
+	pthread_mutex_destroy( &this->mutex );
+
+	free( this );
+}
+
+
+int workers_get_threads_count( workers_t * this )
+{
+	return this->nthreads;
+}
+
+
+int workers_get_thread_index( void )
+{
+	return workers_thread_index;
+}
+
+
+void workers_run( workers_t * this, workers_task_fn fn, void * arg, int count )
+{
+	int caller = workers_thread_index;
+	int i = 0;
+
+	/* The caller is thread 0 of this batch, even when it is a worker of another pool */
+	workers_thread_index = 0;
+
+	if( !this || (this->nthreads == 1) || (count <= 1) )
+	{
+		for( i = 0; i < count; i++ )
+			fn( arg, i );
+
+		workers_thread_index = caller;
+		return;
+	}
+
+	/* Contiguous ranges keep neighbouring tasks on the same thread */
+	for( i = 0; i < this->nthreads; i++ )
+		__atomic_store_n( &this->thread[i].range, workers_pack_range( (uint32_t) ((int64_t) count * i / this->nthreads), (uint32_t) ((int64_t) count * (i + 1) / this->nthreads) ), __ATOMIC_RELAXED );
+
+	pthread_mutex_lock( &this->mutex );
+
+	this->fn = fn;
+	this->arg = arg;
+	this->active = this->spawned;
+	this->generation++;
+
+	pthread_cond_broadcast( &this->start );
+	pthread_mutex_unlock( &this->mutex );
+
+	workers_work( &this->thread[0], fn, arg );
+
+	/* A thread leaves only when no range has tasks left, so once all of them left the batch is done */
+	pthread_mutex_lock( &this->mutex );
+
+	while( this->active > 0 )
+		pthread_cond_wait( &this->done, &this->mutex );
+
+	pthread_mutex_unlock( &this->mutex );
+
+	workers_thread_index = caller;
+}
+
+/* $Id$ */
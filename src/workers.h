@@ -0,0 +1,85 @@
+/*!
+	\file workers.h
+	\brief Worker Threads Pool Object Interface
+	\author Tiago Ventura (tiago.ventura@gmail.com)
+*/
+
+#ifndef __WORKERS_H__
+#define __WORKERS_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/*!
+	\brief Maximum number of threads of a Workers Object
+*/
+#define WORKERS_MAX_THREADS       (64)
+
+
+/*!
+	\brief Workers Object Type Definition (opaque)
+
+	Pool of threads that run batches of independent tasks. The tasks of a
+	batch are dealt to the threads in contiguous ranges; a thread that runs
+	out of tasks steals half of the range left to another one.
+*/
+typedef struct workers_s workers_t;
+
+
+/*!
+	\brief Task function, called once for every task of a batch
+	\param arg Batch argument
+	\param task Task index, from 0 to the tasks count - 1
+*/
+typedef void (*workers_task_fn) ( void * arg, int task );
+
+
+/*!
+	\brief Workers Object Constructor
+	\param nthreads Number of threads, including the caller of workers_run(), 0 for one per processor
+	\return Workers Object
+*/
+workers_t * workers_create( int nthreads );
+
+
+/*!
+	\brief Workers Object Destructor
+	\param this Workers Object
+*/
+void workers_destroy( workers_t * this );
+
+
+/*!
+	\brief Get the number of threads running the tasks
+	\param this Workers Object
+	\return Threads count
+*/
+int workers_get_threads_count( workers_t * this );
+
+
+/*!
+	\brief Run a batch of tasks and wait for all of them, the calling thread works too
+	\param this Workers Object, NULL runs the tasks on the calling thread
+	\param fn Task function
+	\param arg Batch argument
+	\param count Tasks count
+*/
+void workers_run( workers_t * this, workers_task_fn fn, void * arg, int count );
+
+
+/*!
+	\brief Index of the calling thread in the batch it runs, e.g. to pick per-thread scratch memory
+	\return From 0 to WORKERS_MAX_THREADS - 1, 0 for the thread calling workers_run() and outside any batch
+*/
+int workers_get_thread_index( void );
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __WORKERS_H__ */
+
+/* $Id$ */